@@ -0,0 +1,336 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * histfile.c — memory-mapped ring file behind the history store
+ *
+ * Samples are appended by plain stores into a shared mapping; the only
+ * syscall on the sample path is an msync(MS_ASYNC) every HISTFILE_SYNC_S.
+ * See histfile.h for the format. Not thread safe: history.c serialises
+ * appends under its lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "histfile.h"
+
+struct histfile
+{
+    int fd;
+    uint8_t *map;
+    size_t size;
+    uint32_t block;             /* index of the block being filled */
+    uint32_t block_seq;
+    uint32_t record_seq;        /* sequence number of the next record */
+    uint32_t used;              /* records in the current block */
+    uint8_t need_block;
+    int64_t start_s;
+    int64_t synced_s;
+    int32_t last[HISTFILE_SERIES];
+};
+
+static size_t histfile_size(void)
+{
+    return (size_t)HISTFILE_BLOCK_BYTES * (HISTFILE_BLOCKS + 1);
+}
+
+static HistBlockHeader *histfile_block(uint8_t *map, uint32_t i)
+{
+    return (HistBlockHeader *)(map + (size_t)HISTFILE_BLOCK_BYTES * (i + 1));
+}
+
+static HistRecord *histfile_records(HistBlockHeader *b)
+{
+    return (HistRecord *)(b + 1);
+}
+
+static uint16_t histfile_record_tag(uint32_t seq)
+{
+    return (uint16_t)(seq % 65535u + 1);
+}
+
+static int histfile_map(histfile *hf, const char *path)
+{
+    struct stat st;
+
+    hf->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (hf->fd < 0 || fstat(hf->fd, &st) != 0)
+        return -1;
+    if ((size_t)st.st_size != hf->size && ftruncate(hf->fd, 0) != 0)
+        return -1;
+    if (ftruncate(hf->fd, (off_t)hf->size) != 0)
+        return -1;
+    hf->map = (uint8_t *)mmap(NULL, hf->size, PROT_READ | PROT_WRITE, MAP_SHARED, hf->fd, 0);
+    if (hf->map == MAP_FAILED)
+    {
+        hf->map = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Map the ring file at path, creating it if needed. Appends continue in a
+ * new block after the newest one already in the file; a file of another
+ * layout is started afresh. Returns NULL if the file cannot be used.
+ */
+histfile *histfile_open(const char *path)
+{
+    HistFileHeader *hdr;
+    HistBlockHeader *b;
+    histfile *hf;
+    uint32_t i;
+    int s;
+
+    hf = (histfile *)calloc(1, sizeof(*hf));
+    if (!hf)
+        return NULL;
+    hf->fd = -1;
+    hf->size = histfile_size();
+    if (histfile_map(hf, path) != 0)
+    {
+        fprintf(stderr, "histfile: cannot use %s\n", path);
+        histfile_close(hf);
+        return NULL;
+    }
+
+    hdr = (HistFileHeader *)hf->map;
+    if (hdr->magic != HISTFILE_MAGIC || hdr->version != HISTFILE_VERSION ||
+        hdr->block_bytes != HISTFILE_BLOCK_BYTES || hdr->blocks != HISTFILE_BLOCKS)
+    {
+        memset(hf->map, 0, hf->size);
+        hdr->version = HISTFILE_VERSION;
+        hdr->block_bytes = HISTFILE_BLOCK_BYTES;
+        hdr->blocks = HISTFILE_BLOCKS;
+        __sync_synchronize();
+        hdr->magic = HISTFILE_MAGIC;
+    }
+
+    hf->block = HISTFILE_BLOCKS - 1;
+    for (i = 0; i < HISTFILE_BLOCKS; i++)
+    {
+        b = histfile_block(hf->map, i);
+        if (b->seq > hf->block_seq)
+        {
+            hf->block_seq = b->seq;
+            hf->block = i;
+            hf->record_seq = b->first_record + HISTFILE_RECORDS;
+        }
+    }
+    for (s = 0; s < HISTFILE_SERIES; s++)
+        hf->last[s] = HISTFILE_NO_VALUE;
+    hf->need_block = 1;
+    return hf;
+}
+
+/*
+ * Name series in the file header, for the reader
+ */
+void histfile_name(histfile *hf, int series, const char *name)
+{
+    HistFileHeader *hdr;
+
+    if (!hf || series < 0 || series >= HISTFILE_SERIES || !name)
+        return;
+    hdr = (HistFileHeader *)hf->map;
+    strncpy(hdr->names[series], name, HISTFILE_NAME_LEN - 1);
+}
+
+/* Start the next block, keyed with the last value of every series */
+static void histfile_next_block(histfile *hf, int64_t now)
+{
+    HistBlockHeader *b;
+    int s;
+
+    hf->block = (hf->block + 1) % HISTFILE_BLOCKS;
+    b = histfile_block(hf->map, hf->block);
+    b->seq = 0;
+    __sync_synchronize();
+    memset(b + 1, 0, HISTFILE_BLOCK_BYTES - sizeof(*b));
+    b->first_record = hf->record_seq;
+    b->start_s = now;
+    for (s = 0; s < HISTFILE_SERIES; s++)
+        b->key[s] = hf->last[s];
+    __sync_synchronize();
+    b->seq = ++hf->block_seq;
+    hf->start_s = now;
+    hf->used = 0;
+    hf->need_block = 0;
+}
+
+/*
+ * Append value as the newest sample of series
+ */
+void histfile_append(histfile *hf, int series, float value)
+{
+    HistBlockHeader *b;
+    HistRecord *r;
+    int64_t now;
+    double scaled;
+    int32_t q;
+    int64_t delta;
+
+    if (!hf || series < 0 || series >= HISTFILE_SERIES)
+        return;
+
+    scaled = (double)value * HISTFILE_SCALE;
+    scaled += scaled < 0 ? -0.5 : 0.5;
+    if (scaled != scaled || scaled <= (double)INT32_MIN)
+        q = INT32_MIN + 1;
+    else if (scaled > (double)INT32_MAX)
+        q = INT32_MAX;
+    else
+        q = (int32_t)scaled;
+
+    now = (int64_t)time(NULL);
+    delta = 0;
+    if (hf->last[series] != HISTFILE_NO_VALUE)
+    {
+        delta = (int64_t)q - hf->last[series];
+        if (delta < INT16_MIN || delta > INT16_MAX)
+        {
+            /* too big a step for a record: key a new block with the value */
+            hf->last[series] = q;
+            delta = 0;
+            hf->need_block = 1;
+        }
+    }
+    if (hf->need_block || hf->used >= HISTFILE_RECORDS || now < hf->start_s || now - hf->start_s > 65535)
+        histfile_next_block(hf, now);
+    if (hf->last[series] == HISTFILE_NO_VALUE)
+    {
+        /* first sample of the series: the key takes it, ahead of its record */
+        histfile_block(hf->map, hf->block)->key[series] = q;
+        __sync_synchronize();
+    }
+    hf->last[series] = q;
+
+    b = histfile_block(hf->map, hf->block);
+    r = &histfile_records(b)[hf->used];
+    r->series = (uint8_t)series;
+    r->reserved = 0;
+    r->dt_s = (uint16_t)(now - hf->start_s);
+    r->delta = (int16_t)delta;
+    __sync_synchronize();
+    r->seq = histfile_record_tag(hf->record_seq);
+    hf->record_seq++;
+    hf->used++;
+
+    if (now - hf->synced_s >= HISTFILE_SYNC_S)
+    {
+        msync(hf->map, hf->size, MS_ASYNC);
+        hf->synced_s = now;
+    }
+}
+
+void histfile_close(histfile *hf)
+{
+    if (!hf)
+        return;
+    if (hf->map)
+    {
+        msync(hf->map, hf->size, MS_SYNC);
+        munmap(hf->map, hf->size);
+    }
+    if (hf->fd >= 0)
+        close(hf->fd);
+    free(hf);
+}
+
+typedef struct HistOrder
+{
+    uint32_t seq;
+    uint32_t index;
+} HistOrder;
+
+static int histfile_order_cmp(const void *a, const void *b)
+{
+    uint32_t x = ((const HistOrder *)a)->seq;
+    uint32_t y = ((const HistOrder *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Decode every intact sample in the file at path, oldest first, and hand
+ * each to fn. A block is read up to its first record that is out of
+ * sequence. Returns the number of samples, or -1 if the file is not a
+ * history file.
+ */
+int histfile_read(const char *path, histfile_fn fn, void *arg)
+{
+    HistFileHeader *hdr;
+    HistBlockHeader *b;
+    HistRecord *r;
+    HistOrder *order;
+    uint8_t *map;
+    char name[HISTFILE_NAME_LEN];
+    int32_t value[HISTFILE_SERIES];
+    size_t size = histfile_size();
+    struct stat st;
+    uint32_t count = 0;
+    uint32_t i;
+    uint32_t j;
+    int samples = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != size)
+    {
+        close(fd);
+        return -1;
+    }
+    map = (uint8_t *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    hdr = (HistFileHeader *)map;
+    order = (HistOrder *)malloc(sizeof(HistOrder) * HISTFILE_BLOCKS);
+    if (hdr->magic != HISTFILE_MAGIC || hdr->version != HISTFILE_VERSION || !order)
+    {
+        free(order);
+        munmap(map, size);
+        return -1;
+    }
+
+    for (i = 0; i < HISTFILE_BLOCKS; i++)
+    {
+        b = histfile_block(map, i);
+        if (b->seq == 0)
+            continue;
+        order[count].seq = b->seq;
+        order[count].index = i;
+        count++;
+    }
+    qsort(order, count, sizeof(HistOrder), histfile_order_cmp);
+
+    for (i = 0; i < count; i++)
+    {
+        b = histfile_block(map, order[i].index);
+        memcpy(value, b->key, sizeof(value));
+        for (j = 0; j < HISTFILE_RECORDS; j++)
+        {
+            r = &histfile_records(b)[j];
+            if (r->seq != histfile_record_tag(b->first_record + j) || r->series >= HISTFILE_SERIES ||
+                value[r->series] == HISTFILE_NO_VALUE)
+                break;
+            value[r->series] += r->delta;
+            memcpy(name, hdr->names[r->series], sizeof(name));
+            name[sizeof(name) - 1] = '\0';
+            if (fn)
+                fn(arg, b->start_s + r->dt_s, name, (float)value[r->series] / HISTFILE_SCALE);
+            samples++;
+        }
+    }
+
+    free(order);
+    munmap(map, size);
+    return samples;
+}
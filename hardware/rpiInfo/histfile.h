@@ -0,0 +1,72 @@
+#ifndef  __HISTFILE_H
+#define  __HISTFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * On-disk ring of history samples, for reading back what a node was
+ * showing before it died.
+ *
+ * The file is a header block followed by HISTFILE_BLOCKS blocks of
+ * HISTFILE_BLOCK_BYTES, so every block sits in one disk sector. A block
+ * starts with the wall-clock time and the last value of every series
+ * (the key), followed by 8-byte records that carry only the change of one
+ * series since its previous record and the seconds since the block
+ * started. A value that no longer fits starts a new block.
+ *
+ * Both blocks and records have sequence numbers that are written last,
+ * and a reader stops at the first record whose number is out of step, so
+ * a write cut short by power loss only loses the samples it was adding.
+ */
+#define HISTFILE_MAGIC          0x48344d52u   /* "RM4H" */
+#define HISTFILE_VERSION        1
+#define HISTFILE_SERIES         8
+#define HISTFILE_NAME_LEN       16
+#define HISTFILE_BLOCK_BYTES    512
+#define HISTFILE_BLOCKS         4096          /* 2 MB, about 11 hours of the stock series */
+#define HISTFILE_RECORDS        ((HISTFILE_BLOCK_BYTES - sizeof(HistBlockHeader)) / sizeof(HistRecord))
+/* Values are stored in tenths */
+#define HISTFILE_SCALE          10
+#define HISTFILE_NO_VALUE       INT32_MIN
+/* Dirty pages are handed to writeback at most this often */
+#define HISTFILE_SYNC_S         60
+
+typedef struct HistFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_bytes;
+    uint32_t blocks;
+    char names[HISTFILE_SERIES][HISTFILE_NAME_LEN];
+} HistFileHeader;
+
+typedef struct HistBlockHeader
+{
+    uint32_t seq;               /* 0: empty or being rewritten; set last */
+    uint32_t first_record;      /* sequence number of the block's first record */
+    int64_t start_s;            /* wall clock, seconds since the epoch */
+    int32_t key[HISTFILE_SERIES];   /* value in tenths, or HISTFILE_NO_VALUE */
+} HistBlockHeader;
+
+typedef struct HistRecord
+{
+    uint16_t seq;               /* low bits of the record's sequence number plus one; set last */
+    uint8_t series;
+    uint8_t reserved;
+    uint16_t dt_s;              /* seconds since the block started */
+    int16_t delta;              /* tenths, change since the series' previous value */
+} HistRecord;
+
+typedef struct histfile histfile;
+
+/* One decoded sample, as handed to a histfile_read() callback */
+typedef void (*histfile_fn)(void *arg, int64_t time_s, const char *series, float value);
+
+histfile *histfile_open(const char *path);
+void histfile_name(histfile *hf, int series, const char *name);
+void histfile_append(histfile *hf, int series, float value);
+void histfile_close(histfile *hf);
+int histfile_read(const char *path, histfile_fn fn, void *arg);
+
+#endif /*__HISTFILE_H*/
@@ -0,0 +1,449 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * history.c — fixed-memory time series with min/max/avg rollups
+ *
+ * Every series keeps a ring of raw samples and three rings of rollup
+ * buckets (10 s, 1 min, 10 min). Each bucket remembers the epoch (start
+ * time divided by its period) it was filled for, so adding a sample only
+ * touches the current bucket of each level, and stale buckets left behind
+ * by a gap are recognised by their epoch instead of being cleared.
+ *
+ * A query reads buckets, never raw samples: it uses the finest level that
+ * covers the window in at most HISTORY_QUERY_BUCKETS buckets, or the
+ * coarsest level if none does.
+ *
+ * With history_persist() every sample is also appended to a ring file
+ * (histfile.c) that can be read back after a crash, and a series can
+ * feed a quantile sketch (quantile.c) for p95/p99 over a sliding window.
+ * Each sample is then checked against the alert rules on its series
+ * (rules.c).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "history.h"
+#include "histfile.h"
+#include "quantile.h"
+#include "rules.h"
+#include "rpiInfo.h"
+#include "sampler.h"
+
+typedef struct Bucket
+{
+    uint32_t epoch;
+    uint32_t count;             /* 0: empty */
+    float min;
+    float max;
+    double sum;
+} Bucket;
+
+typedef struct Series
+{
+    char name[HISTORY_NAME_LEN];
+    float raw[HISTORY_RAW_LEN];
+    uint32_t raw_count;         /* samples ever added; the newest is at (raw_count - 1) % len */
+    int sketch;                 /* quantile sketch fed by the series, -1 if none */
+    Bucket l0[HISTORY_L0_LEN];
+    Bucket l1[HISTORY_L1_LEN];
+    Bucket l2[HISTORY_L2_LEN];
+} Series;
+
+typedef struct Level
+{
+    uint32_t period_s;
+    uint32_t len;
+} Level;
+
+static const Level levels[HISTORY_LEVELS] = {
+    {HISTORY_L0_SECONDS, HISTORY_L0_LEN},
+    {HISTORY_L1_SECONDS, HISTORY_L1_LEN},
+    {HISTORY_L2_SECONDS, HISTORY_L2_LEN},
+};
+
+static Series series[HISTORY_MAX_SERIES];
+static int series_count;
+static int history_started;
+static histfile *history_file;
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t history_once = PTHREAD_ONCE_INIT;
+
+/* The collector's series come first, at their HISTORY_* ids */
+static void history_init(void)
+{
+    static const char *const names[HISTORY_BUILTIN] = {"cpu", "temp", "ram", "disk", "iolat", "net"};
+    int i;
+
+    for (i = 0; i < HISTORY_MAX_SERIES; i++)
+        series[i].sketch = -1;
+    for (i = 0; i < HISTORY_BUILTIN; i++)
+        snprintf(series[i].name, sizeof(series[i].name), "%s", names[i]);
+    series_count = HISTORY_BUILTIN;
+}
+
+static Bucket *series_level(Series *s, int level)
+{
+    switch (level)
+    {
+    case 0:
+        return s->l0;
+    case 1:
+        return s->l1;
+    default:
+        return s->l2;
+    }
+}
+
+static uint32_t history_now_s(void)
+{
+    return (uint32_t)(sampler_now_us() / 1000000ULL);
+}
+
+static void bucket_add(Bucket *b, uint32_t epoch, float value)
+{
+    if (b->epoch != epoch || b->count == 0)
+    {
+        b->epoch = epoch;
+        b->count = 0;
+        b->min = value;
+        b->max = value;
+        b->sum = 0.0;
+    }
+    if (value < b->min)
+        b->min = value;
+    if (value > b->max)
+        b->max = value;
+    b->sum += value;
+    b->count++;
+}
+
+/* Call with history_lock held */
+static int history_find_locked(const char *name)
+{
+    int i;
+
+    for (i = 0; i < series_count; i++)
+    {
+        if (strcmp(series[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * The id of the series called name, created if it does not exist yet.
+ * Returns -1 if the table is full.
+ */
+int history_series(const char *name)
+{
+    int id;
+
+    pthread_once(&history_once, history_init);
+    if (!name)
+        return -1;
+    pthread_mutex_lock(&history_lock);
+    id = history_find_locked(name);
+    if (id < 0 && series_count < HISTORY_MAX_SERIES)
+    {
+        id = series_count++;
+        memset(&series[id], 0, sizeof(series[id]));
+        series[id].sketch = -1;
+        snprintf(series[id].name, sizeof(series[id].name), "%s", name);
+        histfile_name(history_file, id, series[id].name);
+    }
+    pthread_mutex_unlock(&history_lock);
+    return id;
+}
+
+int history_find(const char *name)
+{
+    int id;
+
+    pthread_once(&history_once, history_init);
+    if (!name)
+        return -1;
+    pthread_mutex_lock(&history_lock);
+    id = history_find_locked(name);
+    pthread_mutex_unlock(&history_lock);
+    return id;
+}
+
+/*
+ * Record value as the newest sample of series id
+ */
+void history_add(int id, float value)
+{
+    Series *s;
+    Bucket *ring;
+    uint32_t now;
+    uint32_t epoch;
+    int i;
+
+    if (id < 0 || id >= HISTORY_MAX_SERIES)
+        return;
+    pthread_once(&history_once, history_init);
+    now = history_now_s();
+
+    pthread_mutex_lock(&history_lock);
+    if (id < series_count)
+    {
+        s = &series[id];
+        s->raw[s->raw_count % HISTORY_RAW_LEN] = value;
+        s->raw_count++;
+        for (i = 0; i < HISTORY_LEVELS; i++)
+        {
+            ring = series_level(s, i);
+            epoch = now / levels[i].period_s;
+            bucket_add(&ring[epoch % levels[i].len], epoch, value);
+        }
+        histfile_append(history_file, id, value);
+        quantile_add(s->sketch, value);
+    }
+    pthread_mutex_unlock(&history_lock);
+    rules_sample(id, value);
+}
+
+/*
+ * Min, max and average of series id over the last window_s seconds,
+ * including the bucket still being filled. The window is rounded up to
+ * whole buckets; stat->span_s says how far back it really reaches.
+ * Returns 0, or -1 if the series is unknown or has no samples in the
+ * window.
+ */
+int history_query(int id, uint32_t window_s, HistoryStat *stat)
+{
+    const Level *level = NULL;
+    Series *s;
+    Bucket *ring;
+    Bucket *b;
+    uint32_t buckets = 0;
+    uint32_t epoch;
+    uint32_t e;
+    double sum = 0.0;
+    int i;
+
+    if (!stat || window_s == 0)
+        return -1;
+    memset(stat, 0, sizeof(*stat));
+
+    for (i = 0; i < HISTORY_LEVELS; i++)
+    {
+        level = &levels[i];
+        buckets = (window_s + level->period_s - 1) / level->period_s;
+        if (buckets <= HISTORY_QUERY_BUCKETS && buckets <= level->len)
+            break;
+    }
+    if (i == HISTORY_LEVELS)
+    {
+        i = HISTORY_LEVELS - 1;
+        if (buckets > level->len)
+            buckets = level->len;
+    }
+    epoch = history_now_s() / level->period_s;
+
+    pthread_once(&history_once, history_init);
+    pthread_mutex_lock(&history_lock);
+    if (id < 0 || id >= series_count)
+    {
+        pthread_mutex_unlock(&history_lock);
+        return -1;
+    }
+    s = &series[id];
+    ring = series_level(s, i);
+    for (e = epoch - buckets + 1; e != epoch + 1; e++)
+    {
+        b = &ring[e % level->len];
+        if (b->epoch != e || b->count == 0)
+            continue;
+        if (stat->count == 0 || b->min < stat->min)
+            stat->min = b->min;
+        if (stat->count == 0 || b->max > stat->max)
+            stat->max = b->max;
+        stat->count += b->count;
+        sum += b->sum;
+    }
+    pthread_mutex_unlock(&history_lock);
+
+    if (stat->count == 0)
+        return -1;
+    stat->avg = (float)(sum / stat->count);
+    stat->span_s = buckets * level->period_s;
+    return 0;
+}
+
+/*
+ * Copy up to max of the newest raw samples of series id to out, oldest
+ * first. Returns how many were copied, or -1 if the series is unknown.
+ */
+int history_recent(int id, float *out, int max)
+{
+    Series *s;
+    uint32_t n;
+    uint32_t first;
+    uint32_t i;
+
+    if (!out || max < 0)
+        return -1;
+    pthread_once(&history_once, history_init);
+    pthread_mutex_lock(&history_lock);
+    if (id < 0 || id >= series_count)
+    {
+        pthread_mutex_unlock(&history_lock);
+        return -1;
+    }
+    s = &series[id];
+    n = s->raw_count < HISTORY_RAW_LEN ? s->raw_count : HISTORY_RAW_LEN;
+    if (n > (uint32_t)max)
+        n = (uint32_t)max;
+    first = s->raw_count - n;
+    for (i = 0; i < n; i++)
+        out[i] = s->raw[(first + i) % HISTORY_RAW_LEN];
+    pthread_mutex_unlock(&history_lock);
+    return (int)n;
+}
+
+/*
+ * Also append every sample to the ring file at path from now on. Returns
+ * 0, or -1 if the file cannot be used.
+ */
+int history_persist(const char *path)
+{
+    histfile *hf;
+    int i;
+
+    pthread_once(&history_once, history_init);
+    hf = histfile_open(path);
+    if (!hf)
+        return -1;
+
+    pthread_mutex_lock(&history_lock);
+    histfile_close(history_file);
+    history_file = hf;
+    for (i = 0; i < series_count; i++)
+        histfile_name(history_file, i, series[i].name);
+    pthread_mutex_unlock(&history_lock);
+    return 0;
+}
+
+/*
+ * Keep a quantile sketch of the last window_s seconds of series id, at a
+ * resolution of 1/scale (see quantile_sketch()). Returns 0, or -1 if the
+ * series is unknown or no sketch is left.
+ */
+int history_track_quantiles(int id, uint32_t window_s, float scale)
+{
+    int sketch;
+
+    pthread_once(&history_once, history_init);
+    if (id < 0 || id >= HISTORY_MAX_SERIES)
+        return -1;
+    pthread_mutex_lock(&history_lock);
+    if (id >= series_count || series[id].sketch >= 0)
+    {
+        pthread_mutex_unlock(&history_lock);
+        return id < series_count ? 0 : -1;
+    }
+    sketch = quantile_sketch(window_s, scale);
+    series[id].sketch = sketch;
+    pthread_mutex_unlock(&history_lock);
+    return sketch >= 0 ? 0 : -1;
+}
+
+/*
+ * The q quantile of series id over its sketch's window, e.g. q = 0.99 for
+ * p99. Returns 0, or -1 if the series has no sketch or no recent samples.
+ */
+int history_quantile(int id, float q, float *value)
+{
+    int sketch = -1;
+
+    pthread_once(&history_once, history_init);
+    pthread_mutex_lock(&history_lock);
+    if (id >= 0 && id < series_count)
+        sketch = series[id].sketch;
+    pthread_mutex_unlock(&history_lock);
+    return quantile_get(sketch, q, value);
+}
+
+static float read_cpu(void)
+{
+    return get_cpu_usage();
+}
+
+static float read_temp(void)
+{
+    return (float)get_temperature();
+}
+
+static float read_net(void)
+{
+    return get_net_rate() / 1024.f;
+}
+
+/*
+ * The stock series, each with its own collector. They are sampled every
+ * HISTORY_INTERVAL_MS while they move by more than noise from one sample
+ * to the next or sit near an alert threshold, and back off to max_ms
+ * while they are flat.
+ */
+typedef struct Metric
+{
+    float (*read)(void);
+    uint32_t max_ms;
+    float noise;
+} Metric;
+
+static const Metric metrics[HISTORY_BUILTIN] = {
+    {read_cpu, 5000, 2.f},              /* HISTORY_CPU, percent */
+    {read_temp, 10000, 0.5f},           /* HISTORY_TEMP, whole degrees */
+    {get_ram_usage, 10000, 1.f},        /* HISTORY_RAM, percent */
+    {get_disk_usage, 60000, 0.1f},      /* HISTORY_DISK, percent */
+    {get_disk_latency, 10000, 1.f},     /* HISTORY_IOLAT, ms */
+    {read_net, 10000, 64.f},            /* HISTORY_NET, KB/s */
+};
+
+static int history_collect(void *arg, void *buf, size_t len)
+{
+    int id = (int)(uintptr_t)arg;
+    float value;
+
+    value = metrics[id].read();
+    history_add(id, value);
+    memcpy(buf, &value, len < sizeof(value) ? len : sizeof(value));
+    return 0;
+}
+
+static int history_near(void *arg, float value)
+{
+    return rules_near((int)(uintptr_t)arg, value);
+}
+
+/*
+ * Start a collector for each stock series, with p95/p99 sketches over
+ * HISTORY_QUANTILE_S for cpu, temp, iolat and net. Returns 0, or -1 if a
+ * collector could not be registered.
+ */
+int history_start(void)
+{
+    int failed = 0;
+    int id;
+    int i;
+
+    if (history_started)
+        return 0;
+    history_started = 1;
+    history_track_quantiles(HISTORY_CPU, HISTORY_QUANTILE_S, 10.f);
+    history_track_quantiles(HISTORY_TEMP, HISTORY_QUANTILE_S, 10.f);
+    history_track_quantiles(HISTORY_IOLAT, HISTORY_QUANTILE_S, 100.f);
+    history_track_quantiles(HISTORY_NET, HISTORY_QUANTILE_S, 10.f);
+    for (i = 0; i < HISTORY_BUILTIN; i++)
+    {
+        id = sampler_register(series[i].name, history_collect, (void *)(uintptr_t)i, sizeof(float),
+                              HISTORY_INTERVAL_MS, 100000);
+        if (id < 0 || sampler_set_adaptive(id, HISTORY_INTERVAL_MS, metrics[i].max_ms, metrics[i].noise,
+                                           history_near, (void *)(uintptr_t)i) != 0)
+            failed++;
+    }
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,63 @@
+#ifndef  __HISTORY_H
+#define  __HISTORY_H
+
+#include <stdint.h>
+
+/*
+ * Fixed-size history of a few metrics: a ring of raw samples, plus
+ * min/max/avg rollups at three resolutions. Sizes are compile-time, so
+ * memory use is fixed and adding a sample never allocates.
+ */
+#define HISTORY_MAX_SERIES      8
+#define HISTORY_NAME_LEN        16
+/*
+ * Raw samples kept per series; the stock series are sampled at most every
+ * HISTORY_INTERVAL_MS, so this is at least 10 minutes of them
+ */
+#define HISTORY_RAW_LEN         600
+#define HISTORY_INTERVAL_MS     1000
+
+/* Rollup resolutions and how many buckets of each are kept */
+#define HISTORY_LEVELS          3
+#define HISTORY_L0_SECONDS      10      /* 1 hour of 10 s buckets */
+#define HISTORY_L0_LEN          360
+#define HISTORY_L1_SECONDS      60      /* 6 hours of 1 min buckets */
+#define HISTORY_L1_LEN          360
+#define HISTORY_L2_SECONDS      600     /* 48 hours of 10 min buckets */
+#define HISTORY_L2_LEN          288
+
+/* A query reads at most this many buckets, moving to a coarser level if needed */
+#define HISTORY_QUERY_BUCKETS   64
+
+/* Series the history collectors feed */
+#define HISTORY_CPU             0       /* percent busy */
+#define HISTORY_TEMP            1       /* degrees, unit set by TEMPERATURE_TYPE */
+#define HISTORY_RAM             2       /* percent used */
+#define HISTORY_DISK            3       /* percent of the root filesystem used */
+#define HISTORY_IOLAT           4       /* ms per disk I/O */
+#define HISTORY_NET             5       /* KB per second, in and out */
+#define HISTORY_BUILTIN         6
+
+/* Window of the quantile sketches the collector keeps for cpu, temp, iolat and net */
+#define HISTORY_QUANTILE_S      300
+
+typedef struct HistoryStat
+{
+    float min;
+    float max;
+    float avg;
+    uint32_t count;             /* samples behind the figures; 0 if none */
+    uint32_t span_s;            /* seconds actually covered, a whole number of buckets */
+} HistoryStat;
+
+int history_series(const char *name);
+int history_find(const char *name);
+void history_add(int id, float value);
+int history_query(int id, uint32_t window_s, HistoryStat *stat);
+int history_recent(int id, float *out, int max);
+int history_persist(const char *path);
+int history_track_quantiles(int id, uint32_t window_s, float scale);
+int history_quantile(int id, float q, float *value);
+int history_start(void);
+
+#endif /*__HISTORY_H*/
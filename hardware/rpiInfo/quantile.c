@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * quantile.c — sliding-window quantile sketches for p95/p99 displays
+ *
+ * See quantile.h for the bucket layout. A query merges the live slices
+ * bucket by bucket, so its cost is QUANTILE_SLICES * QUANTILE_BUCKETS
+ * additions however many samples went in; adding stays O(1).
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "quantile.h"
+#include "sampler.h"
+
+typedef struct QuantileSlice
+{
+    uint32_t epoch;             /* slice start divided by its length */
+    uint32_t total;             /* 0: empty */
+    uint16_t count[QUANTILE_BUCKETS];
+} QuantileSlice;
+
+typedef struct Sketch
+{
+    uint32_t slice_s;
+    float scale;
+    QuantileSlice slice[QUANTILE_SLICES];
+} Sketch;
+
+static Sketch sketches[QUANTILE_MAX_SKETCHES];
+static int sketch_count;
+static pthread_mutex_t quantile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t quantile_index(uint32_t v)
+{
+    uint32_t e;
+    uint32_t shift;
+
+    if (v < QUANTILE_EXACT)
+        return v;
+    e = 31 - (uint32_t)__builtin_clz(v);
+    shift = e - QUANTILE_SUB_BITS;
+    return QUANTILE_EXACT + (e - QUANTILE_SUB_BITS - 1) * QUANTILE_SUB + ((v >> shift) - QUANTILE_SUB);
+}
+
+/* Middle of bucket i, in scaled units */
+static double quantile_value(uint32_t i)
+{
+    uint32_t k;
+    uint32_t shift;
+    double low;
+
+    if (i < QUANTILE_EXACT)
+        return (double)i;
+    k = i - QUANTILE_EXACT;
+    shift = k / QUANTILE_SUB + 1;
+    low = (double)(QUANTILE_SUB + k % QUANTILE_SUB) * (double)(1u << shift);
+    return low + (double)(1u << shift) / 2.0;
+}
+
+static uint32_t quantile_epoch(const Sketch *s)
+{
+    return (uint32_t)(sampler_now_us() / 1000000ULL) / s->slice_s;
+}
+
+/*
+ * A sketch of the last window_s seconds. Values are multiplied by scale
+ * and rounded to integers, so scale sets the resolution near zero, e.g.
+ * 10 for tenths. Returns the sketch id, or -1 if the table is full.
+ */
+int quantile_sketch(uint32_t window_s, float scale)
+{
+    Sketch *s;
+    int id;
+
+    if (scale <= 0.f)
+        return -1;
+    pthread_mutex_lock(&quantile_lock);
+    if (sketch_count >= QUANTILE_MAX_SKETCHES)
+    {
+        pthread_mutex_unlock(&quantile_lock);
+        return -1;
+    }
+    id = sketch_count++;
+    s = &sketches[id];
+    memset(s, 0, sizeof(*s));
+    s->slice_s = window_s / QUANTILE_SLICES ? window_s / QUANTILE_SLICES : 1;
+    s->scale = scale;
+    pthread_mutex_unlock(&quantile_lock);
+    return id;
+}
+
+void quantile_add(int id, float value)
+{
+    QuantileSlice *slice;
+    Sketch *s;
+    double scaled;
+    uint32_t epoch;
+    uint32_t i;
+
+    if (id < 0 || id >= QUANTILE_MAX_SKETCHES)
+        return;
+
+    pthread_mutex_lock(&quantile_lock);
+    if (id < sketch_count)
+    {
+        s = &sketches[id];
+        scaled = (double)value * s->scale + 0.5;
+        if (!(scaled > 0.0))
+            scaled = 0.0;
+        else if (scaled > 4294967295.0)
+            scaled = 4294967295.0;
+
+        epoch = quantile_epoch(s);
+        slice = &s->slice[epoch % QUANTILE_SLICES];
+        if (slice->epoch != epoch || slice->total == 0)
+        {
+            /* the oldest slice goes around again */
+            memset(slice, 0, sizeof(*slice));
+            slice->epoch = epoch;
+        }
+        i = quantile_index((uint32_t)scaled);
+        if (slice->count[i] < UINT16_MAX)
+        {
+            slice->count[i]++;
+            slice->total++;
+        }
+    }
+    pthread_mutex_unlock(&quantile_lock);
+}
+
+/* Whether slice has samples inside the window that ends in epoch now */
+static int quantile_live(uint32_t now, const QuantileSlice *slice)
+{
+    return slice->total != 0 && now - slice->epoch < QUANTILE_SLICES;
+}
+
+/*
+ * The q quantile (0..1) of the samples in the sketch's window, e.g. 0.99
+ * for p99. Returns 0, or -1 if the sketch is unknown or its window empty.
+ */
+int quantile_get(int id, float q, float *value)
+{
+    Sketch *s;
+    uint64_t total = 0;
+    uint64_t rank;
+    uint64_t seen = 0;
+    uint32_t now;
+    uint32_t i;
+    int j;
+
+    if (id < 0 || !value || q < 0.f || q > 1.f)
+        return -1;
+
+    pthread_mutex_lock(&quantile_lock);
+    if (id >= sketch_count)
+    {
+        pthread_mutex_unlock(&quantile_lock);
+        return -1;
+    }
+    s = &sketches[id];
+    now = quantile_epoch(s);
+    for (j = 0; j < QUANTILE_SLICES; j++)
+    {
+        if (quantile_live(now, &s->slice[j]))
+            total += s->slice[j].total;
+    }
+    if (total == 0)
+    {
+        pthread_mutex_unlock(&quantile_lock);
+        return -1;
+    }
+
+    /* the smallest value with at least q of the samples at or below it */
+    rank = (uint64_t)((double)q * (double)total + 0.999999);
+    if (rank == 0)
+        rank = 1;
+    for (i = 0; i < QUANTILE_BUCKETS; i++)
+    {
+        for (j = 0; j < QUANTILE_SLICES; j++)
+        {
+            if (quantile_live(now, &s->slice[j]))
+                seen += s->slice[j].count[i];
+        }
+        if (seen >= rank)
+            break;
+    }
+    if (i == QUANTILE_BUCKETS)
+        i = QUANTILE_BUCKETS - 1;
+    *value = (float)(quantile_value(i) / s->scale);
+    pthread_mutex_unlock(&quantile_lock);
+    return 0;
+}
+
+/*
+ * Samples in the sketch's window
+ */
+uint32_t quantile_count(int id)
+{
+    Sketch *s;
+    uint32_t total = 0;
+    uint32_t now;
+    int j;
+
+    pthread_mutex_lock(&quantile_lock);
+    if (id >= 0 && id < sketch_count)
+    {
+        s = &sketches[id];
+        now = quantile_epoch(s);
+        for (j = 0; j < QUANTILE_SLICES; j++)
+        {
+            if (quantile_live(now, &s->slice[j]))
+                total += s->slice[j].total;
+        }
+    }
+    pthread_mutex_unlock(&quantile_lock);
+    return total;
+}
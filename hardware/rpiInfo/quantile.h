@@ -0,0 +1,29 @@
+#ifndef  __QUANTILE_H
+#define  __QUANTILE_H
+
+#include <stdint.h>
+
+/*
+ * Streaming quantiles over a sliding window, from log-bucketed (HDR style)
+ * histograms. Values are scaled to integers; below QUANTILE_EXACT they
+ * have a bucket each, above it every power of two is split into
+ * QUANTILE_SUB buckets, so a quantile is within 1/QUANTILE_SUB (about 3%)
+ * of the true value. Adding a sample is a clz, a shift and an increment.
+ *
+ * The window is kept as QUANTILE_SLICES histograms of window/QUANTILE_SLICES
+ * seconds each; they merge by adding counts, and the oldest is reused as
+ * time moves on, so memory is fixed per sketch.
+ */
+#define QUANTILE_MAX_SKETCHES   8
+#define QUANTILE_SUB_BITS       5
+#define QUANTILE_SUB            (1u << QUANTILE_SUB_BITS)
+#define QUANTILE_EXACT          (2u * QUANTILE_SUB)
+#define QUANTILE_BUCKETS        (QUANTILE_EXACT + (32 - QUANTILE_SUB_BITS - 1) * QUANTILE_SUB)
+#define QUANTILE_SLICES         10
+
+int quantile_sketch(uint32_t window_s, float scale);
+void quantile_add(int id, float value);
+int quantile_get(int id, float q, float *value);
+uint32_t quantile_count(int id);
+
+#endif /*__QUANTILE_H*/
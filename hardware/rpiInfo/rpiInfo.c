@@ -27,6 +27,9 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/utsname.h>
 
 #include "rpiInfo.h"
 
@@ -58,6 +61,12 @@
 #ifndef CUSTOM_DISPLAY
 #define CUSTOM_DISPLAY "UCTRONICS"
 #endif
+#ifndef HOSTNAME_CHECK_S
+#define HOSTNAME_CHECK_S 10
+#endif
+#ifndef HOSTNAME_LEN
+#define HOSTNAME_LEN 65
+#endif
 #ifndef CELSIUS
 #define CELSIUS 0
 #endif
@@ -161,28 +170,61 @@ static void upcase_ascii(char *s)
 
 /* ---------------- Public API ---------------- */
 
+/*
+ * The hostname as the header shows it: in CAPS when the IP is not shown,
+ * as-is otherwise. The name is formatted once and kept; uname() is called
+ * again at most every HOSTNAME_CHECK_S to see whether it changed. Returns
+ * a generation number that changes whenever the name does.
+ */
+uint32_t get_hostname(char *out, size_t len)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static char cached[HOSTNAME_LEN];
+    static char label[HOSTNAME_LEN];
+    static uint32_t generation;
+    static time_t checked;
+    struct utsname uts;
+    struct timespec ts;
+    uint32_t g;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    pthread_mutex_lock(&lock);
+    if (generation == 0 || ts.tv_sec - checked >= HOSTNAME_CHECK_S)
+    {
+        checked = ts.tv_sec;
+        if (uname(&uts) != 0)
+            strcpy(uts.nodename, "unknown");
+        if (generation == 0 || strncmp(uts.nodename, cached, sizeof(cached) - 1) != 0)
+        {
+            snprintf(cached, sizeof(cached), "%s", uts.nodename);
+            memcpy(label, cached, sizeof(label));
+#if IP_SWITCH == IP_DISPLAY_CLOSE
+            upcase_ascii(label);
+#endif
+            generation++;
+        }
+    }
+    if (out && len)
+        snprintf(out, len, "%s", label);
+    g = generation;
+    pthread_mutex_unlock(&lock);
+    return g;
+}
+
 char* get_ip_address(void)
 {
-    char hostname[256];
-    int rc;
+    char hostname[HOSTNAME_LEN];
     const char *ifname;
     char *ip;
     size_t needed;
     char *result;
 
-    rc = gethostname(hostname, sizeof(hostname));
-    if (rc != 0)
-    {
-        strcpy(hostname, "unknown");
-    }
-    hostname[sizeof(hostname) - 1] = '\0';
+    get_hostname(hostname, sizeof(hostname));
 
 #if IP_SWITCH == IP_DISPLAY_CLOSE
     /* IP disabled: show HOSTNAME ONLY, in CAPS */
-    result = strdup(hostname);
-    if (result != NULL)
-        upcase_ascii(result);
-    return result;
+    return strdup(hostname);
 #else
     /* IP enabled: "hostname ip" (hostname as-is, no label, no colon) */
     ifname = pick_iface();
@@ -340,6 +382,202 @@ uint8_t get_cpu_message(void)
     return (uint8_t)bucket;
 }
 
+/* Fewer jiffies than this between two calls repeat the previous answer */
+#define CPU_USAGE_MIN_JIFFIES 20
+
+/* Busy and total jiffies of all CPUs, from the first line of /proc/stat */
+static int read_cpu_jiffies(unsigned long long *busy, unsigned long long *total)
+{
+    FILE* f;
+    unsigned long long v[8];
+    int n;
+    int i;
+
+    memset(v, 0, sizeof(v));
+    f = fopen("/proc/stat", "r");
+    if (!f)
+        return -1;
+    n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+    fclose(f);
+    if (n < 4)
+        return -1;
+
+    *total = 0;
+    for (i = 0; i < 8; i++)
+        *total += v[i];
+    *busy = *total - v[3] - v[4];   /* minus idle and iowait */
+    return 0;
+}
+
+/* CPU utilisation in percent (0..100) since the previous call, from
+ * /proc/stat; the first call reports the average since boot. Unlike
+ * get_cpu_message() this is the share of time the CPUs were busy, not
+ * the load average. */
+float get_cpu_usage(void)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static unsigned long long last_busy;
+    static unsigned long long last_total;
+    static float last_pct;
+    unsigned long long busy;
+    unsigned long long total;
+    float pct;
+
+    if (read_cpu_jiffies(&busy, &total) != 0)
+        return 0.f;
+
+    pthread_mutex_lock(&lock);
+    if (last_total == 0)
+        pct = total ? (float)busy * 100.0f / (float)total : 0.f;
+    else if (total >= last_total + CPU_USAGE_MIN_JIFFIES && busy >= last_busy)
+        pct = (float)(busy - last_busy) * 100.0f / (float)(total - last_total);
+    else
+        pct = last_pct;         /* too soon for a meaningful ratio */
+    if (last_total == 0 || total >= last_total + CPU_USAGE_MIN_JIFFIES)
+    {
+        last_busy = busy;
+        last_total = total;
+    }
+    if (pct > 100.f)
+        pct = 100.f;
+    last_pct = pct;
+    pthread_mutex_unlock(&lock);
+    return pct;
+}
+
+/* CPU utilisation in percent since the jiffies in last, which are then
+ * moved on; for callers sampling on a clock of their own, e.g. the live
+ * meter, so that get_cpu_usage()'s window is left alone. A zeroed last
+ * gives the average since boot. Returns -1 if /proc/stat cannot be read
+ * or no jiffy has passed. */
+float get_cpu_usage_since(CpuJiffies *last)
+{
+    unsigned long long busy;
+    unsigned long long total;
+    float pct;
+
+    if (read_cpu_jiffies(&busy, &total) != 0 || total <= last->total || busy < last->busy)
+        return -1.f;
+    pct = (float)(busy - last->busy) * 100.0f / (float)(total - last->total);
+    last->busy = busy;
+    last->total = total;
+    return pct > 100.f ? 100.f : pct;
+}
+
+/* Whole disks from /proc/diskstats: I/Os completed and ms spent on them.
+ * Partitions, loop and ram devices are skipped so nothing counts twice. */
+static int read_disk_io(unsigned long long *ios, unsigned long long *ms)
+{
+    FILE* f;
+    char line[256];
+    char name[64];
+    char path[96];
+    unsigned long long rd, rd_ms, wr, wr_ms;
+    unsigned int major, minor;
+
+    f = fopen("/proc/diskstats", "r");
+    if (!f)
+        return -1;
+    *ios = 0;
+    *ms = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "%u %u %63s %llu %*u %*u %llu %llu %*u %*u %llu",
+                   &major, &minor, name, &rd, &rd_ms, &wr, &wr_ms) != 7)
+            continue;
+        if (strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0 || strncmp(name, "zram", 4) == 0)
+            continue;
+        snprintf(path, sizeof(path), "/sys/block/%s", name);
+        if (access(path, F_OK) != 0)
+            continue;
+        *ios += rd + wr;
+        *ms += rd_ms + wr_ms;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Average milliseconds per disk I/O completed since the previous call,
+ * 0 if there was none; the first call reports the average since boot. */
+float get_disk_latency(void)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static unsigned long long last_ios;
+    static unsigned long long last_ms;
+    unsigned long long ios;
+    unsigned long long ms;
+    float latency = 0.f;
+
+    if (read_disk_io(&ios, &ms) != 0)
+        return 0.f;
+
+    pthread_mutex_lock(&lock);
+    if (ios > last_ios && ms >= last_ms)
+        latency = (float)(ms - last_ms) / (float)(ios - last_ios);
+    last_ios = ios;
+    last_ms = ms;
+    pthread_mutex_unlock(&lock);
+    return latency;
+}
+
+/* Bytes received plus sent on every interface but lo */
+static int read_net_bytes(unsigned long long *bytes)
+{
+    FILE* f;
+    char line[256];
+    char *colon;
+    char *name;
+    unsigned long long rx, tx;
+
+    f = fopen("/proc/net/dev", "r");
+    if (!f)
+        return -1;
+    *bytes = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        colon = strchr(line, ':');
+        if (!colon)
+            continue;
+        *colon = '\0';
+        name = line;
+        while (*name == ' ')
+            name++;
+        if (strcmp(name, "lo") == 0)
+            continue;
+        if (sscanf(colon + 1, "%llu %*u %*u %*u %*u %*u %*u %*u %llu", &rx, &tx) == 2)
+            *bytes += rx + tx;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Network throughput in bytes per second since the previous call, all
+ * interfaces but lo, both directions; the first call reports 0. */
+float get_net_rate(void)
+{
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static unsigned long long last_bytes;
+    static struct timespec last_ts;
+    unsigned long long bytes;
+    struct timespec ts;
+    double dt;
+    float rate = 0.f;
+
+    if (read_net_bytes(&bytes) != 0)
+        return 0.f;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    pthread_mutex_lock(&lock);
+    dt = (double)(ts.tv_sec - last_ts.tv_sec) + (double)(ts.tv_nsec - last_ts.tv_nsec) / 1e9;
+    if (last_ts.tv_sec && dt > 0.0 && bytes >= last_bytes)
+        rate = (float)((double)(bytes - last_bytes) / dt);
+    last_bytes = bytes;
+    last_ts = ts;
+    pthread_mutex_unlock(&lock);
+    return rate;
+}
+
 /* Root FS usage, in GB (rounded):
  *  - diskMemSize: total GB
  *  - useMemSize : used  GB
@@ -371,3 +609,25 @@ uint8_t get_hard_disk_memory(uint16_t *diskMemSize, uint16_t *useMemSize)
     *useMemSize  = (uint16_t)((used  + (1ULL << 29)) >> 30);
     return 0;
 }
+
+/* Percent of RAM in use, from the same figures as get_cpu_memory() */
+float get_ram_usage(void)
+{
+    float total = 0.f;
+    float available = 0.f;
+
+    get_cpu_memory(&total, &available);
+    return total > 0.f ? (total - available) * 100.f / total : 0.f;
+}
+
+/* Percent of the root filesystem in use, from a single statvfs. Used is
+ * everything not free, reserved blocks included, which is what the disk
+ * page has always shown. */
+float get_disk_usage(void)
+{
+    struct statvfs vfs;
+
+    if (statvfs("/", &vfs) != 0 || vfs.f_blocks == 0)
+        return 0.f;
+    return (float)((double)(vfs.f_blocks - vfs.f_bfree) * 100.0 / (double)vfs.f_blocks);
+}
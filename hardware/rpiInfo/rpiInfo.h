@@ -2,6 +2,7 @@
 #define  __RPIINFO_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 /**********Select display temperature type**************/
 #define CELSIUS         0
@@ -33,12 +34,30 @@
 #define CUSTOM_DISPLAY     "UCTRONICS"
 /************************IP display switch****************/
 
+/* The hostname is looked up again at most this often; it is cached in between */
+#define HOSTNAME_CHECK_S   10
+#define HOSTNAME_LEN       65
+
+/* Busy and total jiffies of all CPUs, for get_cpu_usage_since() */
+typedef struct CpuJiffies
+{
+    unsigned long long busy;
+    unsigned long long total;
+} CpuJiffies;
+
+uint32_t get_hostname(char *out, size_t len);
 char* get_ip_address(void);
 char* get_ip_address_new(void);
 void get_sd_memory(uint32_t *MemSize, uint32_t *freesize);
 void get_cpu_memory(float *Totalram, float *freeram);
 uint8_t get_temperature(void);
 uint8_t get_cpu_message(void);
+float get_cpu_usage(void);
+float get_cpu_usage_since(CpuJiffies *last);
+float get_disk_latency(void);
+float get_net_rate(void);
 uint8_t get_hard_disk_memory(uint16_t *diskMemSize, uint16_t *useMemSize);
+float get_ram_usage(void);
+float get_disk_usage(void);
 
 #endif /*__RPIINFO_H*/
@@ -0,0 +1,429 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * rules.c — threshold rules with hysteresis and hold times
+ *
+ * Rules are chained per series, so a sample only costs the comparisons
+ * of the rules that read its series. A hold time is checked when a
+ * sample arrives, so a rule fires at most one sample interval after the
+ * condition has held long enough.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "rules.h"
+#include "history.h"
+#include "sampler.h"
+
+enum
+{
+    RULE_GT,
+    RULE_GE,
+    RULE_LT,
+    RULE_LE
+};
+
+typedef struct Rule
+{
+    char expr[RULES_EXPR_LEN];
+    char name[HISTORY_NAME_LEN];    /* the series, as resolved */
+    int series;
+    uint8_t op;
+    uint8_t level;
+    float threshold;
+    float clear;                /* the value must go back past this to clear */
+    uint64_t hold_us;
+    int next;                   /* next rule on the same series plus one, 0 at the end */
+    /* state */
+    uint8_t firing;
+    uint64_t pending_us;        /* when the condition started holding, 0 if it does not */
+    uint64_t since_us;
+    float value;
+} Rule;
+
+/* Other names the stock series are known by */
+static const char *const aliases[][2] = {
+    {"cpu_pct", "cpu"},
+    {"temp_c", "temp"},
+    {"ram_used_pct", "ram"},
+    {"disk_used_pct", "disk"},
+};
+
+static Rule rules[RULES_MAX];
+static int rules_used;
+static int head[HISTORY_MAX_SERIES];    /* first rule on each series plus one, 0 if none */
+static uint32_t generation;
+static pthread_mutex_t rules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+/* Whether p starts with the word kw followed by a space */
+static int keyword(const char *p, const char *kw)
+{
+    size_t n = strlen(kw);
+
+    return strncmp(p, kw, n) == 0 && (p[n] == ' ' || p[n] == '\t');
+}
+
+/* "10s", "500ms", "2m" or "1h"; a bare number is seconds */
+static int parse_duration(const char **p, uint64_t *us)
+{
+    char *end;
+    double v;
+
+    v = strtod(*p, &end);
+    if (end == *p || !(v >= 0.0))
+        return -1;
+    if (strncmp(end, "ms", 2) == 0)
+    {
+        v *= 1e3;
+        end += 2;
+    }
+    else if (*end == 'm')
+    {
+        v *= 60e6;
+        end++;
+    }
+    else if (*end == 'h')
+    {
+        v *= 3600e6;
+        end++;
+    }
+    else
+    {
+        v *= 1e6;
+        if (*end == 's')
+            end++;
+    }
+    *us = (uint64_t)v;
+    *p = end;
+    return 0;
+}
+
+/* "SERIES OP NUMBER [for DURATION] [hyst NUMBER]" into r, naming the series in name */
+static int rule_compile(const char *p, Rule *r, char *name, size_t len)
+{
+    float hyst = 0.f;
+    char *end;
+    size_t n = 0;
+
+    while (isalnum((unsigned char)p[n]) || p[n] == '_')
+        n++;
+    if (n == 0 || n >= len)
+        return -1;
+    memcpy(name, p, n);
+    name[n] = '\0';
+    p = skip_space(p + n);
+
+    if (p[0] == '>' && p[1] == '=')
+        r->op = RULE_GE;
+    else if (p[0] == '<' && p[1] == '=')
+        r->op = RULE_LE;
+    else if (p[0] == '>')
+        r->op = RULE_GT;
+    else if (p[0] == '<')
+        r->op = RULE_LT;
+    else
+        return -1;
+    p = skip_space(p + (p[1] == '=' ? 2 : 1));
+
+    r->threshold = strtof(p, &end);
+    if (end == p)
+        return -1;
+    p = skip_space(end);
+
+    while (*p)
+    {
+        if (keyword(p, "for"))
+        {
+            p = skip_space(p + 3);
+            if (parse_duration(&p, &r->hold_us) != 0)
+                return -1;
+        }
+        else if (keyword(p, "hyst"))
+        {
+            p = skip_space(p + 4);
+            hyst = strtof(p, &end);
+            if (end == p || !(hyst >= 0.f))
+                return -1;
+            p = end;
+        }
+        else
+        {
+            return -1;
+        }
+        p = skip_space(p);
+    }
+    r->clear = r->op == RULE_GT || r->op == RULE_GE ? r->threshold - hyst : r->threshold + hyst;
+    return 0;
+}
+
+/* The stock series an alias stands for, or name itself */
+static const char *rule_series_name(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(aliases) / sizeof(aliases[0]); i++)
+    {
+        if (strcmp(name, aliases[i][0]) == 0)
+            return aliases[i][1];
+    }
+    return name;
+}
+
+/*
+ * Compile expr, e.g. "crit: temp > 75 for 10s hyst 3", and check it from
+ * the next sample of its series on. A series that does not exist yet is
+ * created, so rules can name a plugin's series before it is loaded; that
+ * is warned about on stderr, as it may be a typo. rules_check() tells
+ * once plugins are in. Returns the rule id, or -1 and a message on stderr.
+ */
+int rule_add(const char *expr)
+{
+    char name[HISTORY_NAME_LEN];
+    const char *p;
+    Rule r;
+    int id;
+
+    if (!expr)
+        return -1;
+    memset(&r, 0, sizeof(r));
+    r.level = RULE_WARN;
+    p = skip_space(expr);
+    if (strncmp(p, "warn:", 5) == 0)
+    {
+        p += 5;
+    }
+    else if (strncmp(p, "crit:", 5) == 0)
+    {
+        r.level = RULE_CRIT;
+        p += 5;
+    }
+    p = skip_space(p);
+    snprintf(r.expr, sizeof(r.expr), "%s", p);
+
+    if (rule_compile(p, &r, name, sizeof(name)) != 0)
+    {
+        fprintf(stderr, "rules: cannot parse '%s'\n", expr);
+        return -1;
+    }
+    snprintf(r.name, sizeof(r.name), "%s", rule_series_name(name));
+    if (history_find(r.name) < 0)
+        fprintf(stderr, "rules: no series '%s' yet, '%s' only fires if a plugin adds it\n", r.name, expr);
+    r.series = history_series(r.name);
+    if (r.series < 0)
+    {
+        fprintf(stderr, "rules: no room for series '%s'\n", name);
+        return -1;
+    }
+
+    pthread_mutex_lock(&rules_lock);
+    if (rules_used >= RULES_MAX)
+    {
+        pthread_mutex_unlock(&rules_lock);
+        fprintf(stderr, "rules: more than %d rules\n", RULES_MAX);
+        return -1;
+    }
+    id = rules_used++;
+    r.next = head[r.series];
+    rules[id] = r;
+    head[r.series] = id + 1;
+    pthread_mutex_unlock(&rules_lock);
+    return id;
+}
+
+/*
+ * Warn about rules on a series that nothing feeds: not a stock series,
+ * and no collector of that name. Call once plugins are loaded. Returns
+ * how many rules can never fire.
+ */
+int rules_check(void)
+{
+    int dead = 0;
+    int n = rules_count();
+    int i;
+
+    /* a rule's series and expression do not change once it is added */
+    for (i = 0; i < n; i++)
+    {
+        if (rules[i].series < HISTORY_BUILTIN || sampler_find(rules[i].name) >= 0)
+            continue;
+        fprintf(stderr, "rules: nothing collects '%s', '%s' will never fire\n", rules[i].name, rules[i].expr);
+        dead++;
+    }
+    return dead;
+}
+
+static int rule_holds(const Rule *r, float value, float limit)
+{
+    switch (r->op)
+    {
+    case RULE_GT:
+        return value > limit;
+    case RULE_GE:
+        return value >= limit;
+    case RULE_LT:
+        return value < limit;
+    default:
+        return value <= limit;
+    }
+}
+
+/*
+ * Check the rules on series against its newest sample
+ */
+void rules_sample(int series, float value)
+{
+    Rule *r;
+    uint64_t now;
+    int i;
+
+    if (series < 0 || series >= HISTORY_MAX_SERIES)
+        return;
+    pthread_mutex_lock(&rules_lock);
+    if (!head[series])
+    {
+        pthread_mutex_unlock(&rules_lock);
+        return;
+    }
+    now = sampler_now_us();
+    for (i = head[series]; i; i = r->next)
+    {
+        r = &rules[i - 1];
+        r->value = value;
+        if (!r->firing)
+        {
+            if (!rule_holds(r, value, r->threshold))
+            {
+                r->pending_us = 0;
+                continue;
+            }
+            if (!r->pending_us)
+                r->pending_us = now ? now : 1;
+            if (now - r->pending_us >= r->hold_us)
+            {
+                r->firing = 1;
+                r->since_us = now;
+                __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+            }
+        }
+        else if (!rule_holds(r, value, r->clear))
+        {
+            r->firing = 0;
+            r->pending_us = 0;
+            __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&rules_lock);
+}
+
+int rules_count(void)
+{
+    int n;
+
+    pthread_mutex_lock(&rules_lock);
+    n = rules_used;
+    pthread_mutex_unlock(&rules_lock);
+    return n;
+}
+
+int rules_status(int rule, RuleStatus *status)
+{
+    Rule *r;
+
+    if (rule < 0 || !status)
+        return -1;
+    pthread_mutex_lock(&rules_lock);
+    if (rule >= rules_used)
+    {
+        pthread_mutex_unlock(&rules_lock);
+        return -1;
+    }
+    r = &rules[rule];
+    memcpy(status->expr, r->expr, sizeof(status->expr));
+    status->series = r->series;
+    status->level = r->level;
+    status->firing = r->firing;
+    status->value = r->value;
+    status->since_us = r->since_us;
+    pthread_mutex_unlock(&rules_lock);
+    return 0;
+}
+
+/*
+ * Rules firing now
+ */
+int rules_firing(void)
+{
+    int n = 0;
+    int i;
+
+    pthread_mutex_lock(&rules_lock);
+    for (i = 0; i < rules_used; i++)
+        n += rules[i].firing;
+    pthread_mutex_unlock(&rules_lock);
+    return n;
+}
+
+/*
+ * Whether value is within RULES_NEAR_PCT of a threshold on series, or a
+ * rule there is waiting out its hold time or firing. The sampler watches
+ * such a series at its fastest rate.
+ */
+int rules_near(int series, float value)
+{
+    Rule *r;
+    float margin;
+    float distance;
+    int near = 0;
+    int i;
+
+    if (series < 0 || series >= HISTORY_MAX_SERIES)
+        return 0;
+    pthread_mutex_lock(&rules_lock);
+    for (i = head[series]; i && !near; i = r->next)
+    {
+        r = &rules[i - 1];
+        margin = r->threshold * (RULES_NEAR_PCT / 100.f);
+        if (margin < 0.f)
+            margin = -margin;
+        distance = value > r->threshold ? value - r->threshold : r->threshold - value;
+        near = r->firing || r->pending_us || distance <= margin;
+    }
+    pthread_mutex_unlock(&rules_lock);
+    return near;
+}
+
+/*
+ * Highest severity firing on series, or on any series if series is -1
+ */
+uint8_t rules_level(int series)
+{
+    uint8_t level = RULE_NONE;
+    int i;
+
+    pthread_mutex_lock(&rules_lock);
+    for (i = 0; i < rules_used; i++)
+    {
+        if (rules[i].firing && rules[i].level > level && (series < 0 || rules[i].series == series))
+            level = rules[i].level;
+    }
+    pthread_mutex_unlock(&rules_lock);
+    return level;
+}
+
+/*
+ * Bumped every time a rule fires or clears
+ */
+uint32_t rules_generation(void)
+{
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
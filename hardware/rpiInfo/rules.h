@@ -0,0 +1,44 @@
+#ifndef  __RULES_H
+#define  __RULES_H
+
+#include <stdint.h>
+
+/*
+ * Threshold rules over history series, e.g. "temp > 75 for 10s" or
+ * "crit: disk > 90 hyst 2". A rule is compiled once by rule_add() and
+ * then checked against every new sample of its series, and only of its
+ * series. It fires once the condition has held for its hold time, and
+ * clears when the value falls back past the threshold minus the
+ * hysteresis (plus, for < and <=).
+ */
+#define RULES_MAX               32
+#define RULES_EXPR_LEN          48
+/* A value within this percentage of a threshold is near it, see rules_near() */
+#define RULES_NEAR_PCT          10
+
+/* Severity, from the optional "warn:" or "crit:" prefix */
+#define RULE_NONE               0
+#define RULE_WARN               1
+#define RULE_CRIT               2
+
+typedef struct RuleStatus
+{
+    char expr[RULES_EXPR_LEN];  /* as given, without the severity prefix */
+    int series;
+    uint8_t level;
+    uint8_t firing;
+    float value;                /* latest sample checked */
+    uint64_t since_us;          /* sampler clock when it last fired */
+} RuleStatus;
+
+int rule_add(const char *expr);
+int rules_check(void);
+void rules_sample(int series, float value);
+int rules_count(void);
+int rules_status(int rule, RuleStatus *status);
+int rules_firing(void);
+int rules_near(int series, float value);
+uint8_t rules_level(int series);
+uint32_t rules_generation(void);
+
+#endif /*__RULES_H*/
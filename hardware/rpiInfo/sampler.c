@@ -0,0 +1,457 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * sampler.c — periodic collectors with per-collector time budgets
+ *
+ * Each registered collector runs on its own worker thread at its own
+ * interval and samples into a private scratch buffer. Completed samples
+ * are published under a lock, so readers (page renderers) always get the
+ * latest complete sample without waiting for a collector to finish.
+ *
+ * A collector that overruns its budget is backed off (its interval is
+ * doubled, up to SAMPLER_MAX_BACKOFF times) and is disabled after
+ * SAMPLER_MAX_STRIKES overruns in a row. A collector that blocks outright
+ * only stalls its own worker; the panel keeps rendering its last sample.
+ *
+ * An adaptive collector (sampler_set_adaptive()) picks its own interval
+ * between two bounds from how much its value moves: the average absolute
+ * change between samples follows both the variance and the rate of
+ * change, and is compared with a noise level below which the signal
+ * counts as flat.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sampler.h"
+
+typedef struct Collector
+{
+    char name[32];
+    sampler_fn fn;
+    void *arg;
+    size_t size;
+    uint32_t target_ms;         /* interval before any budget backoff */
+    uint32_t backoff;           /* 1, doubled per overrun up to SAMPLER_MAX_BACKOFF */
+    uint32_t budget_us;
+    uint32_t strikes;
+    uint32_t seq;
+    uint8_t have_sample;
+    uint8_t started;
+    uint8_t adaptive;
+    uint8_t primed;             /* prev holds a value */
+    uint8_t kick;               /* run now instead of at the end of the interval */
+    uint8_t busy;               /* inside fn */
+    float noise;
+    float prev;
+    sampler_near_fn near;
+    void *near_arg;
+    uint64_t last_run_us;
+    uint8_t scratch[SAMPLER_MAX_SAMPLE];
+    uint8_t latest[SAMPLER_MAX_SAMPLE];
+    SamplerStats stats;
+    pthread_cond_t wake;
+    pthread_t thread;
+} Collector;
+
+static Collector collectors[SAMPLER_MAX_COLLECTORS];
+static int collector_count;
+static int sampler_running;
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t sampler_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void deadline_after_ms(struct timespec *ts, uint32_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Budget accounting; called with sampler_lock held. Returns 1 to stop. */
+static int collector_account(Collector *c, uint32_t elapsed)
+{
+    c->stats.runs++;
+    c->stats.last_us = elapsed;
+    if (elapsed > c->stats.max_us)
+        c->stats.max_us = elapsed;
+
+    if (c->budget_us == 0 || elapsed <= c->budget_us)
+    {
+        /* back in budget: decay towards the target interval */
+        c->strikes = 0;
+        if (c->backoff > 1)
+            c->backoff /= 2;
+        c->stats.interval_ms = c->target_ms * c->backoff;
+        return 0;
+    }
+
+    c->stats.overruns++;
+    c->strikes++;
+    if (c->backoff < SAMPLER_MAX_BACKOFF)
+        c->backoff *= 2;
+    c->stats.interval_ms = c->target_ms * c->backoff;
+
+    if (c->strikes >= SAMPLER_MAX_STRIKES)
+    {
+        c->stats.disabled = 1;
+        fprintf(stderr, "sampler: collector '%s' disabled, %u us over a %u us budget\n",
+                c->name, (unsigned)elapsed, (unsigned)c->budget_us);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Move an adaptive collector's target interval after a valid sample;
+ * called with sampler_lock held
+ */
+static void collector_adapt(Collector *c)
+{
+    float value;
+    float change;
+    uint32_t target = c->target_ms;
+
+    memcpy(&value, c->latest, sizeof(value));
+    if (!c->primed)
+    {
+        c->prev = value;
+        c->primed = 1;
+        return;
+    }
+    change = value > c->prev ? value - c->prev : c->prev - value;
+    c->prev = value;
+    if (change != change)
+        change = 0.f;
+    c->stats.activity = (c->stats.activity + change) / 2.f;
+
+    if (c->near && c->near(c->near_arg, value))
+        target = c->stats.min_ms;
+    else if (c->stats.activity > c->noise)
+        target /= 2;
+    else
+        target = target / 4 * SAMPLER_ADAPT_GROWTH + 1;
+    if (target < c->stats.min_ms)
+        target = c->stats.min_ms;
+    if (target > c->stats.max_ms)
+        target = c->stats.max_ms;
+    c->target_ms = target;
+}
+
+/* Time between runs, averaged over the last few; called with sampler_lock held */
+static void collector_period(Collector *c, uint64_t t0)
+{
+    uint32_t period;
+
+    if (c->last_run_us)
+    {
+        period = (uint32_t)((t0 - c->last_run_us) / 1000);
+        c->stats.period_ms = c->stats.period_ms ? (c->stats.period_ms * 3 + period) / 4 : period;
+    }
+    c->last_run_us = t0;
+}
+
+static void *collector_worker(void *arg)
+{
+    Collector *c;
+    struct timespec deadline;
+    uint64_t t0;
+    uint32_t elapsed;
+    int rc;
+
+    c = (Collector *)arg;
+    pthread_mutex_lock(&sampler_lock);
+    while (sampler_running)
+    {
+        c->busy = 1;
+        pthread_mutex_unlock(&sampler_lock);
+
+        t0 = sampler_now_us();
+        rc = c->fn(c->arg, c->scratch, c->size);
+        elapsed = (uint32_t)(sampler_now_us() - t0);
+
+        pthread_mutex_lock(&sampler_lock);
+        c->busy = 0;
+        collector_period(c, t0);
+        if (rc == 0)
+        {
+            memcpy(c->latest, c->scratch, c->size);
+            c->have_sample = 1;
+            c->seq++;
+            if (c->adaptive)
+                collector_adapt(c);
+        }
+        else
+        {
+            c->stats.failures++;
+        }
+        if (collector_account(c, elapsed))
+            break;
+
+        deadline_after_ms(&deadline, c->stats.interval_ms);
+        while (sampler_running && !c->kick)
+        {
+            if (pthread_cond_timedwait(&c->wake, &sampler_lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+        c->kick = 0;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+    return NULL;
+}
+
+/*
+ * Register a collector. It starts sampling on sampler_start(), or right
+ * away if the sampler is already running. Returns the collector id, or -1.
+ */
+int sampler_register(const char *name, sampler_fn fn, void *arg, size_t sample_size,
+                     uint32_t interval_ms, uint32_t budget_us)
+{
+    pthread_condattr_t attr;
+    Collector *c;
+    int id;
+
+    if (!fn || sample_size == 0 || sample_size > SAMPLER_MAX_SAMPLE || interval_ms == 0)
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (collector_count >= SAMPLER_MAX_COLLECTORS)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        return -1;
+    }
+    id = collector_count++;
+    c = &collectors[id];
+    memset(c, 0, sizeof(*c));
+    snprintf(c->name, sizeof(c->name), "%s", name ? name : "?");
+    c->fn = fn;
+    c->arg = arg;
+    c->size = sample_size;
+    c->target_ms = interval_ms;
+    c->backoff = 1;
+    c->budget_us = budget_us;
+    c->stats.interval_ms = interval_ms;
+    c->stats.min_ms = interval_ms;
+    c->stats.max_ms = interval_ms;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (sampler_running && pthread_create(&c->thread, NULL, collector_worker, c) == 0)
+        c->started = 1;
+    pthread_mutex_unlock(&sampler_lock);
+    return id;
+}
+
+/*
+ * Copy the latest complete sample of collector id into buf.
+ * Returns the number of bytes copied, or -1 if there is no sample yet.
+ */
+int sampler_read(int id, void *buf, size_t len, uint32_t *seq)
+{
+    int n;
+
+    if (id < 0 || !buf)
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (id >= collector_count || !collectors[id].have_sample)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        return -1;
+    }
+    n = (int)(len < collectors[id].size ? len : collectors[id].size);
+    memcpy(buf, collectors[id].latest, (size_t)n);
+    if (seq)
+        *seq = collectors[id].seq;
+    pthread_mutex_unlock(&sampler_lock);
+    return n;
+}
+
+/*
+ * Let collector id choose its interval between min_ms and max_ms. Its
+ * sample must start with a float, the value that is watched: a change of
+ * more than noise between samples counts as movement, and near (if not
+ * NULL) says when the value is close enough to a threshold to sample at
+ * min_ms regardless. Returns 0, or -1 if the arguments are bad.
+ */
+int sampler_set_adaptive(int id, uint32_t min_ms, uint32_t max_ms, float noise,
+                         sampler_near_fn near, void *near_arg)
+{
+    Collector *c;
+
+    if (id < 0 || min_ms == 0 || max_ms < min_ms || !(noise >= 0.f))
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (id >= collector_count || collectors[id].size < sizeof(float))
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        return -1;
+    }
+    c = &collectors[id];
+    c->adaptive = 1;
+    c->noise = noise;
+    c->near = near;
+    c->near_arg = near_arg;
+    c->stats.min_ms = min_ms;
+    c->stats.max_ms = max_ms;
+    if (c->target_ms < min_ms)
+        c->target_ms = min_ms;
+    if (c->target_ms > max_ms)
+        c->target_ms = max_ms;
+    c->stats.interval_ms = c->target_ms * c->backoff;
+    pthread_mutex_unlock(&sampler_lock);
+    return 0;
+}
+
+int sampler_get_stats(int id, SamplerStats *stats)
+{
+    if (id < 0 || !stats)
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (id >= collector_count)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        return -1;
+    }
+    *stats = collectors[id].stats;
+    pthread_mutex_unlock(&sampler_lock);
+    return 0;
+}
+
+/*
+ * Run collector id now rather than at the end of its interval, unless its
+ * latest run started less than max_age_ms ago or it is running already.
+ * The interval then starts again from that run. Returns 1 if the
+ * collector was woken, 0 if its sample is fresh enough, or -1.
+ */
+int sampler_trigger(int id, uint32_t max_age_ms)
+{
+    Collector *c;
+    int woken = 0;
+
+    if (id < 0)
+        return -1;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (id >= collector_count)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        return -1;
+    }
+    c = &collectors[id];
+    if (c->started && !c->busy && !c->stats.disabled &&
+        sampler_now_us() - c->last_run_us >= (uint64_t)max_age_ms * 1000)
+    {
+        c->kick = 1;
+        pthread_cond_signal(&c->wake);
+        woken = 1;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+    return woken;
+}
+
+/*
+ * The id of the collector called name, or -1
+ */
+int sampler_find(const char *name)
+{
+    int id = -1;
+    int i;
+
+    if (!name)
+        return -1;
+    pthread_mutex_lock(&sampler_lock);
+    for (i = 0; i < collector_count && id < 0; i++)
+    {
+        if (strcmp(collectors[i].name, name) == 0)
+            id = i;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+    return id;
+}
+
+int sampler_count(void)
+{
+    int n;
+
+    pthread_mutex_lock(&sampler_lock);
+    n = collector_count;
+    pthread_mutex_unlock(&sampler_lock);
+    return n;
+}
+
+/* The name of collector id, or NULL; it stays valid for good */
+const char *sampler_name(int id)
+{
+    const char *name = NULL;
+
+    if (id < 0)
+        return NULL;
+    pthread_mutex_lock(&sampler_lock);
+    if (id < collector_count)
+        name = collectors[id].name;
+    pthread_mutex_unlock(&sampler_lock);
+    return name;
+}
+
+int sampler_start(void)
+{
+    int i;
+    int failed;
+
+    failed = 0;
+    pthread_mutex_lock(&sampler_lock);
+    sampler_running = 1;
+    for (i = 0; i < collector_count; i++)
+    {
+        if (collectors[i].started || collectors[i].stats.disabled)
+            continue;
+        if (pthread_create(&collectors[i].thread, NULL, collector_worker, &collectors[i]) == 0)
+            collectors[i].started = 1;
+        else
+            failed++;
+    }
+    pthread_mutex_unlock(&sampler_lock);
+    return failed ? -1 : 0;
+}
+
+/* Stop all workers. A collector stuck inside its callback delays this. */
+void sampler_stop(void)
+{
+    int i;
+    int n;
+
+    pthread_mutex_lock(&sampler_lock);
+    sampler_running = 0;
+    n = collector_count;
+    for (i = 0; i < n; i++)
+        pthread_cond_signal(&collectors[i].wake);
+    pthread_mutex_unlock(&sampler_lock);
+
+    for (i = 0; i < n; i++)
+    {
+        if (collectors[i].started)
+        {
+            pthread_join(collectors[i].thread, NULL);
+            collectors[i].started = 0;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef  __SAMPLER_H
+#define  __SAMPLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Collectors the sampler can hold, and the largest sample each may produce */
+#define SAMPLER_MAX_COLLECTORS  16
+#define SAMPLER_MAX_SAMPLE      256
+/* A collector over budget this many times in a row is switched off */
+#define SAMPLER_MAX_STRIKES     5
+/* Over-budget collectors back off up to this multiple of their interval */
+#define SAMPLER_MAX_BACKOFF     16
+/*
+ * An adaptive collector that has been flat for a sample stretches its
+ * interval by this many quarters, up to its maximum; one that moves by
+ * more than its noise level halves it, and one near a threshold goes
+ * straight to its minimum
+ */
+#define SAMPLER_ADAPT_GROWTH    5
+
+/* Fill buf (len bytes) with a new sample. Return 0 if the sample is valid. */
+typedef int (*sampler_fn)(void *arg, void *buf, size_t len);
+/* Nonzero if value is close to where something happens, e.g. an alert threshold */
+typedef int (*sampler_near_fn)(void *arg, float value);
+
+typedef struct SamplerStats
+{
+    uint32_t runs;
+    uint32_t failures;       /* collector returned non-zero */
+    uint32_t overruns;       /* collector took longer than its budget */
+    uint32_t interval_ms;    /* current interval, including any backoff */
+    uint32_t min_ms;         /* adaptive bounds; both the registered interval if fixed */
+    uint32_t max_ms;
+    uint32_t period_ms;      /* measured time between runs, averaged */
+    float activity;          /* average change between samples, adaptive collectors only */
+    uint32_t last_us;
+    uint32_t max_us;
+    uint8_t  disabled;
+} SamplerStats;
+
+uint64_t sampler_now_us(void);
+int sampler_register(const char *name, sampler_fn fn, void *arg, size_t sample_size,
+                     uint32_t interval_ms, uint32_t budget_us);
+int sampler_read(int id, void *buf, size_t len, uint32_t *seq);
+int sampler_set_adaptive(int id, uint32_t min_ms, uint32_t max_ms, float noise,
+                         sampler_near_fn near, void *near_arg);
+int sampler_get_stats(int id, SamplerStats *stats);
+int sampler_trigger(int id, uint32_t max_age_ms);
+int sampler_find(const char *name);
+int sampler_count(void);
+const char *sampler_name(int id);
+int sampler_start(void);
+void sampler_stop(void);
+
+#endif /*__SAMPLER_H*/
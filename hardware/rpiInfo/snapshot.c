@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * snapshot.c — all system readings in one call, behind a stable ABI
+ *
+ * Wraps the rpiInfo.c collectors so FFI callers (the Python module,
+ * ctypes scripts) can fill a dashboard without spawning vcgencmd, free,
+ * df or top.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "rpiInfo.h"
+#include "sampler.h"
+
+/*
+ * Fill the first size bytes of snap. size must cover at least version and
+ * size, and is normally sizeof(rpi_snapshot) as the caller compiled it.
+ * Returns 0, or -1 if size is too small.
+ */
+int rpi_snapshot_take(rpi_snapshot *snap, uint32_t size)
+{
+    rpi_snapshot s;
+    uint16_t disk_total;
+    uint16_t disk_used;
+    char *line;
+    FILE *f;
+
+    if (!snap || size < offsetof(rpi_snapshot, taken_us))
+        return -1;
+
+    memset(&s, 0, sizeof(s));
+    s.version = RPI_SNAPSHOT_VERSION;
+    s.size = size < sizeof(s) ? size : (uint32_t)sizeof(s);
+    s.taken_us = sampler_now_us();
+
+    s.cpu_percent = get_cpu_usage();
+    f = fopen("/proc/loadavg", "r");
+    if (f)
+    {
+        if (fscanf(f, "%f", &s.load1) != 1)
+            s.load1 = 0.f;
+        fclose(f);
+    }
+    s.temperature = (float)get_temperature();
+    get_cpu_memory(&s.ram_total_mb, &s.ram_available_mb);
+    if (get_hard_disk_memory(&disk_total, &disk_used) == 0)
+    {
+        s.disk_total_gb = (float)disk_total;
+        s.disk_used_gb = (float)disk_used;
+    }
+
+    if (gethostname(s.hostname, sizeof(s.hostname)) != 0)
+        snprintf(s.hostname, sizeof(s.hostname), "%s", "unknown");
+    s.hostname[sizeof(s.hostname) - 1] = '\0';
+    line = get_ip_address();
+    snprintf(s.address, sizeof(s.address), "%s", line ? line : s.hostname);
+    free(line);
+
+    memcpy(snap, &s, s.size);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef  __SNAPSHOT_H
+#define  __SNAPSHOT_H
+
+#include <stdint.h>
+
+/*
+ * Everything the stock pages show, read in one call. The layout is a
+ * stable ABI for FFI callers: fields are only ever appended, version is
+ * bumped when they are, and callers pass the size of the struct they were
+ * built against, so old callers keep working with newer libraries.
+ */
+#define RPI_SNAPSHOT_VERSION  1
+
+#define RPI_SNAPSHOT_HOST_LEN 64
+#define RPI_SNAPSHOT_ADDR_LEN 64
+
+typedef struct rpi_snapshot
+{
+    uint32_t version;           /* RPI_SNAPSHOT_VERSION of the library */
+    uint32_t size;              /* bytes the library filled in */
+    uint64_t taken_us;          /* monotonic, see sampler_now_us() */
+
+    float cpu_percent;          /* busy share of all CPUs since the previous snapshot */
+    float load1;                /* 1-minute load average */
+    float temperature;          /* degrees, unit set by TEMPERATURE_TYPE */
+    float ram_total_mb;
+    float ram_available_mb;
+    float disk_total_gb;        /* root filesystem */
+    float disk_used_gb;
+
+    char hostname[RPI_SNAPSHOT_HOST_LEN];
+    char address[RPI_SNAPSHOT_ADDR_LEN];  /* first line of the CPU page, "hostname ip" */
+} rpi_snapshot;
+
+int rpi_snapshot_take(rpi_snapshot *snap, uint32_t size);
+
+#endif /*__SNAPSHOT_H*/
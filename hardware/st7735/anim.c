@@ -0,0 +1,84 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "anim.h"
+#include "lcd_ctx.h"
+#include "sampler.h"
+
+/*
+ * The value widget key should draw now, on its way to target. A key seen
+ * for the first time starts at target; when target changes, the value
+ * moves there from wherever it is over LCD_ANIM_MS, easing out. The
+ * least recently used key is dropped when every slot is taken.
+ */
+float lcd_ctx_animate(lcd_ctx *ctx, uint32_t key, float target)
+{
+    LcdAnimSet *set = &ctx->anim;
+    LcdAnim *a = NULL;
+    LcdAnim *victim = &set->slot[0];
+    uint64_t now = sampler_now_us();
+    uint64_t dt;
+    float t;
+    float value;
+    int i;
+
+    if (!set->enabled)
+        return target;
+    set->clock++;
+    for (i = 0; i < LCD_ANIM_SLOTS; i++)
+    {
+        if (set->slot[i].key == key)
+        {
+            a = &set->slot[i];
+            break;
+        }
+        if (set->slot[i].stamp < victim->stamp)
+            victim = &set->slot[i];
+    }
+    if (!a)
+    {
+        a = victim;
+        a->key = key;
+        a->from = target;
+        a->to = target;
+        a->start_us = now;
+    }
+    a->stamp = set->clock;
+
+    dt = now - a->start_us;
+    if (dt >= (uint64_t)LCD_ANIM_MS * 1000)
+    {
+        value = a->to;
+    }
+    else
+    {
+        t = (float)dt / (float)(LCD_ANIM_MS * 1000);
+        t = 1.f - (1.f - t) * (1.f - t);
+        value = a->from + (a->to - a->from) * t;
+    }
+
+    if (target != a->to)
+    {
+        a->from = value;
+        a->to = target;
+        a->start_us = now;
+    }
+    if (value != a->to)
+        set->moving = 1;
+    return value;
+}
+
+/*
+ * Start drawing a frame: forget whether the previous one had values moving
+ */
+void lcd_ctx_anim_begin(lcd_ctx *ctx)
+{
+    ctx->anim.moving = 0;
+}
+
+/*
+ * Whether a value drawn since lcd_ctx_anim_begin() has not arrived yet,
+ * i.e. the page wants another frame
+ */
+uint8_t lcd_ctx_anim_moving(lcd_ctx *ctx)
+{
+    return ctx->anim.moving;
+}
@@ -0,0 +1,55 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __ANIM_H__
+#define __ANIM_H__
+
+#include <stdint.h>
+
+/*
+ * Animated widget values. A widget asks for the value it should draw
+ * now with lcd_ctx_animate(); when the value it was given changes, it
+ * moves from where it was to the new one over LCD_ANIM_MS instead of
+ * jumping. The page scheduler draws the page again every frame while
+ * anything is moving, and turns animation on when it takes a context;
+ * otherwise, e.g. for the legacy API, values jump as they always did.
+ */
+#define LCD_ANIM_SLOTS  16
+#define LCD_ANIM_MS     300
+/* Frames per second an animation aims for; fewer if the bus cannot keep up */
+#define LCD_ANIM_FPS    25
+
+/* Keys: what kind of widget, and which series it shows */
+#define LCD_ANIM_BAR    1
+#define LCD_ANIM_GAUGE  2
+#define LCD_ANIM_KEY(kind, id) (((uint32_t)(kind) << 8) | (uint8_t)(id))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct LcdAnim{
+  uint32_t key;          /* 0: free */
+  float from;
+  float to;
+  uint64_t start_us;
+  uint32_t stamp;        /* last use, for eviction */
+}LcdAnim;
+
+/* Animation state; every lcd_ctx carries its own */
+typedef struct LcdAnimSet{
+  LcdAnim slot[LCD_ANIM_SLOTS];
+  uint32_t clock;
+  uint8_t enabled;       /* something draws the frames in between */
+  uint8_t moving;        /* a value drawn since the last lcd_ctx_anim_begin() is still on its way */
+}LcdAnimSet;
+
+struct lcd_ctx;
+
+extern float lcd_ctx_animate(struct lcd_ctx *ctx, uint32_t key, float target);
+extern void lcd_ctx_anim_begin(struct lcd_ctx *ctx);
+extern uint8_t lcd_ctx_anim_moving(struct lcd_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ANIM_H__
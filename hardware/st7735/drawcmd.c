@@ -0,0 +1,156 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "drawcmd.h"
+#include "lcd_ctx.h"
+#include "textlayout.h"
+#include <string.h>
+
+static uint16_t cmd_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/*
+ * Bytes a record of this op must have, given its fixed fields; 0 for an
+ * unknown op
+ */
+static uint32_t cmd_size(const uint8_t *rec)
+{
+    const uint8_t *f = rec + LCD_CMD_HEADER;
+    uint64_t pixels;
+
+    switch (rec[0])
+    {
+    case LCD_CMD_FILL:
+        return LCD_CMD_HEADER + 10;
+    case LCD_CMD_TEXT:
+        return LCD_CMD_HEADER + 14 + f[13];
+    case LCD_CMD_IMAGE:
+        pixels = (uint64_t)cmd_u16(f + 4) * cmd_u16(f + 6);
+        return (pixels > 0xFFFF) ? 0 : LCD_CMD_HEADER + 8 + (uint32_t)pixels * 2;
+    case LCD_CMD_BAR:
+        return LCD_CMD_HEADER + 14;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Walk the buffer without drawing; returns the number of records, or -1
+ * if a record is truncated, unknown or the wrong size
+ */
+static int cmd_check(const uint8_t *buf, uint32_t len)
+{
+    uint32_t off = 0;
+    uint32_t size;
+    uint32_t need;
+    int count = 0;
+
+    while (off < len)
+    {
+        if (len - off < LCD_CMD_HEADER)
+            return -1;
+        size = cmd_u16(buf + off + 2);
+        if (size < LCD_CMD_HEADER || size > len - off)
+            return -1;
+        /* the fixed fields must be there before cmd_size() reads them */
+        if ((buf[off] == LCD_CMD_TEXT && size < LCD_CMD_HEADER + 14) ||
+            (buf[off] == LCD_CMD_IMAGE && size < LCD_CMD_HEADER + 8))
+            return -1;
+        need = cmd_size(buf + off);
+        if (need == 0 || need != size)
+            return -1;
+        off += size;
+        count++;
+    }
+    return count;
+}
+
+static void cmd_text(lcd_ctx *ctx, const uint8_t *f)
+{
+    char str[TEXT_LAYOUT_MAX_LEN + 1];
+    uint16_t x = cmd_u16(f);
+    uint16_t y = cmd_u16(f + 2);
+    uint16_t w = cmd_u16(f + 4);
+    uint16_t h = cmd_u16(f + 6);
+    uint16_t color = cmd_u16(f + 8);
+    uint16_t bgcolor = cmd_u16(f + 10);
+    uint8_t font = f[12];
+    uint32_t n = f[13];
+
+    if (n > TEXT_LAYOUT_MAX_LEN)
+        n = TEXT_LAYOUT_MAX_LEN;
+    memcpy(str, f + 14, n);
+    str[n] = '\0';
+
+    if (w)
+        text_ctx_draw(ctx, text_ctx_layout(ctx, str, x, y, w, h, TextOverflow_Ellipsis), color, bgcolor);
+    else if (font <= FontType_16x26)
+        lcd_ctx_write_str(ctx, x, y, str, (FontType)font, color, bgcolor);
+}
+
+static void cmd_bar(lcd_ctx *ctx, const uint8_t *f)
+{
+    uint16_t x = cmd_u16(f);
+    uint16_t y = cmd_u16(f + 2);
+    uint16_t w = cmd_u16(f + 4);
+    uint16_t h = cmd_u16(f + 6);
+    uint8_t percent = f[12] > 100 ? 100 : f[12];
+    uint16_t fill = (uint16_t)((uint32_t)w * percent / 100);
+
+    if (fill)
+        lcd_ctx_fill_rectangle(ctx, x, y, fill, h, cmd_u16(f + 8));
+    if (fill < w)
+        lcd_ctx_fill_rectangle(ctx, x + fill, y, w - fill, h, cmd_u16(f + 10));
+}
+
+/*
+ * Run a command buffer (see drawcmd.h) as one frame: everything is drawn
+ * into the shadow framebuffer and sent with a single flush, unless ctx is
+ * deferred, in which case the caller flushes. A malformed buffer draws
+ * nothing. Returns the number of commands run, or -1.
+ */
+int lcd_ctx_submit(lcd_ctx *ctx, const uint8_t *buf, uint32_t len)
+{
+    const uint8_t *f;
+    uint32_t off = 0;
+    uint8_t deferred;
+    int count;
+
+    if (!ctx || (!buf && len))
+        return -1;
+    count = cmd_check(buf, len);
+    if (count <= 0)
+        return count;
+
+    deferred = ctx->deferred;
+    ctx->deferred = 1;
+    while (off < len)
+    {
+        f = buf + off + LCD_CMD_HEADER;
+        switch (buf[off])
+        {
+        case LCD_CMD_FILL:
+            lcd_ctx_fill_rectangle(ctx, cmd_u16(f), cmd_u16(f + 2), cmd_u16(f + 4), cmd_u16(f + 6), cmd_u16(f + 8));
+            break;
+        case LCD_CMD_TEXT:
+            cmd_text(ctx, f);
+            break;
+        case LCD_CMD_IMAGE:
+            lcd_ctx_draw_image(ctx, cmd_u16(f), cmd_u16(f + 2), cmd_u16(f + 4), cmd_u16(f + 6), f + 8);
+            break;
+        case LCD_CMD_BAR:
+            cmd_bar(ctx, f);
+            break;
+        default:
+            break;
+        }
+        off += cmd_u16(buf + off + 2);
+    }
+    lcd_ctx_set_deferred(ctx, deferred);
+    return count;
+}
+
+int lcd_submit(const uint8_t *buf, uint32_t len)
+{
+    return lcd_ctx_submit(lcd_default_ctx(), buf, len);
+}
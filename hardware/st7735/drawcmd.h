@@ -0,0 +1,44 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __DRAWCMD_H__
+#define __DRAWCMD_H__
+
+#include <stdint.h>
+
+/*
+ * Command buffers: a frame's worth of drawing packed into one byte array
+ * and run with a single call, so FFI callers cross into the library once
+ * per frame instead of once per primitive.
+ *
+ * A buffer is a sequence of records. Every record starts with a 4-byte
+ * header, op (u8), reserved (u8, 0) and size (u16, the whole record in
+ * bytes), followed by the op's fields. All multi-byte fields are
+ * little-endian.
+ *
+ *   FILL   x y w h color                          u16 x5
+ *   TEXT   x y w h color bgcolor font len text    u16 x6, u8, u8, len bytes
+ *          w == 0: draw in font at (x, y)
+ *          w  > 0: fit the w x h box, largest font first, ellipsis if too long
+ *   IMAGE  x y w h pixels                         u16 x4, w*h big-endian RGB565
+ *   BAR    x y w h color bgcolor percent pad      u16 x6, u8, u8
+ */
+#define LCD_CMD_FILL   1
+#define LCD_CMD_TEXT   2
+#define LCD_CMD_IMAGE  3
+#define LCD_CMD_BAR    4
+
+#define LCD_CMD_HEADER 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lcd_ctx;
+
+extern int lcd_ctx_submit(struct lcd_ctx *ctx, const uint8_t *buf, uint32_t len);
+extern int lcd_submit(const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __DRAWCMD_H__
@@ -0,0 +1,216 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "fbstore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct FbSlot
+{
+    volatile uint32_t seq;       /* 0: never written */
+    uint32_t crc;                /* over pixels */
+    uint32_t reserved[2];
+} FbSlot;
+
+typedef struct FbHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint32_t slot_bytes;         /* header of a slot plus its pixels */
+    uint32_t reserved[4];
+} FbHeader;
+
+struct fbstore
+{
+    int fd;
+    uint8_t *map;
+    size_t size;
+    uint32_t pixels;
+    uint32_t slot_bytes;
+    int newest;                  /* slot of the newest intact frame, -1 if none */
+};
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+    uint32_t c;
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_of(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t c = 0xFFFFFFFFu;
+
+    while (len--)
+        c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static FbSlot *fbstore_slot(fbstore *store, int i)
+{
+    return (FbSlot *)(store->map + sizeof(FbHeader) + (size_t)i * store->slot_bytes);
+}
+
+static uint16_t *fbstore_pixels(FbSlot *slot)
+{
+    return (uint16_t *)(slot + 1);
+}
+
+/* The newest slot whose pixels match their checksum, or -1 */
+static int fbstore_newest(fbstore *store)
+{
+    FbSlot *slot;
+    int best = -1;
+    uint32_t best_seq = 0;
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        slot = fbstore_slot(store, i);
+        if (slot->seq == 0 || (best >= 0 && slot->seq <= best_seq))
+            continue;
+        if (crc32_of(fbstore_pixels(slot), store->pixels * 2) != slot->crc)
+            continue;
+        best = i;
+        best_seq = slot->seq;
+    }
+    return best;
+}
+
+static int fbstore_map(fbstore *store, const char *path)
+{
+    struct stat st;
+
+    store->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (store->fd < 0 || fstat(store->fd, &st) != 0)
+        return -1;
+    /* a file of another size is from another layout: start afresh */
+    if ((size_t)st.st_size != store->size && ftruncate(store->fd, 0) != 0)
+        return -1;
+    if (ftruncate(store->fd, (off_t)store->size) != 0)
+        return -1;
+    store->map = (uint8_t *)mmap(NULL, store->size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    if (store->map == MAP_FAILED)
+    {
+        store->map = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Map the store at path, creating it if needed. A file written for a
+ * different panel geometry or format is started afresh. Returns NULL if
+ * the file cannot be created or mapped.
+ */
+fbstore *fbstore_open(const char *path, uint16_t width, uint16_t height)
+{
+    fbstore *store;
+    FbHeader *hdr;
+
+    if (!crc_table[1])
+        crc_init();
+
+    store = (fbstore *)calloc(1, sizeof(*store));
+    if (!store)
+        return NULL;
+    store->fd = -1;
+    store->pixels = (uint32_t)width * height;
+    store->slot_bytes = sizeof(FbSlot) + store->pixels * 2;
+    store->size = sizeof(FbHeader) + 2 * (size_t)store->slot_bytes;
+    if (fbstore_map(store, path) != 0)
+    {
+        fprintf(stderr, "fbstore: cannot use %s\n", path);
+        fbstore_close(store);
+        return NULL;
+    }
+
+    hdr = (FbHeader *)store->map;
+    if (hdr->magic != FBSTORE_MAGIC || hdr->version != FBSTORE_VERSION ||
+        hdr->width != width || hdr->height != height || hdr->slot_bytes != store->slot_bytes)
+    {
+        memset(store->map, 0, store->size);
+        hdr->version = FBSTORE_VERSION;
+        hdr->width = width;
+        hdr->height = height;
+        hdr->slot_bytes = store->slot_bytes;
+        __sync_synchronize();
+        hdr->magic = FBSTORE_MAGIC;
+    }
+    store->newest = fbstore_newest(store);
+    return store;
+}
+
+/*
+ * Copy the newest intact frame into fb. Returns 0, or -1 if the store
+ * holds no intact frame yet.
+ */
+int fbstore_load(fbstore *store, uint16_t *fb)
+{
+    int i;
+
+    if (!store)
+        return -1;
+    i = fbstore_newest(store);
+    if (i < 0)
+        return -1;
+    memcpy(fb, fbstore_pixels(fbstore_slot(store, i)), store->pixels * 2);
+    return 0;
+}
+
+/*
+ * Store fb as the newest frame. It goes to the slot that does not hold
+ * the newest intact frame, whatever the other slot's sequence number
+ * says: that one may be higher but torn.
+ */
+void fbstore_save(fbstore *store, const uint16_t *fb)
+{
+    FbSlot *a;
+    FbSlot *b;
+    FbSlot *slot;
+    uint32_t seq;
+    int i;
+
+    if (!store)
+        return;
+    a = fbstore_slot(store, 0);
+    b = fbstore_slot(store, 1);
+    i = store->newest == 0 ? 1 : 0;
+    slot = fbstore_slot(store, i);
+    seq = (a->seq > b->seq ? a->seq : b->seq) + 1;
+
+    slot->seq = 0;
+    __sync_synchronize();
+    memcpy(fbstore_pixels(slot), fb, store->pixels * 2);
+    slot->crc = crc32_of(fb, store->pixels * 2);
+    __sync_synchronize();
+    slot->seq = seq;
+    store->newest = i;
+}
+
+void fbstore_close(fbstore *store)
+{
+    if (!store)
+        return;
+    if (store->map)
+        munmap(store->map, store->size);
+    if (store->fd >= 0)
+        close(store->fd);
+    free(store);
+}
@@ -0,0 +1,34 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __FBSTORE_H__
+#define __FBSTORE_H__
+
+#include <stdint.h>
+
+/*
+ * The last frame of a panel, kept in a small memory-mapped file so a
+ * restarted daemon can put it back on the panel before anything has been
+ * sampled. The file holds two slots; a save goes to the one that does not
+ * hold the newest intact frame and bumps its sequence number last, so a
+ * save cut short by a crash or power loss leaves that frame intact. Saves are plain stores into the
+ * mapping and reach the disk with normal writeback, not one write per
+ * flush.
+ */
+#define FBSTORE_MAGIC   0x42463452u   /* "R4FB" */
+#define FBSTORE_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fbstore fbstore;
+
+extern fbstore *fbstore_open(const char *path, uint16_t width, uint16_t height);
+extern int fbstore_load(fbstore *store, uint16_t *fb);
+extern void fbstore_save(fbstore *store, const uint16_t *fb);
+extern void fbstore_close(fbstore *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FBSTORE_H__
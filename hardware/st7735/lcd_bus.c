@@ -0,0 +1,611 @@
+/* vim: set ai et ts=4 sw=4: */
+/*
+ * Shared I2C buses with one flush worker each.
+ *
+ * Contexts attached to a bus hand their frames to the bus worker instead
+ * of writing them from the drawing thread. The drawing thread only stages
+ * the dirty rectangle into the context's wire buffer; the worker sends it.
+ * Panels on different buses therefore flush in parallel, and panels on the
+ * same bus are sent one frame at a time, in submission order, with the
+ * slave address switched between them.
+ *
+ * A bus budget bounds how long the panels may keep other devices on the
+ * same bus waiting: it sets the message size of the attached contexts'
+ * bursts and how often those bursts pause.
+ *
+ * Frames queue in one of two lanes. Urgent frames (alerts) go before any
+ * normal frame, and a normal frame being sent when one arrives is cut
+ * short after its current message and put back at the head of the normal
+ * lane, to resume where it stopped once the urgent lane is empty. A panel
+ * that submits again while its frame is still queued takes the unsent
+ * rows back: a normal frame folds them in, an urgent one sends its own
+ * pixels first and leaves the rows for the normal lane.
+ */
+#include "lcd_bus.h"
+#include "sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+struct lcd_bus
+{
+    char path[LCD_BUS_PATH_MAX];
+    int fd;
+    int address;                 /* slave address the fd points at, -1 if unknown */
+    pthread_mutex_t io;          /* recursive; held for a whole frame */
+    pthread_mutex_t lock;        /* queue and stats */
+    pthread_cond_t work;
+    lcd_ctx *queue[LCD_BUS_LANES][LCD_BUS_MAX_PANELS];
+    uint32_t head[LCD_BUS_LANES];
+    uint32_t tail[LCD_BUS_LANES];
+    volatile uint8_t preempt;    /* urgent work waiting */
+    int urgent_callers;          /* urgent submitters not yet queued */
+    int panels;
+    lcd_ctx *attached[LCD_BUS_MAX_PANELS];
+    lcd_bus_budget budget;
+    uint16_t chunk_bytes;
+    lcd_bus_stats stats;
+    pthread_t thread;
+};
+
+static lcd_bus buses[LCD_BUS_MAX];
+static int bus_count;
+static pthread_mutex_t bus_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Transport for attached contexts: point the fd at the context's address,
+ * then write. Direct register writes from other threads are serialized
+ * with the worker per message; frames are only ever sent by the worker.
+ */
+static int bus_write(void *priv, const uint8_t *buf, uint32_t len)
+{
+    lcd_ctx *ctx = (lcd_ctx *)priv;
+    lcd_bus *bus = ctx->bus_link;
+    uint64_t t0;
+    uint32_t held;
+    uint8_t switched = 0;
+    int rc = 0;
+
+    pthread_mutex_lock(&bus->io);
+    if (bus->address != ctx->address)
+    {
+        if (ioctl(bus->fd, I2C_SLAVE_FORCE, ctx->address) < 0)
+        {
+            rc = -1;
+        }
+        else
+        {
+            bus->address = ctx->address;
+            switched = 1;
+        }
+    }
+    t0 = sampler_now_us();
+    if (rc == 0 && write(bus->fd, buf, len) != (ssize_t)len)
+        rc = -1;
+    held = (uint32_t)(sampler_now_us() - t0);
+
+    /* stats are read and written under bus->lock, which nests inside io */
+    pthread_mutex_lock(&bus->lock);
+    bus->stats.address_switches += switched;
+    if (held > bus->stats.max_hold_us)
+        bus->stats.max_hold_us = held;
+    pthread_mutex_unlock(&bus->lock);
+    pthread_mutex_unlock(&bus->io);
+    return rc;
+}
+
+static void bus_detach(void *priv)
+{
+    lcd_ctx *ctx = (lcd_ctx *)priv;
+    lcd_bus *bus;
+    int i;
+
+    /* let an in-flight frame finish before the context goes away */
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->busy)
+        pthread_cond_wait(&ctx->idle, &ctx->lock);
+    pthread_mutex_unlock(&ctx->lock);
+
+    bus = ctx->bus_link;
+    pthread_mutex_lock(&bus->io);
+    pthread_mutex_lock(&bus->lock);
+    for (i = 0; i < bus->panels; i++)
+    {
+        if (bus->attached[i] == ctx)
+        {
+            bus->attached[i] = bus->attached[--bus->panels];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bus->lock);
+    pthread_mutex_unlock(&bus->io);
+    ctx->bus_link = NULL;
+}
+
+/*
+ * SCL rate from the device tree (a big-endian u32), e.g.
+ * /sys/class/i2c-dev/i2c-1/device/of_node/clock-frequency
+ */
+static uint32_t bus_read_hz(const char *path)
+{
+    char node[96];
+    unsigned char be[4];
+    const char *name;
+    FILE *f;
+    uint32_t hz = 0;
+
+    name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    snprintf(node, sizeof(node), "/sys/class/i2c-dev/%s/device/of_node/clock-frequency", name);
+    f = fopen(node, "rb");
+    if (f)
+    {
+        if (fread(be, 1, sizeof(be), f) == sizeof(be))
+            hz = ((uint32_t)be[0] << 24) | ((uint32_t)be[1] << 16) | ((uint32_t)be[2] << 8) | be[3];
+        fclose(f);
+    }
+    return hz ? hz : LCD_BUS_DEFAULT_HZ;
+}
+
+/* Apply the bus budget to one context; called with bus->io held */
+static void bus_apply_budget(lcd_bus *bus, lcd_ctx *ctx)
+{
+    ctx->chunk_bytes = bus->chunk_bytes;
+    ctx->slice_us = bus->budget.slice_us;
+    ctx->slice_gap_us = bus->budget.gap_us;
+}
+
+static int bus_pending(lcd_bus *bus, int lane)
+{
+    return bus->head[lane] != bus->tail[lane];
+}
+
+/* Put a frame back in front of the normal lane; called with bus->lock held */
+static void bus_requeue(lcd_bus *bus, lcd_ctx *ctx)
+{
+    bus->head[LCD_LANE_NORMAL]--;
+    bus->queue[LCD_LANE_NORMAL][bus->head[LCD_LANE_NORMAL] % LCD_BUS_MAX_PANELS] = ctx;
+}
+
+/* Take a queued frame out of a lane; returns 0 if ctx was not in it */
+static int bus_unqueue(lcd_bus *bus, int lane, lcd_ctx *ctx)
+{
+    lcd_ctx **q = bus->queue[lane];
+    uint32_t i;
+
+    for (i = bus->head[lane]; i != bus->tail[lane]; i++)
+    {
+        if (q[i % LCD_BUS_MAX_PANELS] != ctx)
+            continue;
+        for (; i + 1 != bus->tail[lane]; i++)
+            q[i % LCD_BUS_MAX_PANELS] = q[(i + 1) % LCD_BUS_MAX_PANELS];
+        bus->tail[lane]--;
+        return 1;
+    }
+    return 0;
+}
+
+/* Account one finished urgent frame; called with bus->lock held */
+static void bus_note_urgent(lcd_bus *bus, lcd_ctx *ctx, uint64_t start, uint64_t now)
+{
+    uint32_t wait = (uint32_t)(start - ctx->submit_us);
+    uint32_t latency = (uint32_t)(now - ctx->submit_us);
+
+    bus->stats.urgent_frames++;
+    bus->stats.urgent_us += latency;
+    if (wait > bus->stats.max_urgent_wait_us)
+        bus->stats.max_urgent_wait_us = wait;
+    if (latency > bus->stats.max_urgent_us)
+        bus->stats.max_urgent_us = latency;
+}
+
+static void *bus_worker(void *arg)
+{
+    lcd_bus *bus = (lcd_bus *)arg;
+    lcd_ctx *ctx;
+    uint64_t t0;
+    uint64_t t1;
+    int lane;
+
+    for (;;)
+    {
+        /* while an urgent submitter is staging, leave the normal lane alone */
+        pthread_mutex_lock(&bus->lock);
+        while (!bus_pending(bus, LCD_LANE_URGENT) &&
+               (bus->urgent_callers || !bus_pending(bus, LCD_LANE_NORMAL)))
+            pthread_cond_wait(&bus->work, &bus->lock);
+        lane = bus_pending(bus, LCD_LANE_URGENT) ? LCD_LANE_URGENT : LCD_LANE_NORMAL;
+        ctx = bus->queue[lane][bus->head[lane] % LCD_BUS_MAX_PANELS];
+        bus->head[lane]++;
+        bus->preempt = bus_pending(bus, LCD_LANE_URGENT) || bus->urgent_callers;
+        pthread_mutex_unlock(&bus->lock);
+
+        t0 = sampler_now_us();
+        pthread_mutex_lock(&bus->io);
+        pthread_mutex_lock(&ctx->lock);
+        ctx->preempt = (lane == LCD_LANE_URGENT) ? NULL : &bus->preempt;
+        ctx->staged_sent = lcd_ctx_send_from(ctx, &ctx->staged, ctx->wire + ctx->staged_base,
+                                             ctx->staged_bytes, ctx->staged_sent);
+        ctx->preempt = NULL;
+        t1 = sampler_now_us();
+
+        pthread_mutex_lock(&bus->lock);
+        if (ctx->staged_sent < ctx->staged_bytes)
+        {
+            bus_requeue(bus, ctx);
+            bus->stats.preemptions++;
+        }
+        else
+        {
+            bus->stats.frames++;
+            if (lane == LCD_LANE_URGENT)
+                bus_note_urgent(bus, ctx, t0, t1);
+            if (ctx->rest_bytes)
+            {
+                /* rows an urgent frame jumped ahead of */
+                ctx->staged = ctx->rest;
+                ctx->staged_base += ctx->staged_bytes;
+                ctx->staged_bytes = ctx->rest_bytes;
+                ctx->staged_sent = 0;
+                ctx->rest_bytes = 0;
+                bus_requeue(bus, ctx);
+            }
+            else
+            {
+                ctx->busy = 0;
+                lcd_ctx_notify(ctx);
+            }
+        }
+        bus->stats.busy_us += t1 - t0;
+        pthread_mutex_unlock(&bus->lock);
+
+        /* also wakes a submitter that may now take a requeued frame back */
+        pthread_cond_broadcast(&ctx->idle);
+        pthread_mutex_unlock(&ctx->lock);
+        pthread_mutex_unlock(&bus->io);
+    }
+    return NULL;
+}
+
+static int bus_open(lcd_bus *bus, const char *path)
+{
+    pthread_mutexattr_t attr;
+
+    memset(bus, 0, sizeof(*bus));
+    snprintf(bus->path, sizeof(bus->path), "%s", path);
+    bus->address = -1;
+    bus->budget.bus_hz = bus_read_hz(path);
+    bus->chunk_bytes = BURST_MAX_LENGTH;
+    bus->stats.chunk_bytes = BURST_MAX_LENGTH;
+    bus->fd = open(path, O_RDWR);
+    if (bus->fd < 0)
+    {
+        fprintf(stderr, "Device %s failed to initialize: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&bus->io, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_mutex_init(&bus->lock, NULL);
+    pthread_cond_init(&bus->work, NULL);
+
+    if (pthread_create(&bus->thread, NULL, bus_worker, bus) != 0)
+    {
+        close(bus->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * The bus for an i2c-dev path, opened and given a worker on first use.
+ * Buses live until the process exits. Returns NULL if the bus cannot be opened.
+ */
+lcd_bus *lcd_bus_get(const char *path)
+{
+    lcd_bus *bus = NULL;
+    int i;
+
+    pthread_mutex_lock(&bus_table_lock);
+    for (i = 0; i < bus_count; i++)
+    {
+        if (strcmp(buses[i].path, path) == 0)
+        {
+            bus = &buses[i];
+            break;
+        }
+    }
+    if (!bus && bus_count < LCD_BUS_MAX && bus_open(&buses[bus_count], path) == 0)
+    {
+        bus = &buses[bus_count++];
+    }
+    pthread_mutex_unlock(&bus_table_lock);
+    return bus;
+}
+
+/*
+ * Drive ctx through bus at address. From now on its flushes are sent by
+ * the bus worker. Returns 0 on success, like lcd_begin().
+ */
+uint8_t lcd_bus_attach(lcd_ctx *ctx, lcd_bus *bus, uint8_t address)
+{
+    lcd_transport transport;
+
+    if (!ctx || !bus)
+        return 1;
+
+    pthread_mutex_lock(&bus->lock);
+    if (bus->panels >= LCD_BUS_MAX_PANELS)
+    {
+        pthread_mutex_unlock(&bus->lock);
+        fprintf(stderr, "Device %s: more than %d panels\n", bus->path, LCD_BUS_MAX_PANELS);
+        return 1;
+    }
+    pthread_mutex_unlock(&bus->lock);
+
+    transport.write = bus_write;
+    transport.close = bus_detach;
+    transport.priv = ctx;
+    lcd_ctx_set_transport(ctx, &transport);
+
+    snprintf(ctx->bus, sizeof(ctx->bus), "%s", bus->path);
+    ctx->address = address;
+    ctx->bus_link = bus;
+
+    pthread_mutex_lock(&bus->io);
+    pthread_mutex_lock(&bus->lock);
+    bus->attached[bus->panels++] = ctx;
+    pthread_mutex_unlock(&bus->lock);
+    bus_apply_budget(bus, ctx);
+    pthread_mutex_unlock(&bus->io);
+    return 0;
+}
+
+/*
+ * The rows of a staged rectangle from the one sent stopped in; returns 0
+ * if nothing is left
+ */
+static int bus_unsent(const lcd_rect *rect, uint32_t sent, lcd_rect *rows)
+{
+    uint32_t w = rect->x1 - rect->x0 + 1;
+
+    *rows = *rect;
+    rows->y0 = rect->y0 + (int16_t)(sent / 2 / w);
+    return rows->y0 <= rows->y1;
+}
+
+/*
+ * Wait until no frame of ctx is in the worker's hands. A frame still
+ * queued in the normal lane, whole or cut short, is taken back instead of
+ * waited for; the rows it had left are stored in *rows. Returns 1 if rows
+ * is set, or -1 if nowait is set and the frame would have to be waited
+ * for. Called with ctx->lock held.
+ */
+static int bus_reclaim(lcd_bus *bus, lcd_ctx *ctx, lcd_rect *rows, uint8_t nowait)
+{
+    int found = 0;
+
+    while (ctx->busy)
+    {
+        pthread_mutex_lock(&bus->lock);
+        if (bus_unqueue(bus, LCD_LANE_NORMAL, ctx))
+        {
+            found = bus_unsent(&ctx->staged, ctx->staged_sent, rows);
+            ctx->busy = 0;
+        }
+        pthread_mutex_unlock(&bus->lock);
+        if (ctx->busy && nowait)
+            return -1;
+        if (ctx->busy)
+            pthread_cond_wait(&ctx->idle, &ctx->lock);
+    }
+    return found;
+}
+
+/*
+ * Queue the dirty rectangle of ctx in a lane. Returns 1 if a frame was
+ * queued, 0 if nothing was dirty, and -1 (nothing done) if nowait is set
+ * and the previous frame is still being sent.
+ */
+static int bus_submit(lcd_ctx *ctx, uint8_t wait, int lane, uint8_t nowait)
+{
+    lcd_bus *bus = ctx->bus_link;
+    lcd_rect rows;
+    uint32_t depth;
+    int reclaimed;
+    int queued;
+
+    if (nowait)
+    {
+        /* the worker holds ctx->lock for as long as it sends this panel */
+        if (pthread_mutex_trylock(&ctx->lock) != 0)
+            return -1;
+        reclaimed = bus_reclaim(bus, ctx, &rows, 1);
+        pthread_mutex_unlock(&ctx->lock);
+        if (reclaimed < 0)
+            return -1;
+        if (reclaimed)
+            lcd_ctx_invalidate(ctx, rows.x0, rows.y0, rows.x1 - rows.x0 + 1, rows.y1 - rows.y0 + 1);
+    }
+
+    if (lane == LCD_LANE_URGENT)
+    {
+        /* cut the frame on the wire short now, it may be this panel's own */
+        pthread_mutex_lock(&bus->lock);
+        bus->urgent_callers++;
+        bus->preempt = 1;
+        pthread_mutex_unlock(&bus->lock);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    reclaimed = bus_reclaim(bus, ctx, &rows, 0);
+    if (reclaimed && lane == LCD_LANE_NORMAL)
+    {
+        lcd_ctx_invalidate(ctx, rows.x0, rows.y0, rows.x1 - rows.x0 + 1, rows.y1 - rows.y0 + 1);
+        reclaimed = 0;
+    }
+    ctx->staged_base = 0;
+    ctx->staged_sent = 0;
+    ctx->staged_bytes = lcd_ctx_stage(ctx, &ctx->staged);
+    ctx->rest_bytes = 0;
+    if (reclaimed)
+    {
+        /* the new pixels first, the old frame's rows behind them */
+        ctx->rest = rows;
+        if (ctx->staged_bytes == 0)
+        {
+            ctx->staged = rows;
+            ctx->staged_bytes = lcd_ctx_stage_rect(ctx, &rows, ctx->wire);
+        }
+        else
+        {
+            /* each is at most a screen, and wire holds two */
+            ctx->rest_bytes = lcd_ctx_stage_rect(ctx, &rows, ctx->wire + ctx->staged_bytes);
+        }
+    }
+    if (ctx->staged_bytes)
+    {
+        /* written under both locks, so lcd_bus_busy() may read it under bus->lock alone */
+        pthread_mutex_lock(&bus->lock);
+        ctx->busy = 1;
+        pthread_mutex_unlock(&bus->lock);
+        ctx->submit_us = sampler_now_us();
+    }
+    queued = ctx->busy;
+    pthread_mutex_unlock(&ctx->lock);
+
+    pthread_mutex_lock(&bus->lock);
+    if (lane == LCD_LANE_URGENT)
+        bus->urgent_callers--;
+    if (queued)
+    {
+        bus->queue[lane][bus->tail[lane] % LCD_BUS_MAX_PANELS] = ctx;
+        bus->tail[lane]++;
+        depth = (bus->tail[LCD_LANE_NORMAL] - bus->head[LCD_LANE_NORMAL]) +
+                (bus->tail[LCD_LANE_URGENT] - bus->head[LCD_LANE_URGENT]);
+        if (depth > bus->stats.max_queue)
+            bus->stats.max_queue = depth;
+    }
+    bus->preempt = bus_pending(bus, LCD_LANE_URGENT) || bus->urgent_callers;
+    pthread_cond_signal(&bus->work);
+    pthread_mutex_unlock(&bus->lock);
+
+    if (wait)
+    {
+        pthread_mutex_lock(&ctx->lock);
+        while (ctx->busy)
+            pthread_cond_wait(&ctx->idle, &ctx->lock);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    return queued;
+}
+
+/*
+ * Stage ctx's dirty rectangle and queue it on its bus. Waits first if the
+ * previous frame of this panel is still being sent, so a panel never has
+ * more than one frame queued. With wait set, also waits for this frame.
+ */
+void lcd_bus_submit(lcd_ctx *ctx, uint8_t wait)
+{
+    bus_submit(ctx, wait, LCD_LANE_NORMAL, 0);
+}
+
+/*
+ * As lcd_bus_submit(), but in the urgent lane: the frame is sent before
+ * any normal one and interrupts the normal frame on the wire, if any.
+ */
+void lcd_bus_submit_urgent(lcd_ctx *ctx, uint8_t wait)
+{
+    bus_submit(ctx, wait, LCD_LANE_URGENT, 0);
+}
+
+/*
+ * As lcd_bus_submit() without waiting: returns -1 rather than block when
+ * the previous frame of this panel is on the wire, else 1 if a frame was
+ * queued and 0 if nothing was dirty. See lcd_ctx_try_flush().
+ */
+int lcd_bus_try_submit(lcd_ctx *ctx)
+{
+    return bus_submit(ctx, 0, LCD_LANE_NORMAL, 1);
+}
+
+/*
+ * Whether ctx has a frame queued or on the wire. Never waits for the
+ * frame, unlike reading ctx->busy under ctx->lock, which the worker holds
+ * while it sends; busy is only ever written with both locks held.
+ */
+uint8_t lcd_bus_busy(lcd_ctx *ctx)
+{
+    lcd_bus *bus = ctx->bus_link;
+    uint8_t busy;
+
+    pthread_mutex_lock(&bus->lock);
+    busy = ctx->busy;
+    pthread_mutex_unlock(&bus->lock);
+    return busy;
+}
+
+/*
+ * Set how much of the bus the panels may use. The message size is the
+ * number of bytes that fit in max_hold_us at the bus clock, counting nine
+ * bit times per byte plus the address byte. Takes effect from the next
+ * frame of every panel on the bus.
+ */
+void lcd_bus_set_budget(lcd_bus *bus, const lcd_bus_budget *budget)
+{
+    uint64_t bytes;
+    uint32_t hz;
+    int i;
+
+    pthread_mutex_lock(&bus->io);
+    hz = budget->bus_hz ? budget->bus_hz : bus->budget.bus_hz;
+    bus->budget = *budget;
+    bus->budget.bus_hz = hz;
+
+    bytes = BURST_MAX_LENGTH;
+    if (budget->max_hold_us)
+    {
+        bytes = (uint64_t)budget->max_hold_us * hz / (9ULL * 1000000ULL);
+        bytes = (bytes > 1) ? bytes - 1 : 0;
+        if (bytes > BURST_MAX_LENGTH)
+            bytes = BURST_MAX_LENGTH;
+        if (bytes < 2)
+            bytes = 2;
+    }
+    bus->chunk_bytes = (uint16_t)(bytes & ~1ULL);
+
+    pthread_mutex_lock(&bus->lock);
+    bus->stats.chunk_bytes = bus->chunk_bytes;
+    for (i = 0; i < bus->panels; i++)
+        bus_apply_budget(bus, bus->attached[i]);
+    pthread_mutex_unlock(&bus->lock);
+    pthread_mutex_unlock(&bus->io);
+}
+
+void lcd_bus_get_budget(lcd_bus *bus, lcd_bus_budget *budget)
+{
+    pthread_mutex_lock(&bus->io);
+    *budget = bus->budget;
+    pthread_mutex_unlock(&bus->io);
+}
+
+const char *lcd_bus_path(const lcd_bus *bus)
+{
+    return bus->path;
+}
+
+void lcd_bus_get_stats(lcd_bus *bus, lcd_bus_stats *stats)
+{
+    pthread_mutex_lock(&bus->lock);
+    *stats = bus->stats;
+    pthread_mutex_unlock(&bus->lock);
+}
@@ -0,0 +1,67 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __LCD_BUS_H__
+#define __LCD_BUS_H__
+
+#include "lcd_ctx.h"
+
+/* Buses open at once, and panels that may share one bus */
+#define LCD_BUS_MAX        4
+#define LCD_BUS_MAX_PANELS 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SCL rate assumed when the device tree does not say */
+#define LCD_BUS_DEFAULT_HZ 100000
+
+/* Queue lanes; urgent frames preempt normal ones between messages */
+#define LCD_LANE_NORMAL 0
+#define LCD_LANE_URGENT 1
+#define LCD_BUS_LANES   2
+
+typedef struct lcd_bus lcd_bus;
+
+/*
+ * How much of the bus the panels may take. Other devices (RTC, fan
+ * controller, PMIC) only wait for at most one message of max_hold_us,
+ * and after every slice_us of panel traffic get at least gap_us to
+ * themselves.
+ */
+typedef struct lcd_bus_budget{
+  uint32_t bus_hz;        /* 0: read from the device tree */
+  uint32_t max_hold_us;   /* longest single message; 0 for BURST_MAX_LENGTH bytes */
+  uint32_t slice_us;      /* 0: never yield inside a burst */
+  uint32_t gap_us;
+}lcd_bus_budget;
+
+typedef struct lcd_bus_stats{
+  uint32_t frames;        /* flushes sent by the worker */
+  uint64_t busy_us;       /* time the worker spent on the bus */
+  uint32_t max_queue;     /* most panels waiting at once */
+  uint32_t address_switches;
+  uint32_t max_hold_us;   /* worst-case time one message held the bus */
+  uint16_t chunk_bytes;   /* message size the budget works out to */
+  uint32_t preemptions;   /* normal frames cut short by urgent ones */
+  uint32_t urgent_frames;
+  uint64_t urgent_us;     /* sum of submit-to-sent times of urgent frames */
+  uint32_t max_urgent_us;
+  uint32_t max_urgent_wait_us;  /* longest an urgent frame waited for the wire */
+}lcd_bus_stats;
+
+extern lcd_bus *lcd_bus_get(const char *path);
+extern uint8_t lcd_bus_attach(lcd_ctx *ctx, lcd_bus *bus, uint8_t address);
+extern void lcd_bus_submit(lcd_ctx *ctx, uint8_t wait);
+extern void lcd_bus_submit_urgent(lcd_ctx *ctx, uint8_t wait);
+extern int lcd_bus_try_submit(lcd_ctx *ctx);
+extern uint8_t lcd_bus_busy(lcd_ctx *ctx);
+extern void lcd_bus_set_budget(lcd_bus *bus, const lcd_bus_budget *budget);
+extern void lcd_bus_get_budget(lcd_bus *bus, lcd_bus_budget *budget);
+extern const char *lcd_bus_path(const lcd_bus *bus);
+extern void lcd_bus_get_stats(lcd_bus *bus, lcd_bus_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LCD_BUS_H__
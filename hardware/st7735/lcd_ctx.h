@@ -0,0 +1,236 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __LCD_CTX_H__
+#define __LCD_CTX_H__
+
+#include "st7735.h"
+#include "textlayout.h"
+#include "anim.h"
+#include <pthread.h>
+
+#define LCD_BUS_PATH_MAX   32
+#define LCD_FB_PIXELS      (X_COORDINATE_MAX * Y_COORDINATE_MAX)
+/* Pause after every register write and after every burst chunk */
+#define LCD_WRITE_DELAY_US 10
+#define LCD_CHUNK_DELAY_US 700
+/* How often a daemon looks up the header line again, e.g. for a new address */
+#define LCD_HEADER_INTERVAL_MS 5000
+/* Rows the CPU page's header takes, above its separator */
+#define LCD_HEADER_H       20
+/* Gauges page: centre row, outer radius and ring width, and the scale's arc in degrees */
+#define LCD_GAUGE_Y        36
+#define LCD_GAUGE_R        30
+#define LCD_GAUGE_W        5
+#define LCD_GAUGE_START    135
+#define LCD_GAUGE_SWEEP    270
+/* A frame is saved for the next start at most this often, see lcd_ctx_store_sync() */
+#define LCD_STORE_MS       1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* How bytes reach the panel; the default opens an i2c-dev node */
+typedef struct lcd_transport{
+  /* send len bytes as one bus message, return 0 on success */
+  int (*write)(void *priv, const uint8_t *buf, uint32_t len);
+  void (*close)(void *priv);
+  void *priv;
+}lcd_transport;
+
+/* Inclusive rectangle in panel coordinates; x1 < x0 means empty */
+typedef struct lcd_rect{
+  int16_t x0;
+  int16_t y0;
+  int16_t x1;
+  int16_t y1;
+}lcd_rect;
+
+struct lcd_bus;
+struct fbstore;
+
+typedef struct lcd_stats{
+  uint32_t commands;      /* 3-byte register writes */
+  uint32_t bursts;
+  uint32_t chunks;
+  uint64_t bytes;         /* everything written to the transport */
+  uint32_t write_errors;
+  uint32_t flushes;
+  uint64_t flush_pixels;
+  uint64_t flush_us;
+  uint32_t max_flush_us;
+  uint32_t max_hold_us;   /* longest single bus message */
+  uint32_t slices;        /* yields inside bursts */
+  uint32_t max_slice_us;  /* longest stretch between yields */
+  uint32_t preemptions;   /* frames cut short for an urgent one */
+  uint64_t first_flush_us; /* when the first frame was completely sent, 0 before */
+  uint64_t last_flush_us; /* when the latest frame was completely sent, 0 before */
+  uint64_t skipped_pixels; /* drawn pixels not sent because the panel already showed them */
+  uint32_t presents;      /* frames composed offscreen and put up by lcd_ctx_present() */
+}lcd_stats;
+
+typedef struct lcd_ctx{
+  lcd_transport transport;
+  int fd;                      /* i2c-dev descriptor of the default transport, -1 if none */
+  char bus[LCD_BUS_PATH_MAX];
+  uint8_t address;
+
+  uint8_t xstart;
+  uint8_t ystart;
+  uint16_t width;
+  uint16_t height;
+  uint8_t rotation;            /* MADCTL bits the geometry was chosen for */
+
+  uint32_t write_delay_us;
+  uint32_t chunk_delay_us;
+
+  /*
+   * Bus sharing. A burst is cut into messages of at most chunk_bytes, and
+   * after slice_us of sending the bus is left idle for slice_gap_us so
+   * other devices on it get a turn. slice_us of 0 never yields early.
+   */
+  uint16_t chunk_bytes;
+  uint32_t slice_us;
+  uint32_t slice_gap_us;
+
+  /*
+   * Shadow framebuffer. Drawing updates fb and grows dirty; a flush sends
+   * the dirty rectangle. Unless deferred is set every primitive flushes
+   * before it returns, which is how the legacy API behaves.
+   */
+  uint16_t fb[LCD_FB_PIXELS];
+  lcd_rect dirty;
+  uint8_t deferred;
+  /* flush staging, big-endian RGB565; room for an urgent frame and the rows it went ahead of */
+  uint8_t wire[LCD_FB_PIXELS * 2 * 2];
+
+  /*
+   * What the panel shows as of the last staged frame. A flush only sends
+   * the part of dirty that differs from it; forced is sent regardless,
+   * e.g. rows a cut-short frame did not get to.
+   */
+  uint16_t shown[LCD_FB_PIXELS];
+  uint8_t shown_valid;         /* 0 until a frame has been staged on this connection */
+  uint32_t shown_seq;          /* bumped every time a frame is staged */
+  lcd_rect forced;
+
+  /*
+   * A frame composed between lcd_ctx_offscreen_begin() and _end(), put up
+   * by lcd_ctx_present(). While offscreen is set fb is the back frame and
+   * flushes are held.
+   */
+  uint16_t back[LCD_FB_PIXELS];
+  uint8_t offscreen;
+  uint8_t back_ready;
+  lcd_rect back_delta;         /* where back differs from shown, as of back_seq */
+  uint32_t back_seq;
+  lcd_rect front_dirty;        /* dirty of the current frame, kept while offscreen */
+
+  TextCache text;
+  LcdAnimSet anim;
+
+  /*
+   * The CPU page's header as last rasterized. It is copied back as long as
+   * the header line and the width are the same, and drawn again otherwise.
+   */
+  uint16_t header_strip[X_COORDINATE_MAX * LCD_HEADER_H];
+  char header_text[TEXT_LAYOUT_MAX_LEN];
+  uint16_t header_width;       /* 0: nothing cached */
+
+  uint8_t partial;             /* the page drawn last has placeholders for data not sampled yet */
+  lcd_stats stats;
+
+  /*
+   * Set when the context is attached to a shared bus (lcd_bus.h). Flushes
+   * then stage into wire and are sent by the bus worker; lock guards the
+   * hand-off and the stats the worker updates.
+   */
+  struct lcd_bus *bus_link;
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+  uint8_t busy;                /* wire holds a frame the worker has not sent yet; written under lock and the bus lock */
+  lcd_rect staged;
+  uint32_t staged_base;        /* where in wire the staged rectangle starts */
+  uint32_t staged_bytes;
+  uint32_t staged_sent;        /* bytes of it already on the panel */
+  lcd_rect rest;               /* sent after staged, from wire + staged_bytes */
+  uint32_t rest_bytes;
+  uint64_t submit_us;          /* when the frame was queued */
+
+  /*
+   * Raised by the bus worker when urgent work is waiting; a burst checks it
+   * between messages and returns early. NULL while sending urgent frames.
+   */
+  const volatile uint8_t *preempt;
+
+  /* eventfd counting finished flushes, for event loops; -1 until asked for */
+  int event_fd;
+
+  /* where the frame on the panel is kept across restarts, NULL if nowhere */
+  struct fbstore *store;
+  uint8_t store_pending;       /* a frame was staged since the last save */
+  uint64_t store_us;           /* when the last save was */
+}lcd_ctx;
+
+extern lcd_ctx *lcd_default_ctx(void);
+extern void lcd_ctx_init(lcd_ctx *ctx);
+extern lcd_ctx *lcd_ctx_create(void);
+extern void lcd_ctx_destroy(lcd_ctx *ctx);
+extern uint8_t lcd_ctx_begin(lcd_ctx *ctx);
+extern uint8_t lcd_ctx_open(lcd_ctx *ctx, const char *bus, uint8_t address);
+extern void lcd_ctx_set_transport(lcd_ctx *ctx, const lcd_transport *transport);
+extern uint8_t lcd_ctx_persist(lcd_ctx *ctx, const char *path);
+extern uint8_t lcd_ctx_restore(lcd_ctx *ctx);
+extern void lcd_ctx_store_sync(lcd_ctx *ctx);
+extern void lcd_ctx_close(lcd_ctx *ctx);
+extern void lcd_ctx_set_deferred(lcd_ctx *ctx, uint8_t deferred);
+extern void lcd_ctx_flush(lcd_ctx *ctx);
+extern void lcd_ctx_flush_async(lcd_ctx *ctx);
+extern void lcd_ctx_flush_urgent(lcd_ctx *ctx);
+extern int lcd_ctx_try_flush(lcd_ctx *ctx);
+extern uint8_t lcd_ctx_busy(lcd_ctx *ctx);
+extern int lcd_ctx_event_fd(lcd_ctx *ctx);
+extern void lcd_ctx_notify(lcd_ctx *ctx);
+extern void lcd_ctx_invalidate(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+extern uint32_t lcd_ctx_stage(lcd_ctx *ctx, lcd_rect *rect);
+extern void lcd_ctx_offscreen_begin(lcd_ctx *ctx);
+extern void lcd_ctx_offscreen_end(lcd_ctx *ctx);
+extern int lcd_ctx_present(lcd_ctx *ctx);
+extern void lcd_ctx_offscreen_drop(lcd_ctx *ctx);
+extern uint32_t lcd_ctx_stage_rect(lcd_ctx *ctx, const lcd_rect *rect, uint8_t *out);
+extern void lcd_ctx_send(lcd_ctx *ctx, const lcd_rect *rect, uint32_t length);
+extern uint32_t lcd_ctx_send_from(lcd_ctx *ctx, const lcd_rect *rect, const uint8_t *data, uint32_t length, uint32_t offset);
+extern void lcd_ctx_get_stats(lcd_ctx *ctx, lcd_stats *stats);
+extern void lcd_ctx_reset_stats(lcd_ctx *ctx);
+
+extern void lcd_ctx_write_string(lcd_ctx *ctx, uint16_t x, uint16_t y, const char *str, FontDef font, uint16_t color, uint16_t bgcolor);
+extern void lcd_ctx_write_str(lcd_ctx *ctx, uint16_t x, uint16_t y, const char *str, FontType font, uint16_t color, uint16_t bgcolor);
+extern void lcd_ctx_write_char(lcd_ctx *ctx, uint16_t x, uint16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor);
+extern void lcd_ctx_write_ch(lcd_ctx *ctx, uint16_t x, uint16_t y, char ch, FontType font, uint16_t color, uint16_t bgcolor);
+extern void lcd_ctx_fill_rectangle(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
+extern void lcd_ctx_fill_screen(lcd_ctx *ctx, uint16_t color);
+extern void lcd_ctx_invert_rectangle(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+extern void lcd_ctx_draw_image(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data);
+extern void lcd_ctx_draw_pixels(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t *pixels, uint32_t stride);
+extern void lcd_ctx_touched(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+extern void lcd_ctx_set_address_window(lcd_ctx *ctx, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+extern void i2c_ctx_write_data(lcd_ctx *ctx, uint8_t high, uint8_t low);
+extern void i2c_ctx_write_command(lcd_ctx *ctx, uint8_t command, uint8_t high, uint8_t low);
+extern uint32_t i2c_ctx_burst_transfer(lcd_ctx *ctx, const uint8_t *buff, uint32_t length);
+extern int lcd_header_register(void);
+extern uint8_t lcd_header_ready(void);
+extern void lcd_ctx_display(lcd_ctx *ctx, uint8_t symbol);
+extern void lcd_ctx_display_cpuLoad(lcd_ctx *ctx);
+extern void lcd_ctx_display_cpu_live(lcd_ctx *ctx, float cpu);
+extern void lcd_ctx_display_ram(lcd_ctx *ctx);
+extern void lcd_ctx_display_temp(lcd_ctx *ctx);
+extern void lcd_ctx_display_disk(lcd_ctx *ctx);
+extern void lcd_ctx_display_quantiles(lcd_ctx *ctx);
+extern void lcd_ctx_display_alerts(lcd_ctx *ctx);
+extern void lcd_ctx_display_gauges(lcd_ctx *ctx);
+extern void lcd_ctx_display_percentage(lcd_ctx *ctx, uint8_t val, uint16_t color);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LCD_CTX_H__
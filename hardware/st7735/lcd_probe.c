@@ -0,0 +1,166 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "lcd_probe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glob.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+/*
+ * One bus being probed. A prober that outlives the caller's deadline
+ * still owns a reference, so whichever of the two lets go last frees it.
+ */
+typedef struct ProbeJob
+{
+    char path[64];
+    uint8_t address;
+    uint32_t timeout_ms;
+    int result;                  /* lcd_probe_bus(), or -2 while running */
+    int refs;
+} ProbeJob;
+
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probe_done = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Whether a device answers at address on the i2c-dev node path. The probe
+ * is a one-byte read, which the panel (write-only as far as the protocol
+ * goes) acknowledges without acting on it; the adapter gives up after
+ * timeout_ms, rounded up to its 10 ms ticks. Like i2cdetect, an address
+ * a kernel driver has claimed is left alone and counts as no answer,
+ * unless force is set, which is only for a bus the user named. Returns 1
+ * if the device answered, 0 if not, -1 if the bus cannot be opened.
+ */
+int lcd_probe_bus(const char *path, uint8_t address, uint32_t timeout_ms, uint8_t force)
+{
+    uint8_t byte;
+    int fd;
+    int answered;
+
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ioctl(fd, I2C_TIMEOUT, (unsigned long)(timeout_ms + 9) / 10);
+    ioctl(fd, I2C_RETRIES, 0UL);
+    /* EBUSY: a driver owns the address, so whatever is there is not a panel of ours */
+    answered = ioctl(fd, force ? I2C_SLAVE_FORCE : I2C_SLAVE, address) == 0 && read(fd, &byte, 1) == 1;
+    close(fd);
+    return answered;
+}
+
+static void probe_release(ProbeJob *job)
+{
+    if (--job->refs == 0)
+        free(job);
+}
+
+static void *probe_worker(void *arg)
+{
+    ProbeJob *job = (ProbeJob *)arg;
+    int result;
+
+    result = lcd_probe_bus(job->path, job->address, job->timeout_ms, 0);
+    pthread_mutex_lock(&probe_lock);
+    job->result = result;
+    pthread_cond_broadcast(&probe_done);
+    probe_release(job);
+    pthread_mutex_unlock(&probe_lock);
+    return NULL;
+}
+
+/* "/dev/i2c-10" -> 10, for picking the lowest numbered bus */
+static long probe_bus_number(const char *path)
+{
+    const char *dash = strrchr(path, '-');
+    return dash ? strtol(dash + 1, NULL, 10) : 0;
+}
+
+/*
+ * Look for a device at address on every LCD_PROBE_PATTERN bus at once,
+ * giving up on buses that have not answered after timeout_ms. A sensor
+ * can share the panel's address on another bus, so if several answer
+ * LCD_PROBE_DEFAULT_BUS, where the panel's header puts it, is preferred,
+ * else the lowest numbered one; it is copied to bus. Returns how many
+ * buses answered, 0 if none did.
+ */
+int lcd_probe(uint8_t address, uint32_t timeout_ms, char *bus, size_t len)
+{
+    ProbeJob *job[LCD_PROBE_MAX_BUSES];
+    pthread_attr_t attr;
+    pthread_t thread;
+    struct timespec deadline;
+    glob_t found;
+    size_t count = 0;
+    size_t running;
+    size_t i;
+    int best = -1;
+    int answered = 0;
+
+    if (glob(LCD_PROBE_PATTERN, 0, NULL, &found) != 0)
+        return 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (i = 0; i < found.gl_pathc && count < LCD_PROBE_MAX_BUSES; i++)
+    {
+        job[count] = (ProbeJob *)calloc(1, sizeof(ProbeJob));
+        if (!job[count])
+            break;
+        snprintf(job[count]->path, sizeof(job[count]->path), "%s", found.gl_pathv[i]);
+        job[count]->address = address;
+        job[count]->timeout_ms = timeout_ms;
+        job[count]->result = -2;
+        job[count]->refs = 2;
+        if (pthread_create(&thread, &attr, probe_worker, job[count]) != 0)
+        {
+            free(job[count]);
+            continue;
+        }
+        count++;
+    }
+    pthread_attr_destroy(&attr);
+    globfree(&found);
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&probe_lock);
+    for (;;)
+    {
+        running = 0;
+        for (i = 0; i < count; i++)
+            running += job[i]->result == -2;
+        if (running == 0 || pthread_cond_timedwait(&probe_done, &probe_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (job[i]->result != 1)
+            continue;
+        answered++;
+        if (best >= 0 && strcmp(job[best]->path, LCD_PROBE_DEFAULT_BUS) == 0)
+            continue;
+        if (best < 0 || strcmp(job[i]->path, LCD_PROBE_DEFAULT_BUS) == 0 ||
+            probe_bus_number(job[i]->path) < probe_bus_number(job[best]->path))
+            best = (int)i;
+    }
+    if (best >= 0)
+        snprintf(bus, len, "%s", job[best]->path);
+    for (i = 0; i < count; i++)
+        probe_release(job[i]);
+    pthread_mutex_unlock(&probe_lock);
+    return answered;
+}
@@ -0,0 +1,28 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __LCD_PROBE_H__
+#define __LCD_PROBE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Buses looked at, and how many of them at most */
+#ifndef LCD_PROBE_PATTERN
+#define LCD_PROBE_PATTERN    "/dev/i2c-*"
+#endif
+#define LCD_PROBE_MAX_BUSES  16
+/* How long a probe of all buses may take, and the bus assumed if none answers */
+#define LCD_PROBE_TIMEOUT_MS 250
+#define LCD_PROBE_DEFAULT_BUS "/dev/i2c-1"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int lcd_probe_bus(const char *path, uint8_t address, uint32_t timeout_ms, uint8_t force);
+extern int lcd_probe(uint8_t address, uint32_t timeout_ms, char *bus, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LCD_PROBE_H__
@@ -0,0 +1,800 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "pages.h"
+#include "lcd_ctx.h"
+#include "sampler.h"
+#include "rules.h"
+#include "rpiInfo.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct Page
+{
+    const char *name;
+    page_render_fn render;
+    void *arg;
+    uint32_t dwell_ms;
+    uint32_t budget_us;
+    const char *deps;           /* comma separated collectors the page reads, or NULL */
+    uint8_t stalled;            /* its renderer is stuck; set from other threads */
+} Page;
+
+/* Every page known to the daemon; panels pick theirs through a PageSet */
+static Page pages[PAGE_MAX];
+static int pages_used;
+/* The stock alerts page, only in the rotation while a rule fires */
+static int alert_page = -1;
+
+/*
+ * Add a page to the catalogue. budget_us of 0 means the page is never
+ * skipped for being slow. Returns the page index, or -1 if the table is full.
+ * Register pages before any panel starts rotating.
+ */
+int page_register(const char *name, page_render_fn render, void *arg, uint32_t dwell_ms, uint32_t budget_us)
+{
+    Page *page;
+
+    if (!render || pages_used >= PAGE_MAX)
+        return -1;
+
+    page = &pages[pages_used];
+    page->name = name;
+    page->render = render;
+    page->arg = arg;
+    page->dwell_ms = dwell_ms ? dwell_ms : PAGE_DEFAULT_DWELL_MS;
+    page->budget_us = budget_us;
+    return pages_used++;
+}
+
+/*
+ * Name the collectors a page draws from, e.g. "cpu,header". Each of them
+ * is run the set's lead time before the page is due, so it renders from
+ * a fresh sample. The string is kept, not copied. Returns 0, or -1 if the
+ * page is unknown.
+ */
+int page_depends(int page, const char *collectors)
+{
+    if (page < 0 || page >= pages_used)
+        return -1;
+    pages[page].deps = collectors;
+    return 0;
+}
+
+/*
+ * Leave a page out of every panel's rotation while its renderer is stuck,
+ * e.g. a plugin render that has not returned, or put it back. Safe to call
+ * from any thread.
+ */
+void page_stall(int page, uint8_t stalled)
+{
+    if (page >= 0 && page < pages_used)
+        __atomic_store_n(&pages[page].stalled, stalled, __ATOMIC_RELEASE);
+}
+
+/* Whether the page in slot is out of the rotation */
+static uint8_t page_skipped(PageSet *set, int slot)
+{
+    return set->stats[slot].disabled || __atomic_load_n(&pages[set->page[slot]].stalled, __ATOMIC_ACQUIRE);
+}
+
+static void page_builtin(lcd_ctx *ctx, void *arg)
+{
+    lcd_ctx_display(ctx, (uint8_t)(uintptr_t)arg);
+}
+
+/*
+ * The stock pages, in the order lcd_display() numbers them
+ */
+void page_register_builtin(void)
+{
+    lcd_header_register();
+    page_depends(page_register("cpu", page_builtin, (void *)0, PAGE_DEFAULT_DWELL_MS, 0), "cpu,header");
+    page_depends(page_register("ram", page_builtin, (void *)1, PAGE_DEFAULT_DWELL_MS, 0), "ram");
+    page_depends(page_register("temp", page_builtin, (void *)2, PAGE_DEFAULT_DWELL_MS, 0), "temp");
+    page_depends(page_register("disk", page_builtin, (void *)3, PAGE_DEFAULT_DWELL_MS, 0), "disk");
+    page_register("p99", page_builtin, (void *)4, PAGE_DEFAULT_DWELL_MS, 0);
+    alert_page = page_register("alerts", page_builtin, (void *)5, PAGE_DEFAULT_DWELL_MS, 0);
+    page_depends(page_register("gauges", page_builtin, (void *)6, PAGE_DEFAULT_DWELL_MS, 0), "temp,cpu");
+}
+
+int page_count(void)
+{
+    return pages_used;
+}
+
+int page_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < pages_used; i++)
+    {
+        if (pages[i].name && strcmp(pages[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *page_name(int page)
+{
+    if (page < 0 || page >= pages_used)
+        return NULL;
+    return pages[page].name;
+}
+
+void page_set_init(PageSet *set, lcd_ctx *ctx)
+{
+    memset(set, 0, sizeof(*set));
+    set->ctx = ctx;
+    set->lead_ms = PAGE_DEFAULT_LEAD_MS;
+    set->ready_slot = -1;
+    if (ctx)
+        ctx->anim.enabled = 1;
+}
+
+int page_set_add(PageSet *set, int page)
+{
+    if (page < 0 || page >= pages_used || set->count >= PAGE_MAX)
+        return -1;
+    set->page[set->count] = page;
+    return set->count++;
+}
+
+void page_set_add_all(PageSet *set)
+{
+    int i;
+
+    for (i = 0; i < pages_used; i++)
+        page_set_add(set, i);
+}
+
+/*
+ * Add the pages named in a comma separated list, e.g. "cpu,temp,uptime".
+ * Returns -1 and names the culprit on stderr if a page is unknown.
+ */
+int page_set_parse(PageSet *set, const char *list)
+{
+    char name[32];
+    const char *end;
+    size_t n;
+    int page;
+
+    while (*list)
+    {
+        end = strchr(list, ',');
+        n = end ? (size_t)(end - list) : strlen(list);
+        if (n > 0)
+        {
+            if (n >= sizeof(name))
+                n = sizeof(name) - 1;
+            memcpy(name, list, n);
+            name[n] = '\0';
+            page = page_find(name);
+            if (page < 0 || page_set_add(set, page) < 0)
+            {
+                fprintf(stderr, "pages: unknown page '%s'\n", name);
+                return -1;
+            }
+        }
+        list += end ? (size_t)(end - list) + 1 : strlen(list);
+    }
+    return 0;
+}
+
+/* Invert the blink band, or put it back */
+static void page_blink(PageSet *set, uint8_t inverted)
+{
+    lcd_ctx *ctx = set->ctx;
+    uint8_t deferred;
+
+    if (set->inverted == inverted)
+        return;
+    deferred = ctx->deferred;
+    ctx->deferred = 1;
+    lcd_ctx_invert_rectangle(ctx, 0, PAGE_BLINK_Y, ctx->width, PAGE_BLINK_H);
+    ctx->deferred = deferred;
+    set->inverted = inverted;
+}
+
+/* Draw the page in slot into ctx without flushing; returns the time taken */
+static uint32_t page_draw(PageSet *set, int slot)
+{
+    lcd_ctx *ctx = set->ctx;
+    Page *page = &pages[set->page[slot]];
+    uint64_t t0;
+    uint8_t deferred;
+
+    deferred = ctx->deferred;
+    ctx->deferred = 1;
+    ctx->partial = 0;
+    lcd_ctx_anim_begin(ctx);
+    t0 = sampler_now_us();
+    page->render(ctx, page->arg);
+    ctx->deferred = deferred;
+    return (uint32_t)(sampler_now_us() - t0);
+}
+
+/* Charge a render of the page in slot to its budget */
+static void page_charge(PageSet *set, int slot, uint32_t elapsed)
+{
+    Page *page = &pages[set->page[slot]];
+    PageStats *stats = &set->stats[slot];
+    lcd_ctx *ctx = set->ctx;
+
+    stats->renders++;
+    stats->last_us = elapsed;
+    if (elapsed > stats->max_us)
+        stats->max_us = elapsed;
+
+    if (page->budget_us && elapsed > page->budget_us)
+    {
+        stats->overruns++;
+        if (++set->strikes[slot] >= PAGE_MAX_STRIKES)
+        {
+            stats->disabled = 1;
+            fprintf(stderr, "pages: page '%s' disabled on %s, %u us over a %u us budget\n",
+                    page->name, ctx->bus, (unsigned)elapsed, (unsigned)page->budget_us);
+        }
+    }
+    else
+    {
+        set->strikes[slot] = 0;
+    }
+}
+
+/* Account a frame of a page that is on the panel since finish */
+static void page_settle(PageSet *set, const PageFrame *frame, uint64_t finish)
+{
+    PageStats *stats = &set->stats[frame->slot];
+    uint32_t late;
+
+    if (finish < frame->start_us)
+        finish = frame->start_us;
+    stats->deadlines++;
+    if (finish - frame->start_us > stats->max_finish_us)
+        stats->max_finish_us = (uint32_t)(finish - frame->start_us);
+    if (finish > frame->deadline_us)
+    {
+        stats->misses++;
+        late = (uint32_t)(finish - frame->deadline_us);
+        if (late > stats->worst_late_us)
+            stats->worst_late_us = late;
+    }
+}
+
+/*
+ * Settle the frames handed to the panel once it has nothing left to send:
+ * they are on it since the last flush finished, or since they were
+ * started if they had nothing to send. A frame held back for being late
+ * is queued first, as soon as the bus takes it.
+ */
+static void page_poll(PageSet *set)
+{
+    lcd_ctx *ctx = set->ctx;
+    lcd_stats s;
+    int i;
+
+    if (set->held)
+    {
+        if (lcd_ctx_try_flush(ctx) < 0)
+            return;
+        set->held = 0;
+    }
+    if (!set->pending_count || lcd_ctx_busy(ctx))
+        return;
+    lcd_ctx_get_stats(ctx, &s);
+    for (i = 0; i < set->pending_count; i++)
+        page_settle(set, &set->pending[i], s.last_flush_us);
+    set->pending_count = 0;
+}
+
+/* Whether a frame due by deadline would start already late */
+static uint8_t page_late(uint64_t deadline)
+{
+    return sampler_now_us() > deadline;
+}
+
+/*
+ * Hand what was drawn for the page in slot since start to the panel, due
+ * by deadline. A frame that is already late while the one before is
+ * still on the bus is not queued behind it: it is held, and goes out with
+ * whatever is drawn next as soon as the bus is free.
+ */
+static void page_submit(PageSet *set, int slot, uint64_t start, uint64_t deadline, uint8_t urgent)
+{
+    lcd_ctx *ctx = set->ctx;
+    PageFrame *frame;
+
+    if (set->pending_count == PAGE_PENDING_MAX)
+    {
+        /* still not on the panel: it is at least this late */
+        page_settle(set, &set->pending[0], sampler_now_us());
+        set->pending_count--;
+        memmove(set->pending, set->pending + 1, sizeof(set->pending[0]) * set->pending_count);
+    }
+    frame = &set->pending[set->pending_count++];
+    frame->slot = slot;
+    frame->start_us = start;
+    frame->deadline_us = deadline;
+
+    if (urgent)
+    {
+        lcd_ctx_flush_urgent(ctx);
+    }
+    else if (set->held)
+    {
+        set->stats[slot].coalesced++;
+    }
+    else if (!page_late(deadline))
+    {
+        lcd_ctx_flush_async(ctx);
+    }
+    else if (lcd_ctx_try_flush(ctx) < 0)
+    {
+        set->held = 1;
+        set->stats[slot].coalesced++;
+    }
+}
+
+/*
+ * Compose the page in slot offscreen, so that at its turn it only has to
+ * be presented. The page on the panel is left as it is.
+ */
+static void page_prerender(PageSet *set, int slot)
+{
+    lcd_ctx *ctx = set->ctx;
+    uint8_t partial = ctx->partial;
+    uint8_t moving = ctx->anim.moving;
+    uint8_t inverted = set->inverted;
+
+    if (slot < 0 || page_skipped(set, slot))
+        return;
+    lcd_ctx_offscreen_begin(ctx);
+    if (inverted)
+    {
+        /* the copy has the inverted band: put it back first */
+        lcd_ctx_invert_rectangle(ctx, 0, PAGE_BLINK_Y, ctx->width, PAGE_BLINK_H);
+    }
+    page_charge(set, slot, page_draw(set, slot));
+    set->ready_partial = ctx->partial;
+    set->ready_moving = ctx->anim.moving;
+    lcd_ctx_offscreen_end(ctx);
+    ctx->partial = partial;
+    ctx->anim.moving = moving;
+    set->ready_slot = slot;
+    set->prerenders++;
+}
+
+/*
+ * Put the page in slot on the panel, due PAGE_DEADLINE_MS after its turn
+ * in the rotation, or after now if it has none. A frame composed ahead
+ * is presented rather than drawn again; either way page_submit() is what
+ * sends it, so a late frame is held and coalesced like any other.
+ */
+static int page_render(PageSet *set, int slot, uint8_t urgent)
+{
+    lcd_ctx *ctx = set->ctx;
+    uint64_t start = sampler_now_us();
+    uint64_t deadline;
+    uint32_t elapsed = 0;
+    uint8_t ready;
+
+    if (slot < 0 || slot >= set->count || page_skipped(set, slot))
+        return -1;
+    deadline = (set->due_us ? set->due_us : start) + (uint64_t)PAGE_DEADLINE_MS * 1000;
+    set->due_us = 0;
+
+    /* draw over the page as it was, not its inverted band */
+    page_blink(set, 0);
+    ready = !urgent && slot == set->ready_slot && lcd_ctx_present(ctx) == 0;
+    set->ready_slot = -1;
+    if (ready)
+    {
+        /* charged when it was composed */
+        ctx->partial = set->ready_partial;
+        ctx->anim.moving = set->ready_moving;
+    }
+    else
+    {
+        lcd_ctx_offscreen_drop(ctx);
+        elapsed = page_draw(set, slot);
+    }
+
+    page_submit(set, slot, start, deadline, urgent);
+    if (!ready)
+        page_charge(set, slot, elapsed);
+    return 0;
+}
+
+/*
+ * Render the page in a slot of the set, charge the time to its budget and
+ * queue the result for the panel. Returns 0 if the page was drawn, -1 if
+ * it is disabled, stalled or out of range.
+ */
+int page_show(PageSet *set, int slot)
+{
+    return page_render(set, slot, 0);
+}
+
+int page_get_stats(PageSet *set, int slot, PageStats *stats)
+{
+    if (slot < 0 || slot >= set->count || !stats)
+        return -1;
+    *stats = set->stats[slot];
+    return 0;
+}
+
+/* The slot holding the alerts page, or -1 if the set does not show it */
+static int page_alert_slot(PageSet *set)
+{
+    int i;
+
+    for (i = 0; alert_page >= 0 && i < set->count; i++)
+    {
+        if (set->page[i] == alert_page)
+            return i;
+    }
+    return -1;
+}
+
+/* The slot the rotation shows after slot, or -1 if there is none */
+static int page_next(PageSet *set, int slot)
+{
+    int next = slot;
+    int i;
+
+    for (i = 0; i < set->count; i++)
+    {
+        next = (next + 1) % set->count;
+        if (page_skipped(set, next) || (set->page[next] == alert_page && rules_firing() == 0))
+            continue;
+        return next;
+    }
+    return -1;
+}
+
+/* Run the collectors the page in slot reads, unless they have just run */
+static void page_prefetch(PageSet *set, int slot)
+{
+    char name[32];
+    const char *list;
+    const char *end;
+    size_t n;
+
+    if (slot < 0 || !(list = pages[set->page[slot]].deps))
+        return;
+    while (*list)
+    {
+        end = strchr(list, ',');
+        n = end ? (size_t)(end - list) : strlen(list);
+        if (n > 0 && n < sizeof(name))
+        {
+            memcpy(name, list, n);
+            name[n] = '\0';
+            if (sampler_trigger(sampler_find(name), set->lead_ms) > 0)
+                set->prefetches++;
+        }
+        list += end ? n + 1 : n;
+    }
+}
+
+/* Time between animation frames: the frame rate's, or what a flush takes if longer */
+static uint64_t page_frame_interval(PageSet *set)
+{
+    uint32_t us = 1000000 / LCD_ANIM_FPS;
+
+    return set->frame_cost_us > us ? set->frame_cost_us : us;
+}
+
+/*
+ * Draw the next frame of a page whose values are moving, due by deadline.
+ * If the frame before is still on its way to the panel, or this one could
+ * no longer make its deadline, it is dropped; values move with time, so
+ * the next frame catches up rather than falling behind. The flushes since
+ * the last frame measure what one costs.
+ */
+static void page_frame(PageSet *set, int slot, uint64_t deadline)
+{
+    lcd_ctx *ctx = set->ctx;
+    lcd_stats s;
+    uint64_t start;
+    uint32_t cost;
+
+    lcd_ctx_get_stats(ctx, &s);
+    if (s.flushes > set->meter_flushes && s.flush_us >= set->meter_us)
+    {
+        cost = (uint32_t)((s.flush_us - set->meter_us) / (s.flushes - set->meter_flushes));
+        set->frame_cost_us = set->frame_cost_us ? (set->frame_cost_us * 3 + cost) / 4 : cost;
+    }
+    set->meter_flushes = s.flushes;
+    set->meter_us = s.flush_us;
+
+    if (lcd_ctx_busy(ctx) || page_late(deadline))
+    {
+        set->frames_skipped++;
+        set->stats[slot].dropped++;
+        return;
+    }
+    start = sampler_now_us();
+    page_blink(set, 0);
+    page_draw(set, slot);
+    page_submit(set, slot, start, deadline, 0);
+    set->frames++;
+}
+
+/*
+ * Hold a page that was just shown for its dwell time. A page drawn with
+ * placeholders is drawn again as soon as its data is in, rather than at
+ * its next turn. The next page's collectors are run the set's lead time
+ * before it is due, and the page itself is composed offscreen half that
+ * time before. While its values animate, it is drawn again every frame.
+ * While a critical rule fires the bar row blinks. Frames handed to the
+ * panel are checked against their deadlines as they land. Returns
+ * the slot of the alerts page if a rule started firing meanwhile and the
+ * set has one, else -1.
+ */
+static int page_dwell(PageSet *set, int slot)
+{
+    lcd_ctx *ctx = set->ctx;
+    uint32_t generation = rules_generation();
+    uint64_t blink_us = 0;
+    uint64_t prefetch_us;
+    uint64_t prerender_us;
+    uint64_t frame_us;
+    uint8_t prefetched = 0;
+    uint8_t prerendered = 0;
+    uint64_t until;
+    uint64_t now;
+    uint64_t step;
+    int alerts = rules_firing();
+    int jump = -1;
+    int n;
+
+    until = sampler_now_us() + (uint64_t)pages[set->page[slot]].dwell_ms * 1000;
+    prefetch_us = until - (uint64_t)set->lead_ms * 1000;
+    prerender_us = until - (uint64_t)set->lead_ms * 500;
+    frame_us = sampler_now_us() + page_frame_interval(set);
+    for (;;)
+    {
+        if (!set->first_page_us && !ctx->partial)
+        {
+            /* time to complete page: wait for it to be on the panel */
+            lcd_ctx_flush(ctx);
+            __atomic_store_n(&set->first_page_us, sampler_now_us(), __ATOMIC_RELEASE);
+        }
+        page_poll(set);
+        if (!lcd_ctx_anim_moving(ctx) && !set->held && !lcd_ctx_busy(ctx))
+        {
+            /* the panel is idle: keep what it shows for the next start */
+            lcd_ctx_store_sync(ctx);
+        }
+
+        now = sampler_now_us();
+        if (rules_level(-1) == RULE_CRIT)
+        {
+            if (now >= blink_us)
+            {
+                page_blink(set, !set->inverted);
+                lcd_ctx_flush_async(ctx);
+                blink_us = now + PAGE_BLINK_MS * 1000;
+            }
+        }
+        else if (set->inverted)
+        {
+            page_blink(set, 0);
+            lcd_ctx_flush_async(ctx);
+        }
+        if (lcd_ctx_anim_moving(ctx) && now >= frame_us)
+        {
+            page_frame(set, slot, frame_us + page_frame_interval(set));
+            frame_us = now + page_frame_interval(set);
+        }
+        if (!prefetched && now >= prefetch_us)
+        {
+            page_prefetch(set, page_next(set, slot));
+            prefetched = 1;
+        }
+        if (prefetched && !prerendered && now >= prerender_us)
+        {
+            page_prerender(set, page_next(set, slot));
+            prerendered = 1;
+        }
+        if (now >= until)
+            break;
+
+        step = until - now;
+        if (step > PAGE_ALERT_POLL_MS * 1000)
+            step = PAGE_ALERT_POLL_MS * 1000;
+        if ((ctx->partial || set->held) && step > PAGE_FILL_POLL_MS * 1000)
+            step = PAGE_FILL_POLL_MS * 1000;
+        if (blink_us > now && step > blink_us - now)
+            step = blink_us - now;
+        if (lcd_ctx_anim_moving(ctx) && frame_us > now && step > frame_us - now)
+            step = frame_us - now;
+        if (!prefetched && step > prefetch_us - now)
+            step = prefetch_us - now;
+        else if (prefetched && !prerendered && step > prerender_us - now)
+            step = prerender_us - now;
+        usleep((useconds_t)step);
+
+        if (ctx->partial && lcd_header_ready())
+            page_show(set, slot);
+        if (rules_generation() != generation)
+        {
+            generation = rules_generation();
+            n = rules_firing();
+            if (set->page[slot] == alert_page)
+            {
+                /* the list changed under us */
+                page_show(set, slot);
+            }
+            else if (n > alerts && (jump = page_alert_slot(set)) >= 0)
+            {
+                break;
+            }
+            alerts = n;
+        }
+        if (set->ready_slot < 0)
+        {
+            /* a redraw above dropped the next page's composed frame */
+            prerendered = 0;
+        }
+    }
+    /* the next page starts from what was drawn, not the inverted band */
+    page_blink(set, 0);
+    if (jump < 0)
+        set->due_us = until;
+    return jump;
+}
+
+/* The slot of the CPU page, added to the set if it is not there; -1 if none */
+static int page_live_slot(PageSet *set)
+{
+    int page = page_find("cpu");
+    int i;
+
+    for (i = 0; i < set->count; i++)
+    {
+        if (set->page[i] == page)
+            return i;
+    }
+    return page_set_add(set, page);
+}
+
+/*
+ * Live meter: pin the CPU page and refresh its reading and bar live_hz
+ * times a second from /proc/stat, smoothed. The whole page is drawn again
+ * once per dwell, e.g. for the header. Each refresh is due by the next
+ * tick; one that comes due while the previous one is still on the bus,
+ * or after the thread was held up, is dropped rather than queued. The rate achieved is logged when it falls
+ * short of the target. Returns only if there is no CPU page.
+ */
+static void page_live(PageSet *set)
+{
+    lcd_ctx *ctx = set->ctx;
+    CpuJiffies jiffies;
+    uint64_t period = 1000000 / set->live_hz;
+    uint64_t redraw_us = 0;
+    uint64_t window_us;
+    uint64_t next;
+    uint64_t now;
+    uint32_t window_frames = 0;
+    float smoothed;
+    float pct;
+    int slot = page_live_slot(set);
+
+    if (slot < 0 || set->stats[slot].disabled)
+    {
+        fprintf(stderr, "pages: no cpu page for the live meter on %s\n", ctx->bus);
+        return;
+    }
+    /* values are fresh every refresh: nothing to animate */
+    ctx->anim.enabled = 0;
+    memset(&jiffies, 0, sizeof(jiffies));
+    smoothed = get_cpu_usage_since(&jiffies);
+    if (smoothed < 0.f)
+        smoothed = 0.f;
+
+    next = window_us = sampler_now_us();
+    for (;;)
+    {
+        page_poll(set);
+        now = sampler_now_us();
+        pct = get_cpu_usage_since(&jiffies);
+        if (pct >= 0.f)
+            smoothed += (pct - smoothed) * PAGE_LIVE_SMOOTH;
+
+        if (lcd_ctx_busy(ctx) || page_late(next + period))
+        {
+            set->live_skipped++;
+            set->stats[slot].dropped++;
+        }
+        else
+        {
+            if (now >= redraw_us || (ctx->partial && lcd_header_ready()))
+            {
+                page_charge(set, slot, page_draw(set, slot));
+                redraw_us = now + (uint64_t)pages[set->page[slot]].dwell_ms * 1000;
+            }
+            lcd_ctx_display_cpu_live(ctx, smoothed);
+            page_submit(set, slot, now, next + period, 0);
+            set->live_frames++;
+            window_frames++;
+            if (!set->first_page_us && !ctx->partial)
+            {
+                lcd_ctx_flush(ctx);
+                __atomic_store_n(&set->first_page_us, sampler_now_us(), __ATOMIC_RELEASE);
+            }
+        }
+
+        if (now - window_us >= (uint64_t)PAGE_LIVE_REPORT_S * 1000000)
+        {
+            set->live_rate = (float)window_frames * 1e6f / (float)(now - window_us);
+            if (set->live_rate < (float)set->live_hz * 0.9f)
+                fprintf(stderr, "pages: live meter on %s at %.1f Hz, short of %u Hz\n",
+                        ctx->bus, set->live_rate, (unsigned)set->live_hz);
+            window_frames = 0;
+            window_us = now;
+        }
+
+        next += period;
+        now = sampler_now_us();
+        while (next <= now)
+        {
+            /* late: drop the refreshes missed rather than run them back to back */
+            next += period;
+            set->live_skipped++;
+            set->stats[slot].dropped++;
+        }
+        usleep((useconds_t)(next - now));
+    }
+}
+
+/*
+ * Rotate through the set forever, holding each page for its dwell time.
+ * The alerts page is skipped while nothing fires, and cuts in as soon as
+ * something does. With live_hz set the CPU page is pinned as a live meter
+ * instead.
+ */
+void page_run(PageSet *set)
+{
+    int slot = 0;
+    int shown = 0;
+    int next;
+
+    if (set->live_hz)
+        page_live(set);
+    for (;;)
+    {
+        if (set->count == 0)
+        {
+            sleep(1);
+            continue;
+        }
+        next = -1;
+        if (set->page[slot] == alert_page && rules_firing() == 0)
+        {
+            /* nothing to show */
+        }
+        else if (page_show(set, slot) == 0)
+        {
+            shown++;
+            next = page_dwell(set, slot);
+        }
+        if (next >= 0)
+        {
+            /* a new alert cuts in ahead of anything queued; the rotation carries on after it */
+            slot = next;
+            if (page_render(set, slot, 1) == 0)
+                page_dwell(set, slot);
+        }
+        slot = (slot + 1) % set->count;
+        if (slot == 0)
+        {
+            /* every page disabled: do not spin */
+            if (shown == 0)
+                sleep(1);
+            shown = 0;
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __PAGES_H__
+#define __PAGES_H__
+
+#include <stdint.h>
+
+#define PAGE_MAX              16
+#define PAGE_DEFAULT_DWELL_MS 2000
+/* A page over its render budget this many times in a row is skipped */
+#define PAGE_MAX_STRIKES      3
+/* How often a page drawn with placeholders checks for its data */
+#define PAGE_FILL_POLL_MS     50
+/* How often a page on the panel checks the alert rules */
+#define PAGE_ALERT_POLL_MS    100
+/* While a critical rule fires, the bar row is inverted and restored every PAGE_BLINK_MS */
+#define PAGE_BLINK_MS         500
+#define PAGE_BLINK_Y          60
+#define PAGE_BLINK_H          10
+/* How long before a page is due its collectors are run, by default */
+#define PAGE_DEFAULT_LEAD_MS  250
+/* Live meter: weight of a new CPU sample in the smoothed reading, and how often the achieved rate is checked */
+#define PAGE_LIVE_SMOOTH      0.3f
+#define PAGE_LIVE_REPORT_S    5
+/* A page is late if it is not on the panel this long after its turn */
+#define PAGE_DEADLINE_MS      250
+/* Frames handed to the panel and not yet known to be on it, at most */
+#define PAGE_PENDING_MAX      4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lcd_ctx;
+
+/* Draw one page into ctx; the scheduler flushes it afterwards */
+typedef void (*page_render_fn)(struct lcd_ctx *ctx, void *arg);
+
+typedef struct PageStats{
+  uint32_t renders;
+  uint32_t overruns;
+  uint32_t last_us;
+  uint32_t max_us;
+  uint8_t disabled;
+  uint32_t deadlines;      /* frames of the page that reached the panel */
+  uint32_t misses;         /* ... after their deadline */
+  uint32_t worst_late_us;  /* furthest any of them was past its deadline */
+  uint32_t max_finish_us;  /* longest from starting a frame to its being on the panel */
+  uint32_t dropped;        /* frames not drawn because they would have started late or the bus was busy */
+  uint32_t coalesced;      /* frames that started late and were held back to go out with the next, not queued */
+}PageStats;
+
+/* A frame handed to the panel, with when it was started and when it is due */
+typedef struct PageFrame{
+  int slot;
+  uint64_t start_us;
+  uint64_t deadline_us;
+}PageFrame;
+
+/* The pages one panel rotates through, with per-panel budget accounting */
+typedef struct PageSet{
+  struct lcd_ctx *ctx;
+  int count;
+  int page[PAGE_MAX];
+  uint32_t strikes[PAGE_MAX];
+  PageStats stats[PAGE_MAX];
+  uint64_t first_page_us;      /* when the first page without placeholders was on the panel, 0 before */
+  uint8_t inverted;            /* the blink band is inverted on the panel */
+  uint32_t lead_ms;            /* how early the next page's collectors are run */
+  uint32_t prefetches;         /* collectors run early for a coming page */
+  int ready_slot;              /* slot composed offscreen and waiting to be presented, -1 if none */
+  uint8_t ready_partial;       /* ... and it was drawn with placeholders */
+  uint8_t ready_moving;        /* ... and with values still animating */
+  uint32_t prerenders;         /* pages composed offscreen ahead of their turn */
+  uint32_t frames;             /* animation frames drawn */
+  uint32_t frames_skipped;     /* ... and dropped because the one before was still being sent or they were late */
+  uint32_t frame_cost_us;      /* smoothed time a flush takes to reach the panel */
+  uint32_t meter_flushes;      /* flush count and time as of the last frame, to measure the next */
+  uint64_t meter_us;
+  uint32_t live_hz;            /* live meter refreshes per second; 0 rotates the pages instead */
+  uint32_t live_frames;        /* refreshes sent */
+  uint32_t live_skipped;       /* ... and skipped because the bus was still busy or the thread late */
+  float live_rate;             /* refreshes per second over the last PAGE_LIVE_REPORT_S */
+  PageFrame pending[PAGE_PENDING_MAX]; /* frames not yet known to be on the panel, oldest first */
+  int pending_count;
+  uint8_t held;                /* a late frame is drawn but waits for the bus to go idle */
+  uint64_t due_us;             /* when the next page in the rotation is due, 0 if now */
+}PageSet;
+
+extern int page_register(const char *name, page_render_fn render, void *arg, uint32_t dwell_ms, uint32_t budget_us);
+extern int page_depends(int page, const char *collectors);
+extern void page_register_builtin(void);
+extern int page_count(void);
+extern int page_find(const char *name);
+extern const char *page_name(int page);
+extern void page_stall(int page, uint8_t stalled);
+
+extern void page_set_init(PageSet *set, struct lcd_ctx *ctx);
+extern int page_set_add(PageSet *set, int page);
+extern void page_set_add_all(PageSet *set);
+extern int page_set_parse(PageSet *set, const char *list);
+extern int page_show(PageSet *set, int slot);
+extern int page_get_stats(PageSet *set, int slot, PageStats *stats);
+extern void page_run(PageSet *set);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PAGES_H__
@@ -0,0 +1,510 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "raster.h"
+#include "lcd_ctx.h"
+
+/* Coverage of one pixel by a shape */
+#define RASTER_OUT  0
+#define RASTER_EDGE 1
+#define RASTER_FULL 2
+
+/* sin of 0..90 degrees, Q14 */
+static const int16_t raster_sin_q14[91] = {
+    0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+    2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+    5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+    8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384,
+};
+
+/* What one call draws with, and the box of the pixels it changed */
+typedef struct Raster{
+    lcd_ctx *ctx;
+    uint16_t color;
+    uint8_t aa;
+    lcd_rect bounds;
+}Raster;
+
+typedef uint8_t (*raster_cover_fn)(const void *shape, int x, int y);
+
+/* A ring, a disc when it has no hole, optionally cut to a sector */
+typedef struct RasterRing{
+    int cx;
+    int cy;
+    /* limits on 4 * squared distance from the centre, i.e. in quarter pixels */
+    int64_t full_out;
+    int64_t edge_out;
+    int64_t zero_in;           /* at or below: in the hole */
+    int64_t full_in;           /* below: on the hole's edge */
+    uint8_t sector;            /* 0: all of it, 1: a sweep up to 180 degrees, 2: a wider one */
+    int32_t sx;                /* start and end directions, Q14 */
+    int32_t sy;
+    int32_t ex;
+    int32_t ey;
+}RasterRing;
+
+/* A capsule: every pixel within a distance of a segment */
+typedef struct RasterLine{
+    float ax;
+    float ay;
+    float lx;                  /* the segment, from (ax, ay) */
+    float ly;
+    float len2;
+    float full2;               /* squared distances */
+    float edge2;
+}RasterLine;
+
+/* A rectangle whose corners are quarter discs around the core's corners */
+typedef struct RasterRound{
+    int x0;                    /* core, inclusive */
+    int y0;
+    int x1;
+    int y1;
+    int64_t full;
+    int64_t edge;
+}RasterRound;
+
+static int32_t raster_sin(int angle)
+{
+    angle %= 360;
+    if (angle < 0)
+        angle += 360;
+    if (angle <= 90)
+        return raster_sin_q14[angle];
+    if (angle <= 180)
+        return raster_sin_q14[180 - angle];
+    if (angle <= 270)
+        return -raster_sin_q14[angle - 180];
+    return -raster_sin_q14[360 - angle];
+}
+
+static int32_t raster_cos(int angle)
+{
+    return raster_sin(angle + 90);
+}
+
+static uint32_t raster_isqrt(uint64_t v)
+{
+    uint64_t r = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > v)
+        bit >>= 2;
+    while (bit)
+    {
+        if (v >= r + bit)
+        {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+/* v as an int within lo..hi, for span ends worked out in float */
+static int raster_clampf(float v, int lo, int hi)
+{
+    if (!(v > (float)lo))
+        return lo;
+    if (v >= (float)hi)
+        return hi;
+    return (int)v;
+}
+
+static void raster_begin(Raster *r, lcd_ctx *ctx, uint16_t color, uint8_t flags)
+{
+    r->ctx = ctx;
+    r->color = color;
+    r->aa = (flags & LCD_RASTER_AA) != 0;
+    r->bounds.x0 = 0;
+    r->bounds.y0 = 0;
+    r->bounds.x1 = -1;
+    r->bounds.y1 = -1;
+}
+
+static void raster_grow(Raster *r, int x0, int x1, int y)
+{
+    lcd_rect *b = &r->bounds;
+
+    if (b->x1 < b->x0)
+    {
+        b->x0 = (int16_t)x0;
+        b->x1 = (int16_t)x1;
+        b->y0 = (int16_t)y;
+        b->y1 = (int16_t)y;
+        return;
+    }
+    if (x0 < b->x0) b->x0 = (int16_t)x0;
+    if (x1 > b->x1) b->x1 = (int16_t)x1;
+    if (y < b->y0) b->y0 = (int16_t)y;
+    if (y > b->y1) b->y1 = (int16_t)y;
+}
+
+/* Fill x0..x1 of row y; the row must be on the panel, the span is clipped */
+static void raster_span(Raster *r, int y, int x0, int x1)
+{
+    uint16_t *p;
+    int x;
+
+    if (x0 < 0)
+        x0 = 0;
+    if (x1 >= r->ctx->width)
+        x1 = r->ctx->width - 1;
+    if (x0 > x1)
+        return;
+    p = &r->ctx->fb[y * r->ctx->width];
+    for (x = x0; x <= x1; x++)
+        p[x] = r->color;
+    raster_grow(r, x0, x1, y);
+}
+
+/* Half the colour over what is there: halve each channel and add */
+static void raster_blend(Raster *r, int y, int x)
+{
+    uint16_t *p = &r->ctx->fb[y * r->ctx->width + x];
+
+    *p = (uint16_t)(((*p & 0xF7DE) >> 1) + ((r->color & 0xF7DE) >> 1));
+    raster_grow(r, x, x, y);
+}
+
+/*
+ * Draw the pixels of row y between x0 and x1 that the shape covers; runs
+ * of covered pixels go out as spans. Without antialiasing an edge pixel
+ * counts as covered.
+ */
+static void raster_row(Raster *r, int y, int x0, int x1, raster_cover_fn cover, const void *shape)
+{
+    uint8_t c;
+    int run = -1;
+    int x;
+
+    if (y < 0 || y >= r->ctx->height)
+        return;
+    if (x0 < 0)
+        x0 = 0;
+    if (x1 >= r->ctx->width)
+        x1 = r->ctx->width - 1;
+    for (x = x0; x <= x1; x++)
+    {
+        c = cover(shape, x, y);
+        if (c == RASTER_EDGE && !r->aa)
+            c = RASTER_FULL;
+        if (c == RASTER_FULL)
+        {
+            if (run < 0)
+                run = x;
+            continue;
+        }
+        if (run >= 0)
+        {
+            raster_span(r, y, run, x - 1);
+            run = -1;
+        }
+        if (c == RASTER_EDGE)
+            raster_blend(r, y, x);
+    }
+    if (run >= 0)
+        raster_span(r, y, run, x1);
+}
+
+/* Mark what was drawn; flushes unless the context defers */
+static void raster_end(Raster *r)
+{
+    lcd_rect *b = &r->bounds;
+
+    if (b->x1 < b->x0)
+        return;
+    lcd_ctx_touched(r->ctx, (uint16_t)b->x0, (uint16_t)b->y0,
+                    (uint16_t)(b->x1 - b->x0 + 1), (uint16_t)(b->y1 - b->y0 + 1));
+}
+
+static uint8_t raster_ring_cover(const void *shape, int x, int y)
+{
+    const RasterRing *g = (const RasterRing *)shape;
+    int64_t dx = x - g->cx;
+    int64_t dy = y - g->cy;
+    int64_t d2 = 4 * (dx * dx + dy * dy);
+    int64_t cs;
+    int64_t ce;
+
+    if (d2 > g->edge_out || d2 <= g->zero_in)
+        return RASTER_OUT;
+    if (g->sector)
+    {
+        /* clockwise of the start and anticlockwise of the end */
+        cs = g->sx * dy - g->sy * dx;
+        ce = dx * g->ey - dy * g->ex;
+        if (g->sector == 1 ? (cs < 0 || ce < 0) : (cs < 0 && ce < 0))
+            return RASTER_OUT;
+    }
+    return (d2 <= g->full_out && d2 >= g->full_in) ? RASTER_FULL : RASTER_EDGE;
+}
+
+/*
+ * A ring of width pixels whose outside edge is r from the centre, cut to
+ * the sweep from start if sector is set. Rows are walked only across the
+ * ring: the hole is skipped.
+ */
+static void raster_ring(lcd_ctx *ctx, int cx, int cy, int r, int width, int start, int sweep,
+                        uint8_t sector, uint16_t color, uint8_t flags)
+{
+    RasterRing g;
+    Raster ras;
+    int64_t q;
+    int64_t dy2;
+    int xo;
+    int xi;
+    int dy;
+    int last;
+    int ri;
+
+    if (width <= 0)
+        width = 1;
+    ri = r - width + 1;
+    g.cx = cx;
+    g.cy = cy;
+    g.full_out = 4 * (int64_t)r * r;
+    g.edge_out = 4 * (int64_t)r * r + 4 * r;
+    g.zero_in = ri > 0 ? 4 * (int64_t)ri * ri - 4 * ri : -1;
+    g.full_in = ri > 0 ? 4 * (int64_t)ri * ri : 0;
+    g.sector = sector;
+    g.sx = raster_cos(start);
+    g.sy = raster_sin(start);
+    g.ex = raster_cos(start + sweep);
+    g.ey = raster_sin(start + sweep);
+
+    raster_begin(&ras, ctx, color, flags);
+    /* only the rows on the panel */
+    dy = -(r + 1) > -cy ? -(r + 1) : -cy;
+    last = r + 1 < ctx->height - 1 - cy ? r + 1 : ctx->height - 1 - cy;
+    for (; dy <= last; dy++)
+    {
+        dy2 = 4 * (int64_t)dy * dy;
+        q = g.edge_out - dy2;
+        if (q < 0)
+            continue;
+        xo = (int)raster_isqrt((uint64_t)q / 4);
+        if (g.zero_in >= dy2)
+        {
+            xi = (int)raster_isqrt((uint64_t)(g.zero_in - dy2) / 4);
+            raster_row(&ras, cy + dy, cx - xo, cx - xi - 1, raster_ring_cover, &g);
+            raster_row(&ras, cy + dy, cx + xi + 1, cx + xo, raster_ring_cover, &g);
+        }
+        else
+        {
+            raster_row(&ras, cy + dy, cx - xo, cx + xo, raster_ring_cover, &g);
+        }
+    }
+    raster_end(&ras);
+}
+
+static uint8_t raster_line_cover(const void *shape, int x, int y)
+{
+    const RasterLine *l = (const RasterLine *)shape;
+    float px = (float)x - l->ax;
+    float py = (float)y - l->ay;
+    float t = 0.f;
+    float d2;
+
+    if (l->len2 > 0.f)
+    {
+        t = (px * l->lx + py * l->ly) / l->len2;
+        if (t < 0.f)
+            t = 0.f;
+        else if (t > 1.f)
+            t = 1.f;
+    }
+    px -= t * l->lx;
+    py -= t * l->ly;
+    d2 = px * px + py * py;
+    if (d2 <= l->full2)
+        return RASTER_FULL;
+    return d2 <= l->edge2 ? RASTER_EDGE : RASTER_OUT;
+}
+
+/*
+ * A line width pixels wide with round ends. Each row is walked only
+ * where it crosses the band around the line.
+ */
+void lcd_ctx_draw_line(lcd_ctx *ctx, int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+                       uint16_t width, uint16_t color, uint8_t flags)
+{
+    RasterLine l;
+    Raster ras;
+    float h;
+    float e;
+    float len;
+    float a;
+    float b;
+    float t;
+    int reach;
+    int left;
+    int right;
+    int top;
+    int bottom;
+    int y;
+
+    h = (float)(width ? width : 1) / 2.f;
+    l.ax = x0;
+    l.ay = y0;
+    l.lx = (float)(x1 - x0);
+    l.ly = (float)(y1 - y0);
+    l.len2 = l.lx * l.lx + l.ly * l.ly;
+    if (flags & LCD_RASTER_AA)
+    {
+        e = h + 0.35f;
+        l.full2 = h > 0.35f ? (h - 0.35f) * (h - 0.35f) : 0.f;
+        l.edge2 = e * e;
+    }
+    else
+    {
+        e = h;
+        l.full2 = h * h;
+        l.edge2 = l.full2;
+    }
+
+    reach = (int)e + 1;
+    left = (x0 < x1 ? x0 : x1) - reach;
+    right = (x0 > x1 ? x0 : x1) + reach;
+    top = (y0 < y1 ? y0 : y1) - reach;
+    bottom = (y0 > y1 ? y0 : y1) + reach;
+    if (top < 0)
+        top = 0;
+    if (bottom >= ctx->height)
+        bottom = ctx->height - 1;
+    /* over-estimate the length so the band below is never too narrow */
+    len = (float)raster_isqrt((uint64_t)l.len2) + 1.f;
+
+    raster_begin(&ras, ctx, color, flags);
+    for (y = top; y <= bottom; y++)
+    {
+        if (y1 != y0)
+        {
+            /* where the row is within e of the line through the segment */
+            a = (((float)y - l.ay) * l.lx - e * len) / l.ly + l.ax;
+            b = (((float)y - l.ay) * l.lx + e * len) / l.ly + l.ax;
+            if (a > b)
+            {
+                t = a;
+                a = b;
+                b = t;
+            }
+            raster_row(&ras, y, raster_clampf(a - 1.f, left, right), raster_clampf(b + 1.f, left, right),
+                       raster_line_cover, &l);
+        }
+        else
+        {
+            raster_row(&ras, y, left, right, raster_line_cover, &l);
+        }
+    }
+    raster_end(&ras);
+}
+
+/*
+ * A circle outline width pixels thick, its outside edge r from the centre
+ */
+void lcd_ctx_draw_circle(lcd_ctx *ctx, int16_t cx, int16_t cy, uint16_t r,
+                         uint16_t width, uint16_t color, uint8_t flags)
+{
+    raster_ring(ctx, cx, cy, r, width, 0, 360, 0, color, flags);
+}
+
+void lcd_ctx_fill_circle(lcd_ctx *ctx, int16_t cx, int16_t cy, uint16_t r, uint16_t color, uint8_t flags)
+{
+    raster_ring(ctx, cx, cy, r, r + 1, 0, 360, 0, color, flags);
+}
+
+/*
+ * Part of a circle outline, from start clockwise through sweep degrees;
+ * a negative sweep runs anticlockwise
+ */
+void lcd_ctx_draw_arc(lcd_ctx *ctx, int16_t cx, int16_t cy, uint16_t r, uint16_t width,
+                      int16_t start, int16_t sweep, uint16_t color, uint8_t flags)
+{
+    if (sweep == 0)
+        return;
+    if (sweep < 0)
+    {
+        start = (int16_t)(start + sweep);
+        sweep = (int16_t)-sweep;
+    }
+    raster_ring(ctx, cx, cy, r, width, start, sweep, sweep >= 360 ? 0 : (sweep <= 180 ? 1 : 2), color, flags);
+}
+
+static uint8_t raster_round_cover(const void *shape, int x, int y)
+{
+    const RasterRound *g = (const RasterRound *)shape;
+    int64_t dx = x < g->x0 ? x - g->x0 : (x > g->x1 ? x - g->x1 : 0);
+    int64_t dy = y < g->y0 ? y - g->y0 : (y > g->y1 ? y - g->y1 : 0);
+    int64_t d2 = 4 * (dx * dx + dy * dy);
+
+    if (d2 <= g->full)
+        return RASTER_FULL;
+    return d2 <= g->edge ? RASTER_EDGE : RASTER_OUT;
+}
+
+/*
+ * A filled rectangle with corners rounded to radius. Rows between the
+ * corners are single spans.
+ */
+void lcd_ctx_fill_round_rect(lcd_ctx *ctx, int16_t x, int16_t y, uint16_t w, uint16_t h,
+                             uint16_t radius, uint16_t color, uint8_t flags)
+{
+    RasterRound g;
+    Raster ras;
+    int64_t q;
+    int rad = radius;
+    int xo;
+    int dy;
+    int row;
+    int last;
+
+    if (w == 0 || h == 0)
+        return;
+    if (rad > (w - 1) / 2)
+        rad = (w - 1) / 2;
+    if (rad > (h - 1) / 2)
+        rad = (h - 1) / 2;
+    g.x0 = x + rad;
+    g.y0 = y + rad;
+    g.x1 = x + w - 1 - rad;
+    g.y1 = y + h - 1 - rad;
+    g.full = 4 * (int64_t)rad * rad;
+    g.edge = 4 * (int64_t)rad * rad + 4 * rad;
+
+    raster_begin(&ras, ctx, color, flags);
+    last = y + h - 1 < ctx->height - 1 ? y + h - 1 : ctx->height - 1;
+    for (row = y > 0 ? y : 0; row <= last; row++)
+    {
+        dy = row < g.y0 ? row - g.y0 : (row > g.y1 ? row - g.y1 : 0);
+        if (dy == 0)
+        {
+            raster_span(&ras, row, x, x + w - 1);
+            continue;
+        }
+        q = g.edge - 4 * (int64_t)dy * dy;
+        if (q < 0)
+            continue;
+        xo = (int)raster_isqrt((uint64_t)q / 4);
+        raster_row(&ras, row, g.x0 - xo, g.x1 + xo, raster_round_cover, &g);
+    }
+    raster_end(&ras);
+}
+
+/*
+ * The pixel r from (cx, cy) at angle, e.g. for the tip of a needle
+ */
+void lcd_ctx_point_on_circle(int16_t cx, int16_t cy, uint16_t r, int16_t angle, int16_t *x, int16_t *y)
+{
+    *x = (int16_t)(cx + (((int32_t)r * raster_cos(angle) + 8192) >> 14));
+    *y = (int16_t)(cy + (((int32_t)r * raster_sin(angle) + 8192) >> 14));
+}
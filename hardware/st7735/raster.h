@@ -0,0 +1,43 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __RASTER_H__
+#define __RASTER_H__
+
+#include <stdint.h>
+
+/*
+ * Lines, circles, arcs and rounded rectangles, drawn as horizontal spans
+ * straight into the shadow framebuffer. Shapes may run off the panel and
+ * are clipped. Each call marks only the bounding box of the pixels it
+ * changed, so moving a gauge needle re-sends the needle and no more.
+ *
+ * Angles are in degrees, 0 pointing right and growing clockwise as seen
+ * on the panel. Circles, arcs and rounded rectangles are worked out in
+ * integers, lines in single-precision float; nothing needs libm.
+ */
+
+/* Blend edge pixels half way into what is under them */
+#define LCD_RASTER_AA  0x01
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lcd_ctx;
+
+extern void lcd_ctx_draw_line(struct lcd_ctx *ctx, int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+                              uint16_t width, uint16_t color, uint8_t flags);
+extern void lcd_ctx_draw_circle(struct lcd_ctx *ctx, int16_t cx, int16_t cy, uint16_t r,
+                                uint16_t width, uint16_t color, uint8_t flags);
+extern void lcd_ctx_fill_circle(struct lcd_ctx *ctx, int16_t cx, int16_t cy, uint16_t r,
+                                uint16_t color, uint8_t flags);
+extern void lcd_ctx_draw_arc(struct lcd_ctx *ctx, int16_t cx, int16_t cy, uint16_t r, uint16_t width,
+                             int16_t start, int16_t sweep, uint16_t color, uint8_t flags);
+extern void lcd_ctx_fill_round_rect(struct lcd_ctx *ctx, int16_t x, int16_t y, uint16_t w, uint16_t h,
+                                    uint16_t radius, uint16_t color, uint8_t flags);
+extern void lcd_ctx_point_on_circle(int16_t cx, int16_t cy, uint16_t r, int16_t angle, int16_t *x, int16_t *y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RASTER_H__
@@ -0,0 +1,119 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "splash.h"
+#include "lcd_ctx.h"
+
+/*
+ * The CPU page's blue separator with "UCTRONICS" below it in Font_16x26,
+ * run-length encoded. The separator sits where the CPU page draws its own,
+ * so the first page only has to repaint around it.
+ */
+static const uint16_t splash_runs[] = {
+    3200, 0x0000, 800, 0x001F, 2249, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF,
+    7, 0x0000, 25, 0xFFFF, 2, 0x0000, 10, 0xFFFF, 9, 0x0000, 7, 0xFFFF,
+    5, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 2, 0x0000, 14, 0xFFFF,
+    7, 0x0000, 9, 0xFFFF, 5, 0x0000, 9, 0xFFFF, 19, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 5, 0x0000, 27, 0xFFFF, 2, 0x0000, 12, 0xFFFF,
+    5, 0x0000, 11, 0xFFFF, 3, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF,
+    2, 0x0000, 14, 0xFFFF, 5, 0x0000, 11, 0xFFFF, 3, 0x0000, 12, 0xFFFF,
+    18, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 3, 0x0000, 6, 0xFFFF,
+    4, 0x0000, 3, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    3, 0x0000, 6, 0xFFFF, 3, 0x0000, 5, 0xFFFF, 3, 0x0000, 5, 0xFFFF,
+    2, 0x0000, 6, 0xFFFF, 5, 0x0000, 4, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    8, 0x0000, 6, 0xFFFF, 4, 0x0000, 3, 0xFFFF, 2, 0x0000, 5, 0xFFFF,
+    5, 0x0000, 3, 0xFFFF, 18, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF,
+    2, 0x0000, 5, 0xFFFF, 15, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    4, 0x0000, 5, 0xFFFF, 2, 0x0000, 5, 0xFFFF, 5, 0x0000, 5, 0xFFFF,
+    1, 0x0000, 7, 0xFFFF, 4, 0x0000, 4, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 5, 0xFFFF, 11, 0x0000, 4, 0xFFFF, 27, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 2, 0x0000, 4, 0xFFFF, 16, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 5, 0x0000, 4, 0xFFFF, 2, 0x0000, 4, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 1, 0x0000, 7, 0xFFFF, 4, 0x0000, 4, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 12, 0x0000, 4, 0xFFFF,
+    27, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 1, 0x0000, 5, 0xFFFF,
+    16, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 5, 0x0000, 4, 0xFFFF,
+    2, 0x0000, 4, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 1, 0x0000, 8, 0xFFFF,
+    3, 0x0000, 4, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    12, 0x0000, 4, 0xFFFF, 27, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF,
+    1, 0x0000, 4, 0xFFFF, 17, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    4, 0x0000, 5, 0xFFFF, 1, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    1, 0x0000, 8, 0xFFFF, 3, 0x0000, 4, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 13, 0x0000, 5, 0xFFFF, 26, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF, 17, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 4, 0x0000, 4, 0xFFFF, 2, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 1, 0x0000, 9, 0xFFFF, 2, 0x0000, 4, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 14, 0x0000, 7, 0xFFFF,
+    23, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF,
+    17, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 2, 0x0000, 6, 0xFFFF,
+    2, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF,
+    1, 0x0000, 5, 0xFFFF, 1, 0x0000, 4, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 15, 0x0000, 9, 0xFFFF, 20, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF, 17, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 10, 0xFFFF, 4, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    1, 0x0000, 4, 0xFFFF, 2, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 17, 0x0000, 9, 0xFFFF,
+    18, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF,
+    17, 0x0000, 5, 0xFFFF, 7, 0x0000, 9, 0xFFFF, 5, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF, 2, 0x0000, 9, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 20, 0x0000, 7, 0xFFFF,
+    17, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF, 1, 0x0000, 5, 0xFFFF,
+    16, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 1, 0x0000, 5, 0xFFFF,
+    4, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF,
+    3, 0x0000, 8, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    21, 0x0000, 5, 0xFFFF, 17, 0x0000, 5, 0xFFFF, 6, 0x0000, 4, 0xFFFF,
+    1, 0x0000, 5, 0xFFFF, 16, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    2, 0x0000, 5, 0xFFFF, 4, 0x0000, 4, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    1, 0x0000, 4, 0xFFFF, 3, 0x0000, 8, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 22, 0x0000, 4, 0xFFFF, 18, 0x0000, 4, 0xFFFF,
+    5, 0x0000, 4, 0xFFFF, 3, 0x0000, 5, 0xFFFF, 15, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 3, 0x0000, 5, 0xFFFF, 3, 0x0000, 4, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 1, 0x0000, 4, 0xFFFF, 4, 0x0000, 7, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 7, 0x0000, 5, 0xFFFF, 21, 0x0000, 4, 0xFFFF,
+    18, 0x0000, 4, 0xFFFF, 5, 0x0000, 4, 0xFFFF, 3, 0x0000, 6, 0xFFFF,
+    14, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 4, 0x0000, 5, 0xFFFF,
+    2, 0x0000, 5, 0xFFFF, 5, 0x0000, 5, 0xFFFF, 1, 0x0000, 4, 0xFFFF,
+    5, 0x0000, 6, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 7, 0x0000, 6, 0xFFFF,
+    10, 0x0000, 1, 0xFFFF, 8, 0x0000, 5, 0xFFFF, 18, 0x0000, 5, 0xFFFF,
+    3, 0x0000, 5, 0xFFFF, 4, 0x0000, 6, 0xFFFF, 5, 0x0000, 2, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF, 5, 0x0000, 4, 0xFFFF,
+    3, 0x0000, 5, 0xFFFF, 3, 0x0000, 5, 0xFFFF, 2, 0x0000, 4, 0xFFFF,
+    5, 0x0000, 6, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 8, 0x0000, 6, 0xFFFF,
+    5, 0x0000, 2, 0xFFFF, 2, 0x0000, 4, 0xFFFF, 4, 0x0000, 5, 0xFFFF,
+    20, 0x0000, 11, 0xFFFF, 7, 0x0000, 11, 0xFFFF, 6, 0x0000, 5, 0xFFFF,
+    7, 0x0000, 4, 0xFFFF, 5, 0x0000, 5, 0xFFFF, 3, 0x0000, 11, 0xFFFF,
+    3, 0x0000, 4, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 2, 0x0000, 14, 0xFFFF,
+    5, 0x0000, 11, 0xFFFF, 2, 0x0000, 12, 0xFFFF, 23, 0x0000, 7, 0xFFFF,
+    11, 0x0000, 9, 0xFFFF, 6, 0x0000, 5, 0xFFFF, 7, 0x0000, 4, 0xFFFF,
+    6, 0x0000, 4, 0xFFFF, 5, 0x0000, 7, 0xFFFF, 5, 0x0000, 4, 0xFFFF,
+    6, 0x0000, 5, 0xFFFF, 2, 0x0000, 14, 0xFFFF, 7, 0x0000, 9, 0xFFFF,
+    3, 0x0000, 9, 0xFFFF, 3692, 0x0000
+};
+
+/*
+ * Decode the splash straight into the framebuffer and mark the whole
+ * panel for the next flush. A panel of another geometry is cleared
+ * instead.
+ */
+void lcd_ctx_draw_splash(lcd_ctx *ctx)
+{
+    uint16_t *p = ctx->fb;
+    uint16_t *end = ctx->fb + (uint32_t)ctx->width * ctx->height;
+    uint32_t i;
+    uint16_t n;
+    uint16_t color;
+
+    if (ctx->width != SPLASH_WIDTH || ctx->height != SPLASH_HEIGHT)
+    {
+        while (p < end)
+            *p++ = ST7735_BLACK;
+    }
+    for (i = 0; i + 1 < sizeof(splash_runs) / sizeof(splash_runs[0]) && p < end; i += 2)
+    {
+        n = splash_runs[i];
+        color = splash_runs[i + 1];
+        if (n > end - p)
+            n = (uint16_t)(end - p);
+        while (n--)
+            *p++ = color;
+    }
+    lcd_ctx_invalidate(ctx, 0, 0, ctx->width, ctx->height);
+}
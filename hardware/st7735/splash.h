@@ -0,0 +1,26 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __SPLASH_H__
+#define __SPLASH_H__
+
+#include <stdint.h>
+
+/*
+ * Boot splash, stored as (count, colour) runs of RGB565 pixels in row
+ * order, so it costs no rendering and about 2 KB of table
+ */
+#define SPLASH_WIDTH  160
+#define SPLASH_HEIGHT 80
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct lcd_ctx;
+
+extern void lcd_ctx_draw_splash(struct lcd_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SPLASH_H__
@@ -1,8 +1,12 @@
 /* vim: set ai et ts=4 sw=4: */
 #include "st7735.h"
+#include "lcd_ctx.h"
+#include "lcd_bus.h"
+#include "fbstore.h"
 #include "time.h"
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <sys/sysinfo.h>
 #include <sys/vfs.h>
@@ -16,66 +20,690 @@
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include "rpiInfo.h"
+#include "sampler.h"
+#include "history.h"
+#include "rules.h"
+#include "textlayout.h"
+#include "raster.h"
 
-int i2cd;
+/*
+ * Context used by the legacy (context-less) API
+ */
+static lcd_ctx default_ctx;
+static pthread_once_t default_ctx_once = PTHREAD_ONCE_INIT;
+
+static void default_ctx_init(void)
+{
+    lcd_ctx_init(&default_ctx);
+}
+
+lcd_ctx *lcd_default_ctx(void)
+{
+    pthread_once(&default_ctx_once, default_ctx_init);
+    return &default_ctx;
+}
+
+/*
+ * i2c-dev transport
+ */
+static int i2cdev_write(void *priv, const uint8_t *buf, uint32_t len)
+{
+    lcd_ctx *ctx = (lcd_ctx *)priv;
+    return (write(ctx->fd, buf, len) == (ssize_t)len) ? 0 : -1;
+}
+
+static void i2cdev_close(void *priv)
+{
+    lcd_ctx *ctx = (lcd_ctx *)priv;
+    if (ctx->fd >= 0)
+    {
+        close(ctx->fd);
+        ctx->fd = -1;
+    }
+}
+
+static void lcd_ctx_write(lcd_ctx *ctx, const uint8_t *buf, uint32_t len)
+{
+    uint64_t t0 = sampler_now_us();
+    uint32_t held;
+
+    if (!ctx->transport.write || ctx->transport.write(ctx->transport.priv, buf, len) != 0)
+        ctx->stats.write_errors++;
+    ctx->stats.bytes += len;
+
+    held = (uint32_t)(sampler_now_us() - t0);
+    if (held > ctx->stats.max_hold_us)
+        ctx->stats.max_hold_us = held;
+}
+
+static void lcd_rect_clear(lcd_rect *r)
+{
+    r->x0 = 0;
+    r->y0 = 0;
+    r->x1 = -1;
+    r->y1 = -1;
+}
+
+/*
+ * Grow a rectangle to cover an area; the area must already be clipped
+ */
+static void lcd_rect_grow(lcd_rect *d, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if (w == 0 || h == 0)
+        return;
+    if (d->x1 < d->x0)
+    {
+        d->x0 = x;
+        d->y0 = y;
+        d->x1 = x + w - 1;
+        d->y1 = y + h - 1;
+        return;
+    }
+    if (x < d->x0) d->x0 = x;
+    if (y < d->y0) d->y0 = y;
+    if (x + w - 1 > d->x1) d->x1 = x + w - 1;
+    if (y + h - 1 > d->y1) d->y1 = y + h - 1;
+}
+
+static void lcd_rect_add(lcd_rect *d, const lcd_rect *r)
+{
+    if (r->x1 >= r->x0)
+        lcd_rect_grow(d, r->x0, r->y0, r->x1 - r->x0 + 1, r->y1 - r->y0 + 1);
+}
+
+static uint32_t lcd_rect_area(const lcd_rect *r)
+{
+    if (r->x1 < r->x0)
+        return 0;
+    return (uint32_t)(r->x1 - r->x0 + 1) * (uint32_t)(r->y1 - r->y0 + 1);
+}
+
+/*
+ * Grow the dirty rectangle; the area must already be clipped
+ */
+static void lcd_ctx_mark(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    lcd_rect_grow(&ctx->dirty, x, y, w, h);
+}
+
+/*
+ * The bounding box of the pixels inside area where frame differs from
+ * what the panel shows; empty if none do
+ */
+static void lcd_ctx_diff(const lcd_ctx *ctx, const uint16_t *frame, const lcd_rect *area, lcd_rect *out)
+{
+    const uint16_t *a;
+    const uint16_t *b;
+    int16_t x;
+    int16_t y;
+
+    lcd_rect_clear(out);
+    for (y = area->y0; y <= area->y1; y++)
+    {
+        a = &frame[y * ctx->width];
+        b = &ctx->shown[y * ctx->width];
+        if (memcmp(a + area->x0, b + area->x0, (size_t)(area->x1 - area->x0 + 1) * 2) == 0)
+            continue;
+        for (x = area->x0; x <= area->x1; x++)
+        {
+            if (a[x] != b[x])
+                lcd_rect_grow(out, (uint16_t)x, (uint16_t)y, 1, 1);
+        }
+    }
+}
+
+/*
+ * Immediate mode: push what a primitive drew before it returns
+ */
+static void lcd_ctx_commit(lcd_ctx *ctx)
+{
+    if (!ctx->deferred && !ctx->offscreen)
+        lcd_ctx_flush(ctx);
+}
+
+void lcd_ctx_init(lcd_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->fd = -1;
+    snprintf(ctx->bus, sizeof(ctx->bus), "%s", "/dev/i2c-1");
+    ctx->address = I2C_ADDRESS;
+    ctx->xstart = ST7735_XSTART;
+    ctx->ystart = ST7735_YSTART;
+    ctx->width = ST7735_WIDTH;
+    ctx->height = ST7735_HEIGHT;
+    ctx->rotation = ST7735_ROTATION;
+    ctx->write_delay_us = LCD_WRITE_DELAY_US;
+    ctx->chunk_delay_us = LCD_CHUNK_DELAY_US;
+    ctx->chunk_bytes = BURST_MAX_LENGTH;
+    ctx->event_fd = -1;
+    lcd_rect_clear(&ctx->dirty);
+    lcd_rect_clear(&ctx->forced);
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->idle, NULL);
+}
+
+lcd_ctx *lcd_ctx_create(void)
+{
+    lcd_ctx *ctx = (lcd_ctx *)malloc(sizeof(lcd_ctx));
+    if (ctx)
+        lcd_ctx_init(ctx);
+    return ctx;
+}
+
+void lcd_ctx_destroy(lcd_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    lcd_ctx_close(ctx);
+    if (ctx->event_fd >= 0)
+    {
+        close(ctx->event_fd);
+        ctx->event_fd = -1;
+    }
+    lcd_ctx_store_sync(ctx);
+    fbstore_close(ctx->store);
+    ctx->store = NULL;
+    if (ctx != &default_ctx)
+    {
+        pthread_cond_destroy(&ctx->idle);
+        pthread_mutex_destroy(&ctx->lock);
+        free(ctx);
+    }
+}
+
+/*
+ * Open ctx->bus and talk to ctx->address. Returns 0 on success.
+ */
+uint8_t lcd_ctx_begin(lcd_ctx *ctx)
+{
+    lcd_ctx_close(ctx);
+    ctx->shown_valid = 0;
+
+    ctx->fd = open(ctx->bus, O_RDWR);
+    if (ctx->fd < 0)
+    {
+        fprintf(stderr, "Device %s failed to initialize: %s\n", ctx->bus, strerror(errno));
+        return 1;
+    }
+    if (ioctl(ctx->fd, I2C_SLAVE_FORCE, ctx->address) < 0)
+    {
+        fprintf(stderr, "Device %s: address 0x%02x not available: %s\n", ctx->bus, ctx->address, strerror(errno));
+        close(ctx->fd);
+        ctx->fd = -1;
+        return 1;
+    }
+    ctx->transport.write = i2cdev_write;
+    ctx->transport.close = i2cdev_close;
+    ctx->transport.priv = ctx;
+    return 0;
+}
+
+uint8_t lcd_ctx_open(lcd_ctx *ctx, const char *bus, uint8_t address)
+{
+    if (bus)
+        snprintf(ctx->bus, sizeof(ctx->bus), "%s", bus);
+    ctx->address = address;
+    return lcd_ctx_begin(ctx);
+}
+
+/*
+ * Use a caller-provided transport, e.g. a recorder in tests
+ */
+void lcd_ctx_set_transport(lcd_ctx *ctx, const lcd_transport *transport)
+{
+    lcd_ctx_close(ctx);
+    ctx->transport = *transport;
+    ctx->shown_valid = 0;
+}
+
+/*
+ * Keep the frame on the panel in the file at path from now on. Staged
+ * frames are saved there at most every LCD_STORE_MS; see
+ * lcd_ctx_store_sync(). Returns 0 on success.
+ */
+uint8_t lcd_ctx_persist(lcd_ctx *ctx, const char *path)
+{
+    fbstore_close(ctx->store);
+    ctx->store = fbstore_open(path, ctx->width, ctx->height);
+    return ctx->store ? 0 : 1;
+}
+
+/*
+ * Load the last saved frame into the framebuffer and mark all of it for
+ * the next flush. Returns 0 if there was a frame to load.
+ */
+uint8_t lcd_ctx_restore(lcd_ctx *ctx)
+{
+    if (fbstore_load(ctx->store, ctx->fb) != 0)
+        return 1;
+    lcd_rect_grow(&ctx->forced, 0, 0, ctx->width, ctx->height);
+    return 0;
+}
+
+/*
+ * Save the frame last staged for the panel, if it has not been saved
+ * yet. Staging only saves when LCD_STORE_MS have passed since the last
+ * save, so an animation or live meter does not copy and checksum the
+ * whole frame each time; call this when the panel goes idle, e.g. after
+ * a page switch, so the final frame is not left out.
+ */
+void lcd_ctx_store_sync(lcd_ctx *ctx)
+{
+    if (!ctx->store || !ctx->store_pending)
+        return;
+    fbstore_save(ctx->store, ctx->shown);
+    ctx->store_pending = 0;
+    ctx->store_us = sampler_now_us();
+}
+
+void lcd_ctx_close(lcd_ctx *ctx)
+{
+    if (ctx->transport.close)
+        ctx->transport.close(ctx->transport.priv);
+    memset(&ctx->transport, 0, sizeof(ctx->transport));
+}
+
+/*
+ * Deferred contexts only touch the bus in lcd_ctx_flush(); turning
+ * deferral off flushes whatever is pending.
+ */
+void lcd_ctx_set_deferred(lcd_ctx *ctx, uint8_t deferred)
+{
+    ctx->deferred = deferred ? 1 : 0;
+    lcd_ctx_commit(ctx);
+}
+
+/*
+ * Mark a rectangle for the next flush without drawing, e.g. to resend
+ * pixels a cut-short frame did not get to. Unlike drawn pixels these are
+ * sent even where they match what the panel is thought to show.
+ */
+void lcd_ctx_invalidate(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if ((x >= ctx->width) || (y >= ctx->height) || w == 0 || h == 0)
+        return;
+    if (x + w > ctx->width)
+        w = ctx->width - x;
+    if (y + h > ctx->height)
+        h = ctx->height - y;
+    lcd_rect_grow(&ctx->forced, x, y, w, h);
+}
+
+/*
+ * Copy a rectangle of the shadow framebuffer to out as big-endian RGB565.
+ * Returns the bytes written.
+ */
+uint32_t lcd_ctx_stage_rect(lcd_ctx *ctx, const lcd_rect *rect, uint8_t *out)
+{
+    uint32_t n = 0;
+    int16_t x;
+    int16_t y;
+    uint16_t c;
+
+    for (y = rect->y0; y <= rect->y1; y++)
+    {
+        for (x = rect->x0; x <= rect->x1; x++)
+        {
+            c = ctx->fb[y * ctx->width + x];
+            out[n++] = c >> 8;
+            out[n++] = c & 0xFF;
+        }
+    }
+    return n;
+}
+
+/*
+ * Copy the dirty part of the shadow framebuffer into ctx->wire as
+ * big-endian RGB565 and mark it clean. Dirty is first cut down to the
+ * pixels that differ from what the panel shows, then forced is added.
+ * Returns the bytes staged.
+ */
+uint32_t lcd_ctx_stage(lcd_ctx *ctx, lcd_rect *rect)
+{
+    uint32_t n;
+    int16_t y;
+
+    *rect = ctx->dirty;
+    if (ctx->shown_valid && rect->x1 >= rect->x0)
+    {
+        lcd_ctx_diff(ctx, ctx->fb, &ctx->dirty, rect);
+        ctx->stats.skipped_pixels += lcd_rect_area(&ctx->dirty) - lcd_rect_area(rect);
+    }
+    lcd_rect_add(rect, &ctx->forced);
+    lcd_rect_clear(&ctx->dirty);
+    lcd_rect_clear(&ctx->forced);
+    if (rect->x1 < rect->x0)
+        return 0;
+
+    n = lcd_ctx_stage_rect(ctx, rect, ctx->wire);
+    for (y = rect->y0; y <= rect->y1; y++)
+        memcpy(&ctx->shown[y * ctx->width + rect->x0], &ctx->fb[y * ctx->width + rect->x0],
+               (size_t)(rect->x1 - rect->x0 + 1) * 2);
+    ctx->shown_valid = 1;
+    ctx->shown_seq++;
+    ctx->store_pending = 1;
+    if (sampler_now_us() - ctx->store_us >= (uint64_t)LCD_STORE_MS * 1000)
+        lcd_ctx_store_sync(ctx);
+    return n;
+}
+
+/*
+ * Compose the next frame without touching the panel. Until
+ * lcd_ctx_offscreen_end() drawing goes to a back frame that starts as a
+ * copy of the current one, and flushes are held.
+ */
+void lcd_ctx_offscreen_begin(lcd_ctx *ctx)
+{
+    memcpy(ctx->back, ctx->fb, sizeof(ctx->fb));
+    ctx->front_dirty = ctx->dirty;
+    lcd_rect_clear(&ctx->dirty);
+    ctx->back_ready = 0;
+    ctx->offscreen = 1;
+}
+
+/*
+ * Put the current frame back and keep the composed one for
+ * lcd_ctx_present(), along with where it differs from the panel
+ */
+void lcd_ctx_offscreen_end(lcd_ctx *ctx)
+{
+    lcd_rect all;
+    uint32_t i;
+    uint16_t t;
+
+    if (!ctx->offscreen)
+        return;
+    for (i = 0; i < (uint32_t)ctx->width * ctx->height; i++)
+    {
+        t = ctx->fb[i];
+        ctx->fb[i] = ctx->back[i];
+        ctx->back[i] = t;
+    }
+    ctx->dirty = ctx->front_dirty;
+    ctx->offscreen = 0;
+
+    all.x0 = 0;
+    all.y0 = 0;
+    all.x1 = (int16_t)(ctx->width - 1);
+    all.y1 = (int16_t)(ctx->height - 1);
+    if (ctx->shown_valid)
+        lcd_ctx_diff(ctx, ctx->back, &all, &ctx->back_delta);
+    else
+        ctx->back_delta = all;
+    ctx->back_seq = ctx->shown_seq;
+    ctx->back_ready = 1;
+}
+
+/*
+ * Make the frame composed offscreen the current one and mark for the
+ * next flush only where it differs from the panel. The delta worked out
+ * by lcd_ctx_offscreen_end() is used if nothing was staged or drawn
+ * since; otherwise the whole frame is compared again at the flush.
+ * Nothing is sent, even in immediate mode: the caller flushes it the
+ * way it flushes everything else. Returns 0, or -1 if no frame is waiting.
+ */
+int lcd_ctx_present(lcd_ctx *ctx)
+{
+    if (!ctx->back_ready || ctx->offscreen)
+        return -1;
+    memcpy(ctx->fb, ctx->back, sizeof(ctx->fb));
+    ctx->back_ready = 0;
+    if (ctx->back_seq == ctx->shown_seq && ctx->dirty.x1 < ctx->dirty.x0)
+        lcd_rect_add(&ctx->dirty, &ctx->back_delta);
+    else
+        lcd_ctx_mark(ctx, 0, 0, ctx->width, ctx->height);
+    ctx->stats.presents++;
+    return 0;
+}
+
+/*
+ * Forget a frame composed offscreen
+ */
+void lcd_ctx_offscreen_drop(lcd_ctx *ctx)
+{
+    ctx->back_ready = 0;
+}
+
+/*
+ * Send a staged rectangle as one window and burst
+ */
+void lcd_ctx_send(lcd_ctx *ctx, const lcd_rect *rect, uint32_t length)
+{
+    lcd_ctx_send_from(ctx, rect, ctx->wire, length, 0);
+}
+
+/*
+ * Send data[offset..length) of a staged rectangle. A frame resumed in the
+ * middle of a row first finishes that row in a one-row window, then sends
+ * the rows below in a second window. Returns the new offset, which is
+ * short of length if ctx->preempt stopped the burst.
+ */
+uint32_t lcd_ctx_send_from(lcd_ctx *ctx, const lcd_rect *rect, const uint8_t *data, uint32_t length, uint32_t offset)
+{
+    uint64_t t0;
+    uint32_t elapsed;
+    uint32_t end;
+    uint32_t px;
+    uint16_t w;
+    uint16_t col;
+    uint8_t y;
+
+    if (offset >= length)
+        return offset;
+
+    t0 = sampler_now_us();
+    w = rect->x1 - rect->x0 + 1;
+    while (offset < length)
+    {
+        px = offset / 2;
+        col = px % w;
+        y = (uint8_t)(rect->y0 + px / w);
+        if (col)
+        {
+            end = offset + (uint32_t)(w - col) * 2;
+            lcd_ctx_set_address_window(ctx, rect->x0 + col, y, rect->x1, y);
+        }
+        else
+        {
+            end = length;
+            lcd_ctx_set_address_window(ctx, rect->x0, y, rect->x1, rect->y1);
+        }
+        offset += i2c_ctx_burst_transfer(ctx, data + offset, end - offset);
+        if (offset < end || (offset < length && ctx->preempt && *ctx->preempt))
+            break;
+    }
+
+    elapsed = (uint32_t)(sampler_now_us() - t0);
+    ctx->stats.flush_us += elapsed;
+    if (elapsed > ctx->stats.max_flush_us)
+        ctx->stats.max_flush_us = elapsed;
+    if (offset < length)
+    {
+        ctx->stats.preemptions++;
+        return offset;
+    }
+    ctx->stats.flushes++;
+    ctx->stats.flush_pixels += length / 2;
+    ctx->stats.last_flush_us = sampler_now_us();
+    if (!ctx->stats.first_flush_us)
+        ctx->stats.first_flush_us = ctx->stats.last_flush_us;
+    return offset;
+}
+
+/*
+ * Push the dirty rectangle to the panel and return once it is sent
+ */
+void lcd_ctx_flush(lcd_ctx *ctx)
+{
+    lcd_rect r;
+    uint32_t n;
+
+    if (ctx->offscreen)
+        return;
+    if (ctx->bus_link)
+    {
+        lcd_bus_submit(ctx, 1);
+        return;
+    }
+    n = lcd_ctx_stage(ctx, &r);
+    lcd_ctx_send(ctx, &r, n);
+    if (n)
+        lcd_ctx_notify(ctx);
+}
+
+/*
+ * Like lcd_ctx_flush(), but on a shared bus return as soon as the frame
+ * is queued; drawing may continue while the bus worker sends it.
+ */
+void lcd_ctx_flush_async(lcd_ctx *ctx)
+{
+    if (ctx->offscreen)
+        return;
+    if (ctx->bus_link)
+        lcd_bus_submit(ctx, 0);
+    else
+        lcd_ctx_flush(ctx);
+}
+
+/*
+ * Like lcd_ctx_flush_async(), but on a shared bus the frame goes ahead of
+ * queued frames and cuts short the one being sent, which resumes after it.
+ */
+void lcd_ctx_flush_urgent(lcd_ctx *ctx)
+{
+    if (ctx->offscreen)
+        return;
+    if (ctx->bus_link)
+        lcd_bus_submit_urgent(ctx, 0);
+    else
+        lcd_ctx_flush(ctx);
+}
+
+/*
+ * Start a flush without ever blocking on the bus, for event loops. Returns
+ * 1 if a frame was queued (completion is signalled on lcd_ctx_event_fd()),
+ * 0 if nothing was dirty, or -1 if the previous frame is still on the wire
+ * and the caller should wait for the event first. A context that is not
+ * on a shared bus flushes synchronously and returns 1 or 0.
+ */
+int lcd_ctx_try_flush(lcd_ctx *ctx)
+{
+    if (ctx->offscreen)
+        return 0;
+    if (ctx->bus_link)
+        return lcd_bus_try_submit(ctx);
+    if (ctx->dirty.x1 < ctx->dirty.x0 && ctx->forced.x1 < ctx->forced.x0)
+        return 0;
+    lcd_ctx_flush(ctx);
+    return 1;
+}
+
+/*
+ * Whether a submitted frame has yet to reach the panel
+ */
+uint8_t lcd_ctx_busy(lcd_ctx *ctx)
+{
+    return ctx->bus_link ? lcd_bus_busy(ctx) : 0;
+}
+
+/*
+ * Nonblocking eventfd that is bumped every time a frame of ctx has been
+ * sent. Created on first use and closed with the context; -1 on failure.
+ */
+int lcd_ctx_event_fd(lcd_ctx *ctx)
+{
+    if (ctx->event_fd < 0)
+        ctx->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return ctx->event_fd;
+}
+
+void lcd_ctx_notify(lcd_ctx *ctx)
+{
+    uint64_t one = 1;
+
+    if (ctx->event_fd >= 0 && write(ctx->event_fd, &one, sizeof(one)) != sizeof(one))
+        ctx->stats.write_errors++;
+}
+
+void lcd_ctx_get_stats(lcd_ctx *ctx, lcd_stats *stats)
+{
+    pthread_mutex_lock(&ctx->lock);
+    *stats = ctx->stats;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void lcd_ctx_reset_stats(lcd_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    pthread_mutex_unlock(&ctx->lock);
+}
 
 /*
  * Set display coordinates
  */
-void lcd_set_address_window(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+void lcd_ctx_set_address_window(lcd_ctx *ctx, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
 {
     /* col address set */
-    i2c_write_command(X_COORDINATE_REG, x0 + ST7735_XSTART, x1 + ST7735_XSTART);
+    i2c_ctx_write_command(ctx, X_COORDINATE_REG, x0 + ctx->xstart, x1 + ctx->xstart);
     /* row address set */
-    i2c_write_command(Y_COORDINATE_REG, y0 + ST7735_YSTART, y1 + ST7735_YSTART);
+    i2c_ctx_write_command(ctx, Y_COORDINATE_REG, y0 + ctx->ystart, y1 + ctx->ystart);
     /* write to RAM */
-    i2c_write_command(CHAR_DATA_REG, 0x00, 0x00);
+    i2c_ctx_write_command(ctx, CHAR_DATA_REG, 0x00, 0x00);
 
-    i2c_write_command(SYNC_REG, 0x00, 0x01);
+    i2c_ctx_write_command(ctx, SYNC_REG, 0x00, 0x01);
 }
 
 /*
  * Display a single character
  */
-void lcd_write_char(uint16_t x, uint16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor)
+void lcd_ctx_write_char(lcd_ctx *ctx, uint16_t x, uint16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor)
 {
     uint32_t i, b, j;
+    uint16_t w = font.width;
+    uint16_t h = font.height;
+    uint16_t *row;
 
-    lcd_set_address_window(x, y, x + font.width - 1, y + font.height - 1);
+    if ((x >= ctx->width) || (y >= ctx->height))
+        return;
+    if (x + w > ctx->width)
+        w = ctx->width - x;
+    if (y + h > ctx->height)
+        h = ctx->height - y;
+    if (ch < 32 || ch > 126)
+        ch = '?';
 
-    for (i = 0; i < font.height; i++)
+    for (i = 0; i < h; i++)
     {
         b = font.data[(ch - 32) * font.height + i];
-        for (j = 0; j < font.width; j++)
+        row = &ctx->fb[(y + i) * ctx->width + x];
+        for (j = 0; j < w; j++)
         {
-            if ((b << j) & 0x8000)
-            {
-                i2c_write_data(color >> 8, color & 0xFF);
-            }
-            else
-            {
-                i2c_write_data(bgcolor >> 8, bgcolor & 0xFF);
-            }
+            row[j] = ((b << j) & 0x8000) ? color : bgcolor;
         }
     }
+    lcd_ctx_mark(ctx, x, y, w, h);
+    lcd_ctx_commit(ctx);
 }
 
-void lcd_write_ch(uint16_t x, uint16_t y, char ch, FontType font, uint16_t color, uint16_t bgcolor)
+void lcd_ctx_write_ch(lcd_ctx *ctx, uint16_t x, uint16_t y, char ch, FontType font, uint16_t color, uint16_t bgcolor)
 {
     switch (font)
     {
     case FontType_7x10:
-        lcd_write_char(x, y, ch, Font_7x10, color, bgcolor);
+        lcd_ctx_write_char(ctx, x, y, ch, Font_7x10, color, bgcolor);
         break;
     case FontType_8x16:
-        lcd_write_char(x, y, ch, Font_8x16, color, bgcolor);
+        lcd_ctx_write_char(ctx, x, y, ch, Font_8x16, color, bgcolor);
         break;
     case FontType_11x18:
-        lcd_write_char(x, y, ch, Font_11x18, color, bgcolor);
+        lcd_ctx_write_char(ctx, x, y, ch, Font_11x18, color, bgcolor);
         break;
     case FontType_16x26:
-        lcd_write_char(x, y, ch, Font_16x26, color, bgcolor);
+        lcd_ctx_write_char(ctx, x, y, ch, Font_16x26, color, bgcolor);
         break;
     }
 }
@@ -83,15 +711,19 @@ void lcd_write_ch(uint16_t x, uint16_t y, char ch, FontType font, uint16_t color
 /*
  * display string
  */
-void lcd_write_string(uint16_t x, uint16_t y, char *str, FontDef font, uint16_t color, uint16_t bgcolor)
+void lcd_ctx_write_string(lcd_ctx *ctx, uint16_t x, uint16_t y, const char *str, FontDef font, uint16_t color, uint16_t bgcolor)
 {
+    uint8_t deferred = ctx->deferred;
+
+    /* draw the whole string, then push it in one go */
+    ctx->deferred = 1;
     while (*str)
     {
-        if (x + font.width >= ST7735_WIDTH)
+        if (x + font.width > ctx->width)
         {
             x = 0;
             y += font.height;
-            if (y + font.height >= ST7735_HEIGHT)
+            if (y + font.height > ctx->height)
             {
                 break;
             }
@@ -104,28 +736,29 @@ void lcd_write_string(uint16_t x, uint16_t y, char *str, FontDef font, uint16_t
             }
         }
 
-        lcd_write_char(x, y, *str, font, color, bgcolor);
-        i2c_write_command(SYNC_REG, 0x00, 0x01);
+        lcd_ctx_write_char(ctx, x, y, *str, font, color, bgcolor);
         x += font.width;
         str++;
     }
+    ctx->deferred = deferred;
+    lcd_ctx_commit(ctx);
 }
 
-void lcd_write_str(uint16_t x, uint16_t y, char *str, FontType font, uint16_t color, uint16_t bgcolor)
+void lcd_ctx_write_str(lcd_ctx *ctx, uint16_t x, uint16_t y, const char *str, FontType font, uint16_t color, uint16_t bgcolor)
 {
     switch (font)
     {
     case FontType_7x10:
-        lcd_write_string(x, y, str, Font_7x10, color, bgcolor);
+        lcd_ctx_write_string(ctx, x, y, str, Font_7x10, color, bgcolor);
         break;
     case FontType_8x16:
-        lcd_write_string(x, y, str, Font_8x16, color, bgcolor);
+        lcd_ctx_write_string(ctx, x, y, str, Font_8x16, color, bgcolor);
         break;
     case FontType_11x18:
-        lcd_write_string(x, y, str, Font_11x18, color, bgcolor);
+        lcd_ctx_write_string(ctx, x, y, str, Font_11x18, color, bgcolor);
         break;
     case FontType_16x26:
-        lcd_write_string(x, y, str, Font_16x26, color, bgcolor);
+        lcd_ctx_write_string(ctx, x, y, str, Font_16x26, color, bgcolor);
         break;
     }
 }
@@ -133,259 +766,828 @@ void lcd_write_str(uint16_t x, uint16_t y, char *str, FontType font, uint16_t co
 /*
  * fill rectangle
  */
-void lcd_fill_rectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+void lcd_ctx_fill_rectangle(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
 {
-    uint8_t buff[320] = {0};
-    uint16_t count = 0;
+    uint16_t *row;
+    uint16_t i;
+    uint16_t j;
+
     /* clipping */
-    if ((x >= ST7735_WIDTH) || (y >= ST7735_HEIGHT))
+    if ((x >= ctx->width) || (y >= ctx->height) || w == 0 || h == 0)
+        return;
+    if ((x + w - 1) >= ctx->width)
+        w = ctx->width - x;
+    if ((y + h - 1) >= ctx->height)
+        h = ctx->height - y;
+
+    for (i = 0; i < h; i++)
+    {
+        row = &ctx->fb[(y + i) * ctx->width + x];
+        for (j = 0; j < w; j++)
+        {
+            row[j] = color;
+        }
+    }
+    lcd_ctx_mark(ctx, x, y, w, h);
+    lcd_ctx_commit(ctx);
+}
+
+/*
+ * Invert the colours of a rectangle; doing it twice restores it
+ */
+void lcd_ctx_invert_rectangle(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    uint16_t *row;
+    uint16_t i;
+    uint16_t j;
+
+    if ((x >= ctx->width) || (y >= ctx->height) || w == 0 || h == 0)
+        return;
+    if ((x + w - 1) >= ctx->width)
+        w = ctx->width - x;
+    if ((y + h - 1) >= ctx->height)
+        h = ctx->height - y;
+
+    for (i = 0; i < h; i++)
+    {
+        row = &ctx->fb[(y + i) * ctx->width + x];
+        for (j = 0; j < w; j++)
+        {
+            row[j] ^= 0xFFFF;
+        }
+    }
+    lcd_ctx_mark(ctx, x, y, w, h);
+    lcd_ctx_commit(ctx);
+}
+
+/*
+ * fill screen
+ */
+void lcd_ctx_fill_screen(lcd_ctx *ctx, uint16_t color)
+{
+    lcd_ctx_fill_rectangle(ctx, 0, 0, ctx->width, ctx->height, color);
+}
+
+/*
+ * Blit w x h big-endian RGB565 pixels
+ */
+void lcd_ctx_draw_image(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data)
+{
+    const uint8_t *src;
+    uint16_t *row;
+    uint16_t cw = w;
+    uint16_t ch = h;
+    uint16_t i;
+    uint16_t j;
+
+    if ((x >= ctx->width) || (y >= ctx->height) || w == 0 || h == 0)
+        return;
+    if (x + cw > ctx->width)
+        cw = ctx->width - x;
+    if (y + ch > ctx->height)
+        ch = ctx->height - y;
+
+    for (i = 0; i < ch; i++)
+    {
+        src = data + (uint32_t)i * w * 2;
+        row = &ctx->fb[(y + i) * ctx->width + x];
+        for (j = 0; j < cw; j++)
+        {
+            row[j] = (uint16_t)((src[j * 2] << 8) | src[j * 2 + 1]);
+        }
+    }
+    lcd_ctx_mark(ctx, x, y, cw, ch);
+    lcd_ctx_commit(ctx);
+}
+
+/*
+ * Blit w x h RGB565 pixels in host byte order, rows stride pixels apart
+ */
+void lcd_ctx_draw_pixels(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t *pixels, uint32_t stride)
+{
+    uint16_t cw = w;
+    uint16_t ch = h;
+    uint16_t i;
+
+    if ((x >= ctx->width) || (y >= ctx->height) || w == 0 || h == 0)
         return;
-    if ((x + w - 1) >= ST7735_WIDTH)
-        w = ST7735_WIDTH - x;
-    if ((y + h - 1) >= ST7735_HEIGHT)
-        h = ST7735_HEIGHT - y;
-    lcd_set_address_window(x, y, x + w - 1, y + h - 1);
+    if (x + cw > ctx->width)
+        cw = ctx->width - x;
+    if (y + ch > ctx->height)
+        ch = ctx->height - y;
 
-    for (count = 0; count < w; count++)
-    {
-        buff[count * 2] = color >> 8;
-        buff[count * 2 + 1] = color & 0xFF;
-    }
-    for (y = h; y > 0; y--)
+    for (i = 0; i < ch; i++)
     {
-        i2c_burst_transfer(buff, sizeof(uint16_t) * w);
+        memcpy(&ctx->fb[(y + i) * ctx->width + x], pixels + (uint32_t)i * stride, (size_t)cw * 2);
     }
+    lcd_ctx_mark(ctx, x, y, cw, ch);
+    lcd_ctx_commit(ctx);
 }
 
 /*
- * fill screen
+ * Mark an area of fb that was drawn into directly, e.g. by raster.c, and
+ * flush it unless deferred; the area must already be clipped
  */
-void lcd_fill_screen(uint16_t color)
+void lcd_ctx_touched(lcd_ctx *ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 {
-    lcd_fill_rectangle(0, 0, ST7735_WIDTH, ST7735_HEIGHT, color);
-    i2c_write_command(SYNC_REG, 0x00, 0x01);
+    lcd_ctx_mark(ctx, x, y, w, h);
+    lcd_ctx_commit(ctx);
 }
 
-void lcd_draw_image(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+void i2c_ctx_write_data(lcd_ctx *ctx, uint8_t high, uint8_t low)
 {
-    uint16_t col = h - y;
-    uint16_t row = w - x;
-    lcd_set_address_window(x, y, x + w - 1, y + h - 1);
-    i2c_burst_transfer(data, sizeof(uint16_t) * col * row);
+    uint8_t msg[3] = {WRITE_DATA_REG, high, low};
+    lcd_ctx_write(ctx, msg, 3);
+    ctx->stats.commands++;
+    usleep(ctx->write_delay_us);
 }
 
-uint8_t lcd_begin(void)
+void i2c_ctx_write_command(lcd_ctx *ctx, uint8_t command, uint8_t high, uint8_t low)
 {
-    uint8_t buffer[20] = {0};
-    char i2c[20] = "/dev/i2c-1";
-    (void)buffer; /* silence unused warning */
+    uint8_t msg[3] = {command, high, low};
+    lcd_ctx_write(ctx, msg, 3);
+    ctx->stats.commands++;
+    usleep(ctx->write_delay_us);
+}
 
-    /* I2C Init */
-    i2cd = open(i2c, O_RDWR); /* "/dev/i2c-1" */
-    if (i2cd < 0)
-    {
-        fprintf(stderr, "Device I2C-1 failed to initialize\n");
-        return 1;
-    }
-    if (ioctl(i2cd, I2C_SLAVE_FORCE, I2C_ADDRESS) < 0)
+/*
+ * Stream a buffer in burst mode. Messages are cut at chunk_bytes (kept
+ * even so a pixel never straddles two messages), and once slice_us has
+ * been spent on the bus the gap after the chunk grows to slice_gap_us.
+ * If ctx->preempt is raised the burst is closed after the current message;
+ * returns the bytes sent.
+ */
+uint32_t i2c_ctx_burst_transfer(lcd_ctx *ctx, const uint8_t *buff, uint32_t length)
+{
+    uint32_t count = 0;
+    uint32_t chunk;
+    uint32_t n;
+    uint32_t gap;
+    uint32_t slice;
+    uint64_t slice_start;
+
+    chunk = ctx->chunk_bytes & ~1u;
+    if (chunk == 0 || chunk > BURST_MAX_LENGTH)
+        chunk = BURST_MAX_LENGTH;
+
+    i2c_ctx_write_command(ctx, BURST_WRITE_REG, 0x00, 0x01);
+    slice_start = sampler_now_us();
+    while (length > count)
     {
-        return 1;
+        n = length - count;
+        if (n > chunk)
+            n = chunk;
+        lcd_ctx_write(ctx, buff + count, n);
+        count += n;
+        ctx->stats.chunks++;
+        if (ctx->preempt && *ctx->preempt && length > count)
+            break;
+
+        gap = ctx->chunk_delay_us;
+        slice = (uint32_t)(sampler_now_us() - slice_start);
+        if (ctx->slice_us && slice >= ctx->slice_us && length > count)
+        {
+            if (ctx->slice_gap_us > gap)
+                gap = ctx->slice_gap_us;
+            ctx->stats.slices++;
+            if (slice > ctx->stats.max_slice_us)
+                ctx->stats.max_slice_us = slice;
+            usleep(gap);
+            slice_start = sampler_now_us();
+            continue;
+        }
+        usleep(gap);
     }
+    slice = (uint32_t)(sampler_now_us() - slice_start);
+    if (slice > ctx->stats.max_slice_us)
+        ctx->stats.max_slice_us = slice;
+    i2c_ctx_write_command(ctx, BURST_WRITE_REG, 0x00, 0x00);
+    i2c_ctx_write_command(ctx, SYNC_REG, 0x00, 0x01);
+    ctx->stats.bursts++;
+    return count;
+}
+
+/*
+ * The CPU page's first line, "hostname ip". Finding the address can wait
+ * on the network, so a daemon samples it in the background instead: once
+ * lcd_header_register() has been called the page draws the latest sample,
+ * or the bare hostname (marking the page partial) until there is one.
+ */
+static int header_collector = -1;
+
+static int header_collect(void *arg, void *buf, size_t len)
+{
+    char *line = get_ip_address_new();
+
+    (void)arg;
+    if (!line)
+        return -1;
+    snprintf((char *)buf, len, "%s", line);
+    free(line);
     return 0;
 }
 
-void i2c_write_data(uint8_t high, uint8_t low)
+int lcd_header_register(void)
 {
-    uint8_t msg[3] = {WRITE_DATA_REG, high, low};
-    write(i2cd, msg, 3);
-    usleep(10);
+    if (header_collector < 0)
+        header_collector = sampler_register("header", header_collect, NULL, TEXT_LAYOUT_MAX_LEN,
+                                            LCD_HEADER_INTERVAL_MS, 0);
+    return header_collector;
 }
 
-void i2c_write_command(uint8_t command, uint8_t high, uint8_t low)
+/*
+ * Whether the sampled header is in
+ */
+uint8_t lcd_header_ready(void)
 {
-    uint8_t msg[3] = {command, high, low};
-    write(i2cd, msg, 3);
-    usleep(10);
+    char line[TEXT_LAYOUT_MAX_LEN];
+
+    return header_collector >= 0 && sampler_read(header_collector, line, sizeof(line), NULL) > 0;
 }
 
-void i2c_burst_transfer(uint8_t *buff, uint32_t length)
+/* Returns 0 if out holds a placeholder */
+static int lcd_header_text(char *out, size_t len)
 {
-    uint32_t count = 0;
-    i2c_write_command(BURST_WRITE_REG, 0x00, 0x01);
-    while (length > count)
+    char *line;
+
+    if (header_collector >= 0)
     {
-        if ((length - count) > BURST_MAX_LENGTH)
-        {
-            write(i2cd, buff + count, BURST_MAX_LENGTH);
-            count += BURST_MAX_LENGTH;
-        }
-        else
+        if (sampler_read(header_collector, out, len, NULL) > 0)
         {
-            write(i2cd, buff + count, length - count);
-            count += (length - count);
+            out[len - 1] = '\0';
+            return 1;
         }
-        usleep(700);
+        get_hostname(out, len);
+        return 0;
     }
-    i2c_write_command(BURST_WRITE_REG, 0x00, 0x00);
-    i2c_write_command(SYNC_REG, 0x00, 0x01);
+
+    line = get_ip_address_new(); /* malloc'd */
+    snprintf(out, len, "%s", line ? line : CUSTOM_DISPLAY);
+    free(line);
+    return 1;
 }
 
-void lcd_display(uint8_t symbol)
+/*
+ * Draw a stock page and push it with a single flush
+ */
+void lcd_ctx_display(lcd_ctx *ctx, uint8_t symbol)
 {
+    uint8_t deferred = ctx->deferred;
+
+    ctx->deferred = 1;
     switch (symbol)
     {
     case 0:
-        lcd_display_cpuLoad();
+        lcd_ctx_display_cpuLoad(ctx);
         break;
     case 1:
-        lcd_display_ram();
+        lcd_ctx_display_ram(ctx);
         break;
     case 2:
-        lcd_display_temp();
+        lcd_ctx_display_temp(ctx);
         break;
     case 3:
-        lcd_display_disk();
+        lcd_ctx_display_disk(ctx);
+        break;
+    case 4:
+        lcd_ctx_display_quantiles(ctx);
+        break;
+    case 5:
+        lcd_ctx_display_alerts(ctx);
+        break;
+    case 6:
+        lcd_ctx_display_gauges(ctx);
         break;
     default:
         break;
     }
+    ctx->deferred = deferred;
+    lcd_ctx_commit(ctx);
 }
 
-void lcd_display_percentage(uint8_t val, uint16_t color)
+/* Segments of the bar lit for val percent */
+static uint8_t bar_level(uint8_t val)
+{
+    unsigned level = val + 10u;
+
+    if (level >= 100)
+    {
+        level = 100;
+    }
+    return (uint8_t)(level / 10);
+}
+
+/*
+ * The stock pages' bar with level of its ten segments lit. A fractional
+ * level lights the last one part way, for the frames of an animation.
+ */
+static void lcd_ctx_display_bar(lcd_ctx *ctx, float level, uint16_t color)
 {
     uint8_t count = 0;
     uint8_t xCoordinate = 30;
-    val += 10;
-    if (val >= 100)
+    uint8_t deferred = ctx->deferred;
+    uint16_t part;
+
+    ctx->deferred = 1;
+    for (count = 0; count < 10; count++)
     {
-        val = 100;
+        part = level >= count + 1 ? 6 : (level > count ? (uint16_t)((level - count) * 6.f + 0.5f) : 0);
+        if (part > 0)
+            lcd_ctx_fill_rectangle(ctx, xCoordinate, 60, part, 10, color);
+        if (part < 6)
+            lcd_ctx_fill_rectangle(ctx, (uint16_t)(xCoordinate + part), 60, (uint16_t)(6 - part), 10, ST7735_GRAY);
+        xCoordinate += 10;
     }
-    val /= 10;
-    for (count = 0; count < val; count++)
+    ctx->deferred = deferred;
+    lcd_ctx_commit(ctx);
+}
+
+void lcd_ctx_display_percentage(lcd_ctx *ctx, uint8_t val, uint16_t color)
+{
+    lcd_ctx_display_bar(ctx, bar_level(val), color);
+}
+
+/*
+ * A stock page's bar for series, moving to val rather than jumping when it
+ * differs from what the page showed last
+ */
+static void lcd_ctx_display_series_bar(lcd_ctx *ctx, int series, uint8_t val, uint16_t color)
+{
+    lcd_ctx_display_bar(ctx, lcd_ctx_animate(ctx, LCD_ANIM_KEY(LCD_ANIM_BAR, series), bar_level(val)), color);
+}
+
+static float read_temperature(void)
+{
+    return (float)get_temperature();
+}
+
+/*
+ * The newest sample of a stock series, which the page scheduler has the
+ * collectors take just before the page is due; read directly when
+ * nothing collects the series, e.g. through the legacy API
+ */
+static float page_value(int series, float (*read)(void))
+{
+    float value;
+
+    if (history_recent(series, &value, 1) == 1)
+        return value;
+    return read();
+}
+
+/* A page's bar colour, overridden while an alert rule on its series fires */
+static uint16_t alert_color(int series, uint16_t color)
+{
+    switch (rules_level(series))
     {
-        lcd_fill_rectangle(xCoordinate, 60, 6, 10, color);
-        xCoordinate += 10;
+    case RULE_CRIT:
+        return ST7735_RED;
+    case RULE_WARN:
+        return ST7735_ORANGE;
+    default:
+        return color;
     }
-    for (count = 0; count < 10 - val; count++)
+}
+
+/*
+ * One line of history between the separator and the reading, e.g.
+ * "24h avg 12%" or with peak set "1h max 61C", once the history store has
+ * samples for the series
+ */
+static void lcd_ctx_display_trend(lcd_ctx *ctx, int series, uint32_t window_s, uint8_t peak,
+                                  const char *label, const char *unit)
+{
+    char line[TEXT_LAYOUT_MAX_LEN];
+    HistoryStat st;
+    float value;
+    size_t width;
+
+    lcd_ctx_fill_rectangle(ctx, 0, 25, ctx->width, 10, ST7735_BLACK);
+    if (history_query(series, window_s, &st) != 0)
+        return;
+    value = peak ? st.max : st.avg;
+    snprintf(line, sizeof(line), "%s %d%s", label, (int)(value + 0.5f), unit);
+    width = strlen(line) * Font_7x10.width;
+    lcd_ctx_write_string(ctx, width < ctx->width ? (uint16_t)((ctx->width - width) / 2) : 0, 25,
+                         line, Font_7x10, ST7735_GRAY, ST7735_BLACK);
+}
+
+/*
+ * Draw the header line, from the strip rasterized last time if it is the
+ * same line
+ */
+static void lcd_ctx_draw_header(lcd_ctx *ctx, const char *line)
+{
+    uint16_t y;
+
+    if (ctx->header_width == ctx->width && strcmp(ctx->header_text, line) == 0)
     {
-        lcd_fill_rectangle(xCoordinate, 60, 6, 10, ST7735_GRAY);
-        xCoordinate += 10;
+        lcd_ctx_draw_pixels(ctx, 0, 0, ctx->width, LCD_HEADER_H, ctx->header_strip, ctx->width);
+        return;
     }
+
+    /* Largest font that fits above the separator; ellipsis if even 7x10 is too wide */
+    lcd_ctx_fill_rectangle(ctx, 0, 0, ctx->width, LCD_HEADER_H, ST7735_BLACK);
+    text_ctx_draw(ctx, text_ctx_layout(ctx, line, 0, 0, ctx->width, LCD_HEADER_H, TextOverflow_Ellipsis),
+                  ST7735_WHITE, ST7735_BLACK);
+    for (y = 0; y < LCD_HEADER_H && y < ctx->height; y++)
+        memcpy(&ctx->header_strip[y * ctx->width], &ctx->fb[y * ctx->width], (size_t)ctx->width * 2);
+    snprintf(ctx->header_text, sizeof(ctx->header_text), "%s", line);
+    ctx->header_width = ctx->width;
 }
 
-void lcd_display_cpuLoad(void)
+void lcd_ctx_display_cpuLoad(lcd_ctx *ctx)
 {
-    /* widen buffer a bit; fits "hostname ip" comfortably */
-    char iPSource[32] = {0};
+    char iPSource[TEXT_LAYOUT_MAX_LEN] = {0};
     uint8_t cpuLoad = 0;
     char cpuStr[10] = {0};
-    char *line;
 
-    lcd_fill_screen(ST7735_BLACK);
-    cpuLoad = get_cpu_message();
+    lcd_ctx_fill_screen(ctx, ST7735_BLACK);
+    cpuLoad = (uint8_t)(page_value(HISTORY_CPU, get_cpu_usage) + 0.5f);
     sprintf(cpuStr, "%d", cpuLoad);
 
     /* Top separator line */
-    lcd_fill_rectangle(0, 20, ST7735_WIDTH, 5, ST7735_BLUE);
+    lcd_ctx_fill_rectangle(ctx, 0, 20, ctx->width, 5, ST7735_BLUE);
 
     /* First line: NO "IP:" label — use the formatted string from rpiInfo.c */
-    line = get_ip_address_new(); /* malloc'd */
-    if (line != NULL)
-    {
-        size_t n = strlen(line);
-        if (n >= sizeof(iPSource)) n = sizeof(iPSource) - 1;
-        memcpy(iPSource, line, n);
-        iPSource[n] = '\0';
-        free(line);
-    }
-    else
-    {
-        strncpy(iPSource, CUSTOM_DISPLAY, sizeof(iPSource) - 1);
-        iPSource[sizeof(iPSource) - 1] = '\0';
-    }
-    lcd_write_string(0, 0, iPSource, Font_8x16, ST7735_WHITE, ST7735_BLACK);
+    if (!lcd_header_text(iPSource, sizeof(iPSource)))
+        ctx->partial = 1;
+    lcd_ctx_draw_header(ctx, iPSource);
 
     /* CPU line */
-    lcd_write_string(36, 35, "CPU:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(80, 35, cpuStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(113, 35, "%",   Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_display_percentage(cpuLoad, ST7735_GREEN);
+    lcd_ctx_write_string(ctx, 36, 35, "CPU:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 80, 35, cpuStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 113, 35, "%",   Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_display_trend(ctx, HISTORY_CPU, 24 * 3600, 0, "24h avg", "%");
+    lcd_ctx_display_series_bar(ctx, HISTORY_CPU, cpuLoad, alert_color(HISTORY_CPU, ST7735_GREEN));
 }
 
-void lcd_display_ram(void)
+/*
+ * The CPU page's reading and bar for the live meter. Only those cells are
+ * drawn, so a flush sends what changed in them and nothing else.
+ */
+void lcd_ctx_display_cpu_live(lcd_ctx *ctx, float cpu)
+{
+    char cpuStr[10] = {0};
+    uint8_t deferred = ctx->deferred;
+    float level;
+
+    if (cpu < 0.f)
+        cpu = 0.f;
+    else if (cpu > 100.f)
+        cpu = 100.f;
+    /* padded, so a shorter reading clears the digits of a longer one */
+    snprintf(cpuStr, sizeof(cpuStr), "%-3d", (int)(cpu + 0.5f));
+    level = (cpu + 10.f) / 10.f;
+
+    ctx->deferred = 1;
+    lcd_ctx_write_string(ctx, 80, 35, cpuStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_display_bar(ctx, level > 10.f ? 10.f : level, alert_color(HISTORY_CPU, ST7735_GREEN));
+    ctx->deferred = deferred;
+    lcd_ctx_commit(ctx);
+}
+
+void lcd_ctx_display_ram(lcd_ctx *ctx)
 {
-    float Totalram = 0.0f;
-    float freeram = 0.0f;
     uint8_t residue = 0;
     char residueStr[10] = {0};
 
-    get_cpu_memory(&Totalram, &freeram);
-    residue = (uint8_t)((Totalram - freeram) / Totalram * 100.0f);
+    residue = (uint8_t)page_value(HISTORY_RAM, get_ram_usage);
     sprintf(residueStr, "%d", residue);
 
-    lcd_fill_rectangle(0, 35, ST7735_WIDTH, 20, ST7735_BLACK);
-    lcd_write_string(36, 35, "RAM:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(80, 35, residueStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(113, 35, "%",      Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_display_percentage(residue, ST7735_YELLOW);
+    lcd_ctx_fill_rectangle(ctx, 0, 35, ctx->width, 20, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 36, 35, "RAM:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 80, 35, residueStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 113, 35, "%",      Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_display_trend(ctx, HISTORY_RAM, 3600, 1, "1h max", "%");
+    lcd_ctx_display_series_bar(ctx, HISTORY_RAM, residue, alert_color(HISTORY_RAM, ST7735_YELLOW));
 }
 
-void lcd_display_temp(void)
+void lcd_ctx_display_temp(lcd_ctx *ctx)
 {
     uint16_t temp;
     char tempStr[10] = {0};
 
-    temp = get_temperature();
+    temp = (uint16_t)(page_value(HISTORY_TEMP, read_temperature) + 0.5f);
     sprintf(tempStr, "%d", temp);
 
-    lcd_fill_rectangle(0, 35, ST7735_WIDTH, 20, ST7735_BLACK);
-    lcd_write_string(30, 35, "TEMP:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(85, 35, tempStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_fill_rectangle(ctx, 0, 35, ctx->width, 20, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 30, 35, "TEMP:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 85, 35, tempStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
     if (TEMPERATURE_TYPE == FAHRENHEIT)
     {
-        lcd_write_string(118, 35, "F", Font_11x18, ST7735_WHITE, ST7735_BLACK);
+        lcd_ctx_write_string(ctx, 118, 35, "F", Font_11x18, ST7735_WHITE, ST7735_BLACK);
     }
     else
     {
-        lcd_write_string(118, 35, "C", Font_11x18, ST7735_WHITE, ST7735_BLACK);
+        lcd_ctx_write_string(ctx, 118, 35, "C", Font_11x18, ST7735_WHITE, ST7735_BLACK);
     }
+    lcd_ctx_display_trend(ctx, HISTORY_TEMP, 3600, 1, "1h max", TEMPERATURE_TYPE == FAHRENHEIT ? "F" : "C");
 
     if (TEMPERATURE_TYPE == FAHRENHEIT)
     {
         /* Not strictly needed for bar %, but keep prior behavior */
         temp = (uint16_t)((temp - 32) / 1.8);
     }
-    lcd_display_percentage((uint8_t)temp, ST7735_RED);
+    lcd_ctx_display_series_bar(ctx, HISTORY_TEMP, (uint8_t)temp, alert_color(HISTORY_TEMP, ST7735_RED));
 }
 
-void lcd_display_disk(void)
+void lcd_ctx_display_disk(lcd_ctx *ctx)
 {
-    uint16_t diskMemSize = 0;
-    uint16_t diskUseMemSize = 0;
-    uint32_t sdMemSize = 0;
-    uint32_t sdUseMemSize = 0;
-
-    uint16_t memTotal = 0;
-    uint16_t useMemTotal = 0;
     uint8_t residue = 0;
     char residueStr[10] = {0};
 
-    get_sd_memory(&sdMemSize, &sdUseMemSize);
-    get_hard_disk_memory(&diskMemSize, &diskUseMemSize);
+    residue = (uint8_t)page_value(HISTORY_DISK, get_disk_usage);
+    sprintf(residueStr, "%d", residue);
+
+    lcd_ctx_fill_rectangle(ctx, 0, 35, ctx->width, 20, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 30, 35, "DISK:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 85, 35, residueStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_write_string(ctx, 118, 35, "%",      Font_11x18, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_display_trend(ctx, HISTORY_DISK, 24 * 3600, 1, "24h max", "%");
+    lcd_ctx_display_series_bar(ctx, HISTORY_DISK, residue, alert_color(HISTORY_DISK, ST7735_BLUE));
+}
+
+/* A quantile for the p95/p99 page: one decimal below 10, "--" without samples */
+static void quantile_text(char *out, size_t len, int found, float value)
+{
+    if (!found)
+        snprintf(out, len, "--");
+    else if (value < 9.95f)
+        snprintf(out, len, "%.1f", value);
+    else
+        snprintf(out, len, "%d", (int)(value + 0.5f));
+}
+
+/*
+ * p95 and p99 over the last HISTORY_QUANTILE_S of CPU, temperature, disk
+ * I/O latency and network rate, from the history store's sketches
+ */
+void lcd_ctx_display_quantiles(lcd_ctx *ctx)
+{
+    static const int series[] = {HISTORY_CPU, HISTORY_TEMP, HISTORY_IOLAT, HISTORY_NET};
+    static const char *const labels[] = {"CPU", "TEMP", "IO", "NET"};
+    char line[TEXT_LAYOUT_MAX_LEN];
+    char p95_text[12];
+    char p99_text[12];
+    const char *unit;
+    float p95 = 0.f;
+    float p99 = 0.f;
+    int has95;
+    int has99;
+    int i;
+
+    lcd_ctx_fill_screen(ctx, ST7735_BLACK);
+    snprintf(p95_text, sizeof(p95_text), "%umin", HISTORY_QUANTILE_S / 60);
+    snprintf(line, sizeof(line), "%-5s%6s%6s", p95_text, "p95", "p99");
+    lcd_ctx_write_string(ctx, 4, 6, line, Font_7x10, ST7735_WHITE, ST7735_BLACK);
+    lcd_ctx_fill_rectangle(ctx, 0, 20, ctx->width, 5, ST7735_BLUE);
+
+    for (i = 0; i < 4; i++)
+    {
+        has95 = history_quantile(series[i], 0.95f, &p95) == 0;
+        has99 = history_quantile(series[i], 0.99f, &p99) == 0;
+        switch (series[i])
+        {
+        case HISTORY_CPU:
+            unit = "%";
+            break;
+        case HISTORY_TEMP:
+            unit = TEMPERATURE_TYPE == FAHRENHEIT ? "F" : "C";
+            break;
+        case HISTORY_IOLAT:
+            unit = "ms";
+            break;
+        default:
+            unit = "KB/s";
+            if (has99 && p99 >= 1024.f)
+            {
+                p95 /= 1024.f;
+                p99 /= 1024.f;
+                unit = "MB/s";
+            }
+            break;
+        }
+        quantile_text(p95_text, sizeof(p95_text), has95, p95);
+        quantile_text(p99_text, sizeof(p99_text), has99, p99);
+        snprintf(line, sizeof(line), "%-5s%6s%6s %s", labels[i], p95_text, p99_text, unit);
+        lcd_ctx_write_string(ctx, 4, (uint16_t)(28 + 13 * i), line, Font_7x10, ST7735_WHITE, ST7735_BLACK);
+    }
+}
 
-    memTotal = (uint16_t)(sdMemSize + diskMemSize);
-    useMemTotal = (uint16_t)(sdUseMemSize + diskUseMemSize);
+/*
+ * A round gauge: a dim track, the reading's share of full scale as an arc
+ * in colour with a needle at its end, and the label under the opening
+ */
+static void lcd_ctx_draw_gauge(lcd_ctx *ctx, int16_t cx, int16_t cy, float fraction, uint16_t color,
+                               const char *label)
+{
+    int16_t angle;
+    int16_t x;
+    int16_t y;
+    uint16_t w;
+
+    if (fraction < 0.f)
+        fraction = 0.f;
+    else if (fraction > 1.f)
+        fraction = 1.f;
+    angle = (int16_t)(LCD_GAUGE_START + fraction * LCD_GAUGE_SWEEP + 0.5f);
+
+    lcd_ctx_draw_arc(ctx, cx, cy, LCD_GAUGE_R, LCD_GAUGE_W, LCD_GAUGE_START, LCD_GAUGE_SWEEP,
+                     ST7735_DARKGRAY, LCD_RASTER_AA);
+    lcd_ctx_draw_arc(ctx, cx, cy, LCD_GAUGE_R, LCD_GAUGE_W, LCD_GAUGE_START, (int16_t)(angle - LCD_GAUGE_START),
+                     color, LCD_RASTER_AA);
+    lcd_ctx_point_on_circle(cx, cy, LCD_GAUGE_R - LCD_GAUGE_W - 3, angle, &x, &y);
+    lcd_ctx_draw_line(ctx, cx, cy, x, y, 2, ST7735_WHITE, LCD_RASTER_AA);
+    lcd_ctx_fill_circle(ctx, cx, cy, 3, ST7735_WHITE, LCD_RASTER_AA);
+
+    w = text_measure(label, &Font_7x10);
+    lcd_ctx_write_string(ctx, w < 2 * cx ? (uint16_t)(cx - w / 2) : 0, (uint16_t)(cy + LCD_GAUGE_R - 2),
+                         label, Font_7x10, ST7735_WHITE, ST7735_BLACK);
+}
+
+/*
+ * Temperature and CPU load as two round gauges
+ */
+void lcd_ctx_display_gauges(lcd_ctx *ctx)
+{
+    char label[16];
+    float temp;
+    float cpu;
+    float scale;
+
+    temp = page_value(HISTORY_TEMP, read_temperature);
+    cpu = page_value(HISTORY_CPU, get_cpu_usage);
 
-    if (memTotal > 0)
-        residue = (uint8_t)(useMemTotal * 1.0 / memTotal * 100.0);
+    lcd_ctx_fill_screen(ctx, ST7735_BLACK);
+    if (TEMPERATURE_TYPE == FAHRENHEIT)
+    {
+        scale = (temp - 32.f) / 180.f;
+        snprintf(label, sizeof(label), "TEMP %dF", (int)(temp + 0.5f));
+    }
     else
-        residue = 0;
+    {
+        scale = temp / 100.f;
+        snprintf(label, sizeof(label), "TEMP %dC", (int)(temp + 0.5f));
+    }
+    scale = lcd_ctx_animate(ctx, LCD_ANIM_KEY(LCD_ANIM_GAUGE, HISTORY_TEMP), scale);
+    lcd_ctx_draw_gauge(ctx, (int16_t)(ctx->width / 4), LCD_GAUGE_Y, scale,
+                       alert_color(HISTORY_TEMP, ST7735_RED), label);
+    snprintf(label, sizeof(label), "CPU %d%%", (int)(cpu + 0.5f));
+    scale = lcd_ctx_animate(ctx, LCD_ANIM_KEY(LCD_ANIM_GAUGE, HISTORY_CPU), cpu / 100.f);
+    lcd_ctx_draw_gauge(ctx, (int16_t)(ctx->width * 3 / 4), LCD_GAUGE_Y, scale,
+                       alert_color(HISTORY_CPU, ST7735_GREEN), label);
+}
 
-    sprintf(residueStr, "%d", residue);
+/*
+ * The rules firing now, one per line with the value that tripped them,
+ * under a band in the colour of the worst one
+ */
+void lcd_ctx_display_alerts(lcd_ctx *ctx)
+{
+    char line[TEXT_LAYOUT_MAX_LEN];
+    char value[16];
+    RuleStatus st;
+    uint8_t level;
+    uint16_t y = 24;
+    int cols = ctx->width / Font_7x10.width;
+    int room;
+    int firing;
+    int i;
+
+    lcd_ctx_fill_screen(ctx, ST7735_BLACK);
+    firing = rules_firing();
+    if (firing == 0)
+    {
+        lcd_ctx_fill_rectangle(ctx, 0, 20, ctx->width, 5, ST7735_BLUE);
+        lcd_ctx_write_string(ctx, (uint16_t)((ctx->width - 9 * Font_11x18.width) / 2), 40, "No alerts",
+                             Font_11x18, ST7735_GREEN, ST7735_BLACK);
+        return;
+    }
+
+    level = rules_level(-1);
+    lcd_ctx_fill_rectangle(ctx, 0, 0, ctx->width, 20, level == RULE_CRIT ? ST7735_RED : ST7735_ORANGE);
+    snprintf(line, sizeof(line), "%d ALERT%s", firing, firing > 1 ? "S" : "");
+    lcd_ctx_write_string(ctx, 4, 1, line, Font_11x18, ST7735_WHITE,
+                         level == RULE_CRIT ? ST7735_RED : ST7735_ORANGE);
+
+    for (i = 0; i < rules_count() && y + Font_7x10.height <= ctx->height; i++)
+    {
+        if (rules_status(i, &st) != 0 || !st.firing)
+            continue;
+        snprintf(value, sizeof(value), st.value < 9.95f && st.value > -9.95f ? " %.1f" : " %.0f", st.value);
+        room = cols - (int)strlen(value);
+        snprintf(line, sizeof(line), "%.*s%s", room > 0 ? room : 0, st.expr, value);
+        lcd_ctx_write_string(ctx, 0, y, line, Font_7x10,
+                             st.level == RULE_CRIT ? ST7735_RED : ST7735_ORANGE, ST7735_BLACK);
+        y += Font_7x10.height + 1;
+    }
+}
+
+/*
+ * Legacy API: thin wrappers over the default context
+ */
+uint8_t lcd_begin(void)
+{
+    return lcd_ctx_begin(lcd_default_ctx());
+}
+
+void lcd_set_address_window(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+{
+    lcd_ctx_set_address_window(lcd_default_ctx(), x0, y0, x1, y1);
+}
+
+void lcd_write_char(uint16_t x, uint16_t y, char ch, FontDef font, uint16_t color, uint16_t bgcolor)
+{
+    lcd_ctx_write_char(lcd_default_ctx(), x, y, ch, font, color, bgcolor);
+}
+
+void lcd_write_ch(uint16_t x, uint16_t y, char ch, FontType font, uint16_t color, uint16_t bgcolor)
+{
+    lcd_ctx_write_ch(lcd_default_ctx(), x, y, ch, font, color, bgcolor);
+}
+
+void lcd_write_string(uint16_t x, uint16_t y, char *str, FontDef font, uint16_t color, uint16_t bgcolor)
+{
+    lcd_ctx_write_string(lcd_default_ctx(), x, y, str, font, color, bgcolor);
+}
+
+void lcd_write_str(uint16_t x, uint16_t y, char *str, FontType font, uint16_t color, uint16_t bgcolor)
+{
+    lcd_ctx_write_str(lcd_default_ctx(), x, y, str, font, color, bgcolor);
+}
+
+void lcd_fill_rectangle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+    lcd_ctx_fill_rectangle(lcd_default_ctx(), x, y, w, h, color);
+}
+
+void lcd_fill_screen(uint16_t color)
+{
+    lcd_ctx_fill_screen(lcd_default_ctx(), color);
+}
+
+void lcd_draw_image(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    lcd_ctx_draw_image(lcd_default_ctx(), x, y, w, h, data);
+}
+
+void i2c_write_data(uint8_t high, uint8_t low)
+{
+    i2c_ctx_write_data(lcd_default_ctx(), high, low);
+}
+
+void i2c_write_command(uint8_t command, uint8_t high, uint8_t low)
+{
+    i2c_ctx_write_command(lcd_default_ctx(), command, high, low);
+}
+
+void i2c_burst_transfer(uint8_t *buff, uint32_t length)
+{
+    i2c_ctx_burst_transfer(lcd_default_ctx(), buff, length);
+}
+
+void lcd_display(uint8_t symbol)
+{
+    lcd_ctx_display(lcd_default_ctx(), symbol);
+}
+
+void lcd_display_percentage(uint8_t val, uint16_t color)
+{
+    lcd_ctx_display_percentage(lcd_default_ctx(), val, color);
+}
+
+void lcd_display_cpuLoad(void)
+{
+    lcd_ctx_display_cpuLoad(lcd_default_ctx());
+}
+
+void lcd_display_ram(void)
+{
+    lcd_ctx_display_ram(lcd_default_ctx());
+}
+
+void lcd_display_temp(void)
+{
+    lcd_ctx_display_temp(lcd_default_ctx());
+}
+
+void lcd_display_disk(void)
+{
+    lcd_ctx_display_disk(lcd_default_ctx());
+}
+
+void lcd_display_quantiles(void)
+{
+    lcd_ctx_display_quantiles(lcd_default_ctx());
+}
 
-    lcd_fill_rectangle(0, 35, ST7735_WIDTH, 20, ST7735_BLACK);
-    lcd_write_string(30, 35, "DISK:", Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(85, 35, residueStr, Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_write_string(118, 35, "%",      Font_11x18, ST7735_WHITE, ST7735_BLACK);
-    lcd_display_percentage(residue, ST7735_BLUE);
+void lcd_display_alerts(void)
+{
+    lcd_ctx_display_alerts(lcd_default_ctx());
+}
+
+void lcd_display_gauges(void)
+{
+    lcd_ctx_display_gauges(lcd_default_ctx());
 }
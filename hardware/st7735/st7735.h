@@ -116,6 +116,8 @@
 #define ST7735_YELLOW 0xFFE0
 #define ST7735_WHITE 0xFFFF
 #define ST7735_GRAY 0x8410
+#define ST7735_ORANGE 0xFD20
+#define ST7735_DARKGRAY 0x3186
 #define ST7735_COLOR565(r, g, b)                                               \
   (((r & 0xF8) << 8) | ((g & 0xFC) << 3) | ((b & 0xF8) >> 3))
 
@@ -148,6 +150,9 @@ extern void lcd_display_cpuLoad(void);
 extern void lcd_display_ram(void);
 extern void lcd_display_temp(void);
 extern void lcd_display_disk(void);
+extern void lcd_display_quantiles(void);
+extern void lcd_display_alerts(void);
+extern void lcd_display_gauges(void);
 extern void lcd_display_percentage(uint8_t val, uint16_t color);
 #ifdef __cplusplus
 }
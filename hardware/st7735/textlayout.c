@@ -0,0 +1,206 @@
+/* vim: set ai et ts=4 sw=4: */
+#include "textlayout.h"
+#include "lcd_ctx.h"
+#include <string.h>
+
+/* Loaded fonts, largest first; the fonts are monospaced */
+static const FontDef *text_fonts[] = {&Font_16x26, &Font_11x18, &Font_8x16, &Font_7x10};
+#define TEXT_FONT_COUNT (sizeof(text_fonts) / sizeof(text_fonts[0]))
+
+/*
+ * Width in pixels of str drawn on a single line
+ */
+uint16_t text_measure(const char *str, const FontDef *font)
+{
+    size_t n;
+
+    if (!str || !font)
+        return 0;
+    n = strlen(str);
+    if (n > 0xFFFF / font->width)
+        return 0xFFFF;
+    return (uint16_t)(n * font->width);
+}
+
+/*
+ * Largest loaded font in which str fits a w x h box, or NULL if none does
+ */
+const FontDef *text_pick_font(const char *str, uint16_t w, uint16_t h)
+{
+    uint32_t i;
+
+    for (i = 0; i < TEXT_FONT_COUNT; i++)
+    {
+        if (text_fonts[i]->height > h)
+            continue;
+        if (text_measure(str, text_fonts[i]) <= w)
+            return text_fonts[i];
+    }
+    return NULL;
+}
+
+/*
+ * Smallest font that still fits the box height; used for the overflow fallback
+ */
+static const FontDef *text_fallback_font(uint16_t h)
+{
+    uint32_t i;
+
+    for (i = TEXT_FONT_COUNT; i > 0; i--)
+    {
+        if (text_fonts[i - 1]->height <= h)
+            return text_fonts[i - 1];
+    }
+    return NULL;
+}
+
+/*
+ * Layout of str in the given box. Layouts are cached per (string, box) in
+ * the context, so callers may call this on every draw and only pay for
+ * measuring when the string actually changes. The returned entry stays
+ * valid until it is recycled by TEXT_LAYOUT_CACHE_SIZE newer layouts.
+ */
+TextLayout *text_ctx_layout(lcd_ctx *ctx, const char *str, uint16_t x, uint16_t y, uint16_t w, uint16_t h, TextOverflow overflow)
+{
+    TextCache *cache = &ctx->text;
+    TextLayout *entry = NULL;
+    TextLayout *victim = &cache->entries[0];
+    uint32_t i;
+    size_t n;
+
+    if (!str)
+        return NULL;
+    n = strlen(str);
+    if (n >= TEXT_LAYOUT_MAX_LEN)
+        n = TEXT_LAYOUT_MAX_LEN - 1;
+
+    cache->clock++;
+    for (i = 0; i < TEXT_LAYOUT_CACHE_SIZE; i++)
+    {
+        entry = &cache->entries[i];
+        if (entry->stamp != 0 && entry->x == x && entry->y == y && entry->w == w && entry->h == h &&
+            entry->overflow == overflow && entry->len == n && strncmp(entry->text, str, n) == 0)
+        {
+            entry->stamp = cache->clock;
+            return entry;
+        }
+        if (entry->stamp < victim->stamp)
+            victim = entry;
+    }
+
+    entry = victim;
+    memcpy(entry->text, str, n);
+    entry->text[n] = '\0';
+    entry->x = x;
+    entry->y = y;
+    entry->w = w;
+    entry->h = h;
+    entry->overflow = overflow;
+    entry->len = (uint16_t)n;
+    entry->offset = 0;
+    entry->stamp = cache->clock;
+
+    entry->font = text_pick_font(entry->text, w, h);
+    entry->fits = (entry->font != NULL);
+    if (!entry->fits)
+        entry->font = text_fallback_font(h);
+    if (entry->font)
+    {
+        entry->width = text_measure(entry->text, entry->font);
+        entry->visible = w / entry->font->width;
+    }
+    else
+    {
+        entry->width = 0;
+        entry->visible = 0;
+    }
+    return entry;
+}
+
+/*
+ * Draw a layout, then clear the rest of the box row so a shorter string
+ * does not leave the tail of the previous one behind. Each call on a
+ * marquee layout advances it by one character.
+ */
+void text_ctx_draw(lcd_ctx *ctx, TextLayout *layout, uint16_t color, uint16_t bgcolor)
+{
+    char cells[TEXT_LAYOUT_MAX_LEN];
+    const FontDef *font;
+    uint16_t n = 0;
+    uint16_t keep;
+    uint16_t period;
+    uint16_t i;
+    uint8_t deferred;
+
+    if (!layout || !layout->font)
+        return;
+    font = layout->font;
+
+    if (layout->fits)
+    {
+        n = layout->len;
+        memcpy(cells, layout->text, n);
+    }
+    else if (layout->overflow == TextOverflow_Ellipsis)
+    {
+        n = layout->visible;
+        if (n > sizeof(cells))
+            n = sizeof(cells);
+        keep = (n > 3) ? n - 3 : 0;
+        memcpy(cells, layout->text, keep);
+        memset(cells + keep, '.', n - keep);
+    }
+    else
+    {
+        n = layout->visible;
+        if (n > sizeof(cells))
+            n = sizeof(cells);
+        period = layout->len + TEXT_MARQUEE_GAP;
+        for (i = 0; i < n; i++)
+        {
+            keep = (layout->offset + i) % period;
+            cells[i] = (keep < layout->len) ? layout->text[keep] : ' ';
+        }
+        layout->offset = (layout->offset + 1) % period;
+    }
+
+    deferred = ctx->deferred;
+    ctx->deferred = 1;
+    for (i = 0; i < n; i++)
+    {
+        lcd_ctx_write_char(ctx, layout->x + i * font->width, layout->y, cells[i], *font, color, bgcolor);
+    }
+    if (n * font->width < layout->w)
+    {
+        lcd_ctx_fill_rectangle(ctx, layout->x + n * font->width, layout->y,
+                               layout->w - n * font->width, font->height, bgcolor);
+    }
+    ctx->deferred = deferred;
+    if (!deferred)
+        lcd_ctx_flush(ctx);
+}
+
+/*
+ * Drop every cached layout, and the header strip drawn from one, e.g.
+ * after the fonts or the geometry change
+ */
+void text_ctx_flush_cache(lcd_ctx *ctx)
+{
+    memset(&ctx->text, 0, sizeof(ctx->text));
+    ctx->header_width = 0;
+}
+
+TextLayout *text_layout(const char *str, uint16_t x, uint16_t y, uint16_t w, uint16_t h, TextOverflow overflow)
+{
+    return text_ctx_layout(lcd_default_ctx(), str, x, y, w, h, overflow);
+}
+
+void text_draw(TextLayout *layout, uint16_t color, uint16_t bgcolor)
+{
+    text_ctx_draw(lcd_default_ctx(), layout, color, bgcolor);
+}
+
+void text_layout_flush_cache(void)
+{
+    text_ctx_flush_cache(lcd_default_ctx());
+}
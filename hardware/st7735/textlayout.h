@@ -0,0 +1,61 @@
+/* vim: set ai et ts=4 sw=4: */
+#ifndef __TEXTLAYOUT_H__
+#define __TEXTLAYOUT_H__
+
+#include "fonts.h"
+
+/* Longest string a layout keeps; longer input is cut before measuring */
+#define TEXT_LAYOUT_MAX_LEN    64
+/* Number of (string, box) layouts kept before the oldest is recycled */
+#define TEXT_LAYOUT_CACHE_SIZE 8
+/* Blank cells between the tail and the head of a scrolling marquee */
+#define TEXT_MARQUEE_GAP       3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What to do when the string does not fit the box even in the smallest font */
+typedef enum TextOverflow{
+  TextOverflow_Ellipsis = 0,
+  TextOverflow_Marquee
+}TextOverflow;
+
+typedef struct TextLayout{
+  char text[TEXT_LAYOUT_MAX_LEN];
+  uint16_t x;
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+  TextOverflow overflow;
+  const FontDef *font;   /* largest loaded font that fits, or the smallest one */
+  uint16_t len;          /* characters in text */
+  uint16_t visible;      /* character cells that fit in the box */
+  uint16_t width;        /* pixel width of text in the chosen font */
+  uint8_t fits;          /* 0 when the overflow fallback is in effect */
+  uint16_t offset;       /* marquee position, in characters */
+  uint32_t stamp;        /* last use, for cache eviction */
+}TextLayout;
+
+/* Layout cache; every lcd_ctx carries its own */
+typedef struct TextCache{
+  TextLayout entries[TEXT_LAYOUT_CACHE_SIZE];
+  uint32_t clock;
+}TextCache;
+
+struct lcd_ctx;
+
+extern uint16_t text_measure(const char *str, const FontDef *font);
+extern const FontDef *text_pick_font(const char *str, uint16_t w, uint16_t h);
+extern TextLayout *text_ctx_layout(struct lcd_ctx *ctx, const char *str, uint16_t x, uint16_t y, uint16_t w, uint16_t h, TextOverflow overflow);
+extern void text_ctx_draw(struct lcd_ctx *ctx, TextLayout *layout, uint16_t color, uint16_t bgcolor);
+extern void text_ctx_flush_cache(struct lcd_ctx *ctx);
+extern TextLayout *text_layout(const char *str, uint16_t x, uint16_t y, uint16_t w, uint16_t h, TextOverflow overflow);
+extern void text_draw(TextLayout *layout, uint16_t color, uint16_t bgcolor);
+extern void text_layout_flush_cache(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TEXTLAYOUT_H__
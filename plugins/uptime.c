@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * uptime.c — example display plugin
+ *
+ * Build:   make plugins
+ * Install: sudo install -m 0644 plugins/uptime.so /usr/lib/uctronics-display/plugins/
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/sysinfo.h>
+
+#include "rm0004_plugin.h"
+
+struct uptime_sample
+{
+    long uptime;
+    unsigned short procs;
+};
+
+static int uptime_collect(void *buf, uint32_t len)
+{
+    struct uptime_sample *s = (struct uptime_sample *)buf;
+    struct sysinfo info;
+
+    if (len < sizeof(*s) || sysinfo(&info) != 0)
+        return -1;
+    s->uptime = info.uptime;
+    s->procs = info.procs;
+    return 0;
+}
+
+static void uptime_render(const void *sample, uint32_t len, const struct rm0004_draw_api *api)
+{
+    const struct uptime_sample *s = (const struct uptime_sample *)sample;
+    char text[24];
+
+    if (!s || len < sizeof(*s))
+    {
+        api->write_text(api->surface, 30, 35, "UP: ...", RM0004_FONT_11x18, 0xFFFF, 0x0000);
+        return;
+    }
+    snprintf(text, sizeof(text), "UP: %ud %02uh", (unsigned)(s->uptime / 86400), (unsigned)(s->uptime / 3600 % 24));
+    api->fit_text(api->surface, 0, 35, api->width, 20, text, 0xFFFF, 0x0000);
+    snprintf(text, sizeof(text), "%u procs", (unsigned)s->procs);
+    api->write_text(api->surface, 44, 60, text, RM0004_FONT_7x10, 0x8410, 0x0000);
+}
+
+static const struct rm0004_plugin uptime_plugin = {
+    RM0004_PLUGIN_ABI_VERSION,
+    "uptime",
+    sizeof(struct uptime_sample),
+    5000,       /* interval_ms */
+    0,          /* collect_budget_us: default */
+    0,          /* render_budget_us: default */
+    0,          /* dwell_ms: default */
+    NULL,
+    uptime_collect,
+    uptime_render,
+    NULL
+};
+
+const struct rm0004_plugin *rm0004_plugin_entry(uint32_t host_abi)
+{
+    (void)host_abi;
+    return &uptime_plugin;
+}
@@ -1,32 +1,481 @@
 /******
-Demo for ssd1306 i2c driver for  Raspberry Pi 
+Demo for ssd1306 i2c driver for  Raspberry Pi
 ******/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
 #include "st7735.h"
+#include "lcd_ctx.h"
+#include "lcd_bus.h"
+#include "lcd_probe.h"
+#include "pages.h"
+#include "splash.h"
+#include "sampler.h"
+#include "history.h"
+#include "rules.h"
+#include "plugin.h"
+#include "state.h"
 #include "time.h"
 #include <unistd.h>
 
+#define PANEL_MAX 8
 
+typedef struct Panel
+{
+	char bus[LCD_BUS_PATH_MAX];
+	uint8_t address;
+	char pages[96];		/* comma separated page names, empty for all */
+	lcd_ctx *ctx;
+	lcd_bus *link;
+	PageSet set;
+	pthread_t thread;
+	uint8_t reported;	/* cold start timings printed */
+} Panel;
+
+static Panel panels[PANEL_MAX];
+static int panel_count;
+static lcd_bus_budget budget;
+static int budget_set;
+static uint32_t lead_ms = PAGE_DEFAULT_LEAD_MS;
+static uint32_t live_hz;
+static uint64_t start_us;
 
-int main(void) 
+static void usage(const char *argv0)
 {
-	uint8_t symbol = 0;
-	
-	if(lcd_begin())      //LCD Screen initialization
+	fprintf(stderr,
+		"usage: %s [-p BUS[:ADDR[:PAGE,...]]]... [-s HOLD_US[:SLICE_US[:GAP_US]]] [-a RULE]... [-l LEAD_MS] [-L HZ]\n"
+		"  -p  drive a panel on BUS (default: the one it answers on) at ADDR (default 0x%02x)\n"
+		"      showing the named pages (default all); repeat for more panels\n"
+		"  -s  share the bus: hold it at most HOLD_US per message, and after\n"
+		"      SLICE_US of panel traffic leave it idle for GAP_US\n"
+		"  -a  alert when a rule holds, e.g. 'crit: temp > 75 for 10s hyst 3';\n"
+		"      series are cpu, temp, ram, disk, iolat, net and any a plugin adds\n"
+		"  -l  sample a page's data LEAD_MS before the page is due (default %d)\n"
+		"  -L  live meter: pin the CPU page and refresh it HZ times a second,\n"
+		"      e.g. 20 during a load test\n"
+		"  kill -USR1 prints per-panel stats to stderr\n",
+		argv0, I2C_ADDRESS, PAGE_DEFAULT_LEAD_MS);
+}
+
+/* "BUS[:ADDR[:PAGES]]" */
+static int panel_parse(Panel *panel, char *spec)
+{
+	char *addr;
+	char *list;
+	char *end;
+	long value;
+
+	memset(panel, 0, sizeof(*panel));
+	addr = strchr(spec, ':');
+	if (addr)
+		*addr++ = '\0';
+	snprintf(panel->bus, sizeof(panel->bus), "%s", spec);
+	panel->address = I2C_ADDRESS;
+	if (!addr)
+		return 0;
+
+	list = strchr(addr, ':');
+	if (list)
+		*list++ = '\0';
+	if (*addr)
 	{
+		value = strtol(addr, &end, 0);
+		if (*end || value < 0x03 || value > 0x77)
+			return -1;
+		panel->address = (uint8_t)value;
+	}
+	if (list)
+		snprintf(panel->pages, sizeof(panel->pages), "%s", list);
+	return 0;
+}
+
+/* "HOLD_US[:SLICE_US[:GAP_US]]" */
+static int budget_parse(lcd_bus_budget *b, const char *spec)
+{
+	unsigned long v[3] = {0, 0, 0};
+	char *end;
+	int i;
+
+	for (i = 0; i < 3 && *spec; i++)
+	{
+		v[i] = strtoul(spec, &end, 10);
+		if (end == spec || (*end && *end != ':'))
+			return -1;
+		spec = *end ? end + 1 : end;
+	}
+	memset(b, 0, sizeof(*b));
+	b->max_hold_us = (uint32_t)v[0];
+	b->slice_us = (uint32_t)v[1];
+	b->gap_us = (uint32_t)v[2];
+	return 0;
+}
+
+/* "LEAD_MS" */
+static int lead_parse(uint32_t *ms, const char *spec)
+{
+	unsigned long v;
+	char *end;
+
+	v = strtoul(spec, &end, 10);
+	if (end == spec || *end || v > 60000)
+		return -1;
+	*ms = (uint32_t)v;
+	return 0;
+}
+
+/* "HZ", a live meter refresh rate */
+static int live_parse(uint32_t *hz, const char *spec)
+{
+	unsigned long v;
+	char *end;
+
+	v = strtoul(spec, &end, 10);
+	if (end == spec || *end || v < 1 || v > 50)
+		return -1;
+	*hz = (uint32_t)v;
+	return 0;
+}
+
+/*
+ * Find the bus of a panel given without one. The bus cached by the last
+ * run is used if the panel still answers there; otherwise every bus is
+ * probed at once and the result cached for next time, unless something
+ * answered on more than one bus and the pick may be a sensor.
+ */
+static void panel_find_bus(Panel *panel)
+{
+	char name[32];
+	char path[256];
+	char bus[LCD_BUS_PATH_MAX] = "";
+	FILE *f;
+	int answered;
+
+	snprintf(name, sizeof(name), "bus-%02x", panel->address);
+	if (state_path(path, sizeof(path), name) != 0)
+		path[0] = '\0';
+
+	f = path[0] ? fopen(path, "r") : NULL;
+	if (f)
+	{
+		if (fgets(bus, sizeof(bus), f))
+			bus[strcspn(bus, "\n")] = '\0';
+		fclose(f);
+		if (bus[0] && lcd_probe_bus(bus, panel->address, LCD_PROBE_TIMEOUT_MS, 0) == 1)
+		{
+			snprintf(panel->bus, sizeof(panel->bus), "%s", bus);
+			return;
+		}
+	}
+
+	answered = lcd_probe(panel->address, LCD_PROBE_TIMEOUT_MS, bus, sizeof(bus));
+	if (answered == 0)
+	{
+		fprintf(stderr, "panel 0x%02x: no answer on %s, trying %s\n",
+			panel->address, LCD_PROBE_PATTERN, LCD_PROBE_DEFAULT_BUS);
+		snprintf(panel->bus, sizeof(panel->bus), "%s", LCD_PROBE_DEFAULT_BUS);
+		return;
+	}
+	snprintf(panel->bus, sizeof(panel->bus), "%s", bus);
+	if (answered > 1)
+	{
+		/* not cached: pass -p BUS to settle it */
+		fprintf(stderr, "panel 0x%02x: answers on %d buses, using %s\n", panel->address, answered, bus);
+		return;
+	}
+	fprintf(stderr, "panel 0x%02x: found on %s\n", panel->address, bus);
+
+	f = path[0] ? fopen(path, "w") : NULL;
+	if (f)
+	{
+		fprintf(f, "%s\n", bus);
+		fclose(f);
+	}
+}
+
+/*
+ * Keep the panel's frame in the state directory, and put the frame saved
+ * by the previous run back on the panel right away, or the splash if
+ * there is none
+ */
+static void panel_restore(Panel *panel)
+{
+	char name[64];
+	char path[256];
+	const char *bus = strrchr(panel->bus, '/');
+
+	snprintf(name, sizeof(name), "frame-%s-%02x.bin", bus ? bus + 1 : panel->bus, panel->address);
+	if (state_path(path, sizeof(path), name) != 0 || lcd_ctx_persist(panel->ctx, path) != 0 ||
+		lcd_ctx_restore(panel->ctx) != 0)
+		lcd_ctx_draw_splash(panel->ctx);
+	lcd_ctx_flush_async(panel->ctx);
+}
+
+static void *panel_thread(void *arg)
+{
+	Panel *panel = (Panel *)arg;
+	page_run(&panel->set);
+	return NULL;
+}
+
+/* Milliseconds from start to t, or 0 if t has not happened */
+static unsigned long since_start_ms(uint64_t t)
+{
+	return t > start_us ? (unsigned long)((t - start_us) / 1000) : 0;
+}
+
+/*
+ * Print how long the panel took to show its first pixel and its first
+ * complete page, once it has. Returns 1 if it printed.
+ */
+static int panel_report_start(Panel *panel)
+{
+	lcd_stats s;
+	uint64_t page_us;
+
+	page_us = __atomic_load_n(&panel->set.first_page_us, __ATOMIC_ACQUIRE);
+	if (panel->reported || !page_us)
 		return 0;
+	lcd_ctx_get_stats(panel->ctx, &s);
+	fprintf(stderr, "panel %s@0x%02x: first pixel after %lu ms, complete page after %lu ms\n",
+		panel->bus, panel->address, since_start_ms(s.first_flush_us), since_start_ms(page_us));
+	panel->reported = 1;
+	return 1;
+}
+
+static void bus_dump_stats(lcd_bus *bus)
+{
+	lcd_bus_stats s;
+	lcd_bus_budget b;
+
+	lcd_bus_get_stats(bus, &s);
+	lcd_bus_get_budget(bus, &b);
+	fprintf(stderr, "bus %s @ %u Hz: %u frames, busy %llu ms, %u-byte messages, worst hold %u us, queue max %u\n",
+		lcd_bus_path(bus), (unsigned)b.bus_hz, (unsigned)s.frames,
+		(unsigned long long)(s.busy_us / 1000), (unsigned)s.chunk_bytes,
+		(unsigned)s.max_hold_us, (unsigned)s.max_queue);
+	if (s.urgent_frames)
+		fprintf(stderr, "  urgent: %u frames, avg %llu us, max %u us to the panel, max wait %u us, %u preemptions\n",
+			(unsigned)s.urgent_frames, (unsigned long long)(s.urgent_us / s.urgent_frames),
+			(unsigned)s.max_urgent_us, (unsigned)s.max_urgent_wait_us, (unsigned)s.preemptions);
+}
+
+static void sampler_dump(void)
+{
+	SamplerStats s;
+	int i;
+
+	for (i = 0; sampler_get_stats(i, &s) == 0; i++)
+		fprintf(stderr, "collector %-8s every %u ms (%u..%u), %.2f Hz effective, %u runs, %u failures%s\n",
+			sampler_name(i), (unsigned)s.interval_ms, (unsigned)s.min_ms, (unsigned)s.max_ms,
+			s.period_ms ? 1000.0 / s.period_ms : 0.0, (unsigned)s.runs, (unsigned)s.failures,
+			s.disabled ? ", disabled" : "");
+}
+
+static void rules_dump(void)
+{
+	RuleStatus st;
+	int i;
+
+	for (i = 0; rules_status(i, &st) == 0; i++)
+		fprintf(stderr, "rule %s%s: %s, last %.1f\n", st.level == RULE_CRIT ? "crit: " : "",
+			st.expr, st.firing ? "firing" : "clear", st.value);
+}
+
+static void panel_dump_stats(Panel *panel)
+{
+	lcd_stats s;
+	PageStats ps;
+	int i;
+
+	lcd_ctx_get_stats(panel->ctx, &s);
+	fprintf(stderr, "panel %s@0x%02x: %u flushes, %llu px, %llu bytes, avg %llu us, max %u us, %u errors\n",
+		panel->bus, panel->address, (unsigned)s.flushes,
+		(unsigned long long)s.flush_pixels, (unsigned long long)s.bytes,
+		(unsigned long long)(s.flushes ? s.flush_us / s.flushes : 0),
+		(unsigned)s.max_flush_us, (unsigned)s.write_errors);
+	fprintf(stderr, "  bus hold: max %u us per message, %u yields, max %u us between yields\n",
+		(unsigned)s.max_hold_us, (unsigned)s.slices, (unsigned)s.max_slice_us);
+	fprintf(stderr, "  cold start: first pixel after %lu ms, complete page after %lu ms\n",
+		since_start_ms(s.first_flush_us),
+		since_start_ms(__atomic_load_n(&panel->set.first_page_us, __ATOMIC_ACQUIRE)));
+	fprintf(stderr, "  prefetch: %u collector runs %u ms ahead of their page\n",
+		(unsigned)panel->set.prefetches, (unsigned)panel->set.lead_ms);
+	fprintf(stderr, "  offscreen: %u pages composed ahead, %u presented, %llu unchanged px not sent\n",
+		(unsigned)panel->set.prerenders, (unsigned)s.presents, (unsigned long long)s.skipped_pixels);
+	fprintf(stderr, "  animation: %u frames, %u dropped while the bus was busy or late, %u us per flush\n",
+		(unsigned)panel->set.frames, (unsigned)panel->set.frames_skipped, (unsigned)panel->set.frame_cost_us);
+	if (panel->set.live_hz)
+		fprintf(stderr, "  live meter: %.1f of %u Hz over the last %d s, %u refreshes, %u skipped\n",
+			panel->set.live_rate, (unsigned)panel->set.live_hz, PAGE_LIVE_REPORT_S,
+			(unsigned)panel->set.live_frames, (unsigned)panel->set.live_skipped);
+	for (i = 0; i < panel->set.count; i++)
+	{
+		page_get_stats(&panel->set, i, &ps);
+		fprintf(stderr, "  page %-8s %u renders, last %u us, max %u us, %u overruns%s\n",
+			page_name(panel->set.page[i]), (unsigned)ps.renders, (unsigned)ps.last_us,
+			(unsigned)ps.max_us, (unsigned)ps.overruns, ps.disabled ? ", disabled" : "");
+		fprintf(stderr, "           deadline missed %u of %u (%.1f%%), worst %u us late, max %u us to the panel, %u dropped, %u coalesced\n",
+			(unsigned)ps.misses, (unsigned)ps.deadlines,
+			ps.deadlines ? 100.0 * ps.misses / ps.deadlines : 0.0,
+			(unsigned)ps.worst_late_us, (unsigned)ps.max_finish_us,
+			(unsigned)ps.dropped, (unsigned)ps.coalesced);
 	}
-	sleep(1);
-	while(1)
-	{
-		lcd_display(symbol);
-		sleep(1);
-        sleep(1);
-		symbol++;
-		if(symbol==4)
-        {
-          symbol=0;
-        }
+}
+
+int main(int argc, char **argv)
+{
+	char spec[128];
+	struct timespec tick = {0, 100000000L};
+	sigset_t sigs;
+	int pending;
+	int sig;
+	int opt;
+	int i;
+
+	start_us = sampler_now_us();
+
+	/* SIGUSR1 is taken by sigwait() below; keep it away from worker threads */
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+	while ((opt = getopt(argc, argv, "p:s:a:l:L:h")) != -1)
+	{
+		if (opt == 'p' && panel_count < PANEL_MAX)
+		{
+			snprintf(spec, sizeof(spec), "%s", optarg);
+			if (panel_parse(&panels[panel_count], spec) != 0)
+			{
+				fprintf(stderr, "bad panel '%s'\n", optarg);
+				return 1;
+			}
+			panel_count++;
+		}
+		else if (opt == 's' && budget_parse(&budget, optarg) == 0)
+		{
+			budget_set = 1;
+		}
+		else if (opt == 'a')
+		{
+			if (rule_add(optarg) < 0)
+				return 1;
+		}
+		else if (opt == 'l' && lead_parse(&lead_ms, optarg) == 0)
+		{
+			/* applied to each panel's page set below */
+		}
+		else if (opt == 'L' && live_parse(&live_hz, optarg) == 0)
+		{
+			/* likewise */
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (panel_count == 0)
+	{
+		spec[0] = '\0';
+		panel_parse(&panels[panel_count++], spec);
+	}
+
+	/* last run's frames or the splash go up first, before anything is loaded or sampled */
+	for (i = 0; i < panel_count; i++)
+	{
+		Panel *panel = &panels[i];
+
+		if (!panel->bus[0])
+			panel_find_bus(panel);
+		panel->ctx = lcd_ctx_create();
+		panel->link = lcd_bus_get(panel->bus);
+		if (!panel->ctx || !panel->link || lcd_bus_attach(panel->ctx, panel->link, panel->address))
+		{
+			/* non-zero so that Restart=on-failure tries again, e.g. once udev has made the node */
+			fprintf(stderr, "panel %d: cannot drive %s at 0x%02x: %s\n", i + 1,
+					panel->bus[0] ? panel->bus : "(no bus found)", panel->address,
+					!panel->ctx ? "out of memory" : !panel->link ? "bus did not open" : "attach failed");
+			return 1;
+		}
+		if (budget_set)
+			lcd_bus_set_budget(panel->link, &budget);
+		panel_restore(panel);
+	}
+
+	/*
+	 * Stock pages first, then one page per plugin, in file name order.
+	 * Collectors start as they are registered, each on its own thread, so
+	 * nothing here waits for the network; pages fill in as samples arrive.
+	 */
+	page_register_builtin();
+	if (state_path(spec, sizeof(spec), "history.bin") == 0)
+		history_persist(spec);
+	history_start();
+	sampler_start();
+	plugin_load_dir(plugin_dir());
+	rules_check();
+
+	for (i = 0; i < panel_count; i++)
+	{
+		Panel *panel = &panels[i];
+
+		page_set_init(&panel->set, panel->ctx);
+		panel->set.lead_ms = lead_ms;
+		panel->set.live_hz = live_hz;
+		if (panel->pages[0])
+		{
+			if (page_set_parse(&panel->set, panel->pages) != 0)
+				return 1;
+		}
+		else
+		{
+			page_set_add_all(&panel->set);
+		}
+	}
+
+	for (i = 0; i < panel_count; i++)
+	{
+		if (pthread_create(&panels[i].thread, NULL, panel_thread, &panels[i]) != 0)
+		{
+			fprintf(stderr, "panel %s: no render thread\n", panels[i].bus);
+			return 1;
+		}
+	}
+
+	pending = 0;
+	for (i = 0; i < panel_count; i++)
+		pending += panels[i].set.count > 0;
+
+	for (;;)
+	{
+		/* poll for the cold start timings until every panel has shown a page */
+		if (pending > 0)
+		{
+			sig = sigtimedwait(&sigs, NULL, &tick);
+			for (i = 0; i < panel_count; i++)
+				pending -= panel_report_start(&panels[i]);
+		}
+		else if (sigwait(&sigs, &sig) != 0)
+		{
+			continue;
+		}
+		if (sig == SIGUSR1)
+		{
+			for (i = 0; i < panel_count; i++)
+			{
+				/* one line per bus, before its first panel */
+				int j = 0;
+				while (j < i && panels[j].link != panels[i].link)
+					j++;
+				if (j == i)
+					bus_dump_stats(panels[i].link);
+				panel_dump_stats(&panels[i]);
+			}
+			sampler_dump();
+			rules_dump();
+		}
 	}
 	return 0;
 }
@@ -0,0 +1,371 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * plugin.c — load custom pages and collectors from shared objects
+ *
+ * Every *.so in the plugin directory is dlopen()ed at startup. Its
+ * collector is registered with the sampler and its render callback is
+ * registered as a page, so plugins rotate and sample exactly like the
+ * stock pages, under the same time budgets.
+ *
+ * A render runs on the plugin's own thread, into a scratch context, and
+ * the panel thread waits for it at most the render budget. A render that
+ * is not back by then is abandoned: the page shows a placeholder, and is
+ * left out of every panel's rotation until the render returns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "plugin.h"
+#include "rm0004_plugin.h"
+#include "sampler.h"
+#include "pages.h"
+#include "lcd_ctx.h"
+#include "textlayout.h"
+
+#define PLUGIN_CONTENT_TOP 25
+
+typedef struct Plugin
+{
+    void *handle;
+    const struct rm0004_plugin *desc;
+    char path[256];
+    int collector;
+    int page;
+    uint32_t budget_us;
+
+    /* render thread; the fields below are guarded by render_lock */
+    pthread_t thread;
+    pthread_mutex_t render_lock;
+    pthread_cond_t render_wake;
+    pthread_cond_t render_done;    /* CLOCK_MONOTONIC */
+    lcd_ctx *surface;              /* scratch the thread draws into */
+    uint8_t sample[RM0004_PLUGIN_MAX_SAMPLE];
+    uint32_t sample_len;
+    uint8_t requested;             /* a render is waiting for the thread */
+    uint8_t running;               /* ... or under way; surface is the thread's */
+    uint8_t stalled;               /* a render overran and was abandoned */
+    uint64_t started_us;
+} Plugin;
+
+static Plugin plugins[PLUGIN_MAX];
+static int plugin_count;
+
+/* ---------------- Draw primitives handed to plugins ---------------- */
+
+static void api_fill_rect(void *surface, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color)
+{
+    lcd_ctx_fill_rectangle((lcd_ctx *)surface, x, y, w, h, color);
+}
+
+static void api_write_text(void *surface, uint16_t x, uint16_t y, const char *str, int font,
+                           uint16_t color, uint16_t bgcolor)
+{
+    if (font < RM0004_FONT_7x10 || font > RM0004_FONT_16x26 || !str)
+        return;
+    lcd_ctx_write_str((lcd_ctx *)surface, x, y, str, (FontType)font, color, bgcolor);
+}
+
+static void api_fit_text(void *surface, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const char *str,
+                         uint16_t color, uint16_t bgcolor)
+{
+    lcd_ctx *ctx = (lcd_ctx *)surface;
+    text_ctx_draw(ctx, text_ctx_layout(ctx, str, x, y, w, h, TextOverflow_Ellipsis), color, bgcolor);
+}
+
+static void api_draw_bar(void *surface, uint8_t percent, uint16_t color)
+{
+    lcd_ctx_display_percentage((lcd_ctx *)surface, percent, color);
+}
+
+static void api_draw_image(void *surface, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data)
+{
+    if (!data)
+        return;
+    lcd_ctx_draw_image((lcd_ctx *)surface, x, y, w, h, data);
+}
+
+static void plugin_draw_api(lcd_ctx *ctx, struct rm0004_draw_api *api)
+{
+    memset(api, 0, sizeof(*api));
+    api->abi_version = RM0004_PLUGIN_ABI_VERSION;
+    api->size = sizeof(*api);
+    api->width = ctx->width;
+    api->height = ctx->height;
+    api->top = PLUGIN_CONTENT_TOP;
+    api->surface = ctx;
+    api->fill_rect = api_fill_rect;
+    api->write_text = api_write_text;
+    api->fit_text = api_fit_text;
+    api->draw_bar = api_draw_bar;
+    api->draw_image = api_draw_image;
+}
+
+/* ---------------- Sampler and page glue ---------------- */
+
+static int plugin_collect(void *arg, void *buf, size_t len)
+{
+    Plugin *p = (Plugin *)arg;
+    return p->desc->collect(buf, (uint32_t)len);
+}
+
+static void *plugin_render_thread(void *arg)
+{
+    Plugin *p = (Plugin *)arg;
+    struct rm0004_draw_api api;
+    lcd_ctx *surface = p->surface;
+    uint64_t took;
+
+    pthread_mutex_lock(&p->render_lock);
+    for (;;)
+    {
+        while (!p->requested)
+            pthread_cond_wait(&p->render_wake, &p->render_lock);
+        p->requested = 0;
+        pthread_mutex_unlock(&p->render_lock);
+
+        plugin_draw_api(surface, &api);
+        lcd_ctx_fill_rectangle(surface, 0, PLUGIN_CONTENT_TOP, surface->width,
+                               surface->height - PLUGIN_CONTENT_TOP, ST7735_BLACK);
+        p->desc->render(p->sample_len ? p->sample : NULL, p->sample_len, &api);
+
+        pthread_mutex_lock(&p->render_lock);
+        p->running = 0;
+        if (p->stalled)
+        {
+            took = sampler_now_us() - p->started_us;
+            fprintf(stderr, "plugin: %s render returned after %lu ms, page back in rotation\n",
+                    p->desc->name, (unsigned long)(took / 1000));
+            p->stalled = 0;
+            page_stall(p->page, 0);
+        }
+        pthread_cond_broadcast(&p->render_done);
+    }
+    return NULL;
+}
+
+/* Wait on render_done until deadline (sampler_now_us() time); returns 0 on timeout */
+static int plugin_wait(Plugin *p, uint64_t deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(deadline / 1000000ULL);
+    ts.tv_nsec = (long)(deadline % 1000000ULL) * 1000L;
+    return pthread_cond_timedwait(&p->render_done, &p->render_lock, &ts) != ETIMEDOUT;
+}
+
+/*
+ * Have the plugin's thread draw the page and copy it into ctx. Pages on
+ * several panels may render the same plugin at once; plugins are not
+ * required to be reentrant, so one render runs at a time. Waits at most
+ * the render budget, for this render and any other panel's before it.
+ */
+static void plugin_render(lcd_ctx *ctx, void *arg)
+{
+    Plugin *p = (Plugin *)arg;
+    uint8_t sample[RM0004_PLUGIN_MAX_SAMPLE];
+    uint64_t deadline = sampler_now_us() + p->budget_us;
+    lcd_ctx *surface = p->surface;
+    char text[48];
+    int n = -1;
+
+    if (p->collector >= 0)
+        n = sampler_read(p->collector, sample, sizeof(sample), NULL);
+
+    pthread_mutex_lock(&p->render_lock);
+    while (p->running && !p->stalled && plugin_wait(p, deadline))
+        ;
+    if (!p->running)
+    {
+        surface->width = ctx->width;
+        surface->height = ctx->height;
+        p->sample_len = n > 0 ? (uint32_t)n : 0;
+        if (p->sample_len)
+            memcpy(p->sample, sample, p->sample_len);
+        p->requested = 1;
+        p->running = 1;
+        p->started_us = sampler_now_us();
+        pthread_cond_signal(&p->render_wake);
+        while (p->running && plugin_wait(p, deadline))
+            ;
+    }
+    if (!p->running)
+    {
+        lcd_ctx_draw_pixels(ctx, 0, PLUGIN_CONTENT_TOP, ctx->width, ctx->height - PLUGIN_CONTENT_TOP,
+                            surface->fb + PLUGIN_CONTENT_TOP * surface->width, surface->width);
+        pthread_mutex_unlock(&p->render_lock);
+        return;
+    }
+    if (!p->stalled)
+    {
+        p->stalled = 1;
+        page_stall(p->page, 1);
+        fprintf(stderr, "plugin: %s render over its %u us budget, page left out until it returns\n",
+                p->desc->name, (unsigned)p->budget_us);
+    }
+    pthread_mutex_unlock(&p->render_lock);
+
+    lcd_ctx_fill_rectangle(ctx, 0, PLUGIN_CONTENT_TOP, ctx->width, ctx->height - PLUGIN_CONTENT_TOP, ST7735_BLACK);
+    snprintf(text, sizeof(text), "%s: no response", p->desc->name);
+    text_ctx_draw(ctx, text_ctx_layout(ctx, text, 0, PLUGIN_CONTENT_TOP, ctx->width, 20, TextOverflow_Ellipsis),
+                  ST7735_WHITE, ST7735_BLACK);
+}
+
+static uint32_t clamp_u32(uint32_t value, uint32_t fallback, uint32_t lo, uint32_t hi)
+{
+    if (value == 0)
+        return fallback;
+    if (value < lo)
+        return lo;
+    if (value > hi)
+        return hi;
+    return value;
+}
+
+/* ---------------- Loading ---------------- */
+
+/* Give the plugin a scratch context and a thread to render into it; returns 0 on success */
+static int plugin_start_render(Plugin *p)
+{
+    pthread_condattr_t attr;
+
+    p->surface = lcd_ctx_create();
+    if (!p->surface)
+        return -1;
+    lcd_ctx_set_deferred(p->surface, 1);
+    pthread_mutex_init(&p->render_lock, NULL);
+    pthread_cond_init(&p->render_wake, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->render_done, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&p->thread, NULL, plugin_render_thread, p) != 0)
+    {
+        lcd_ctx_destroy(p->surface);
+        p->surface = NULL;
+        return -1;
+    }
+    pthread_detach(p->thread);
+    return 0;
+}
+
+static int plugin_load(const char *path)
+{
+    Plugin *p;
+    rm0004_plugin_entry_fn entry;
+    const struct rm0004_plugin *desc;
+    void *handle;
+
+    if (plugin_count >= PLUGIN_MAX)
+    {
+        fprintf(stderr, "plugin: %s skipped, at most %d plugins\n", path, PLUGIN_MAX);
+        return -1;
+    }
+
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+    {
+        fprintf(stderr, "plugin: %s\n", dlerror());
+        return -1;
+    }
+
+    *(void **)(&entry) = dlsym(handle, RM0004_PLUGIN_ENTRY);
+    desc = entry ? entry(RM0004_PLUGIN_ABI_VERSION) : NULL;
+    if (!desc || desc->abi_version != RM0004_PLUGIN_ABI_VERSION || !desc->name)
+    {
+        fprintf(stderr, "plugin: %s has no compatible %s (want ABI %d)\n",
+                path, RM0004_PLUGIN_ENTRY, RM0004_PLUGIN_ABI_VERSION);
+        dlclose(handle);
+        return -1;
+    }
+    if (desc->collect && (desc->sample_size == 0 || desc->sample_size > RM0004_PLUGIN_MAX_SAMPLE))
+    {
+        fprintf(stderr, "plugin: %s sample_size %u out of range\n", desc->name, (unsigned)desc->sample_size);
+        dlclose(handle);
+        return -1;
+    }
+    if (desc->init && desc->init() != 0)
+    {
+        fprintf(stderr, "plugin: %s init failed\n", desc->name);
+        dlclose(handle);
+        return -1;
+    }
+
+    p = &plugins[plugin_count];
+    p->handle = handle;
+    p->desc = desc;
+    snprintf(p->path, sizeof(p->path), "%s", path);
+    p->collector = -1;
+    p->page = -1;
+
+    if (desc->collect)
+    {
+        p->collector = sampler_register(desc->name, plugin_collect, p, desc->sample_size,
+                                        clamp_u32(desc->interval_ms, PLUGIN_DEFAULT_INTERVAL_MS,
+                                                  PLUGIN_MIN_INTERVAL_MS, 3600000),
+                                        clamp_u32(desc->collect_budget_us, PLUGIN_COLLECT_BUDGET_US,
+                                                  1, PLUGIN_MAX_COLLECT_BUDGET_US));
+    }
+    if (desc->render && plugin_start_render(p) == 0)
+    {
+        p->budget_us = clamp_u32(desc->render_budget_us, PLUGIN_RENDER_BUDGET_US, 1, PLUGIN_MAX_RENDER_BUDGET_US);
+        p->page = page_register(desc->name, plugin_render, p, desc->dwell_ms, p->budget_us);
+        /* the page draws from the plugin's own collector */
+        if (p->collector >= 0)
+            page_depends(p->page, desc->name);
+    }
+    if ((desc->collect && p->collector < 0) || (desc->render && p->page < 0))
+    {
+        /* a half-registered plugin cannot be taken back out; keep it loaded */
+        fprintf(stderr, "plugin: %s could not be fully scheduled\n", desc->name);
+    }
+
+    plugin_count++;
+    fprintf(stderr, "plugin: loaded %s from %s\n", desc->name, path);
+    return 0;
+}
+
+const char* plugin_dir(void)
+{
+    const char *dir = getenv(PLUGIN_DIR_ENV);
+    return (dir && *dir) ? dir : PLUGIN_DIR;
+}
+
+/*
+ * Load every *.so in dir, in name order. Returns the number loaded;
+ * a missing directory simply means no plugins.
+ */
+int plugin_load_dir(const char *dir)
+{
+    struct dirent **list;
+    char path[256];
+    size_t n;
+    int count;
+    int loaded = 0;
+    int i;
+
+    count = scandir(dir, &list, NULL, alphasort);
+    if (count < 0)
+        return 0;
+
+    for (i = 0; i < count; i++)
+    {
+        n = strlen(list[i]->d_name);
+        if (n > 3 && strcmp(list[i]->d_name + n - 3, ".so") == 0 &&
+            snprintf(path, sizeof(path), "%s/%s", dir, list[i]->d_name) < (int)sizeof(path))
+        {
+            if (plugin_load(path) == 0)
+                loaded++;
+        }
+        free(list[i]);
+    }
+    free(list);
+    return loaded;
+}
@@ -0,0 +1,20 @@
+#ifndef  __PLUGIN_H
+#define  __PLUGIN_H
+
+/* Where plugins are loaded from; the environment variable overrides it */
+#define PLUGIN_DIR                   "/usr/lib/uctronics-display/plugins"
+#define PLUGIN_DIR_ENV               "UCTRONICS_PLUGIN_DIR"
+#define PLUGIN_MAX                   8
+
+/* Defaults and caps for what a plugin may ask for */
+#define PLUGIN_DEFAULT_INTERVAL_MS   1000
+#define PLUGIN_MIN_INTERVAL_MS       100
+#define PLUGIN_COLLECT_BUDGET_US     20000
+#define PLUGIN_MAX_COLLECT_BUDGET_US 200000
+#define PLUGIN_RENDER_BUDGET_US      1500000
+#define PLUGIN_MAX_RENDER_BUDGET_US  3000000
+
+const char* plugin_dir(void);
+int plugin_load_dir(const char *dir);
+
+#endif /*__PLUGIN_H*/
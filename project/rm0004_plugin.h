@@ -0,0 +1,91 @@
+/*
+ * rm0004_plugin.h — plugin ABI for the UCTRONICS display daemon
+ *
+ * A plugin is a shared object exporting
+ *
+ *     const struct rm0004_plugin *rm0004_plugin_entry(uint32_t host_abi);
+ *
+ * The daemon loads every *.so in its plugin directory at startup. The
+ * collector runs on the daemon's sampler at interval_ms and writes at most
+ * sample_size bytes into the buffer it is given. The render callback draws
+ * one page from the latest sample, using only the primitives in
+ * struct rm0004_draw_api, so plugins do not link against the display
+ * library and keep working across daemon updates.
+ *
+ * Both callbacks are timed. A collector over budget is backed off and then
+ * disabled; a page over its render budget several times in a row is
+ * dropped from the rotation. Render runs on a thread of the plugin's own,
+ * and a panel waits for it at most the render budget: a render that takes
+ * longer is abandoned, and the page is skipped until it returns.
+ *
+ * Only append fields to these structs; bump RM0004_PLUGIN_ABI_VERSION when
+ * an existing field changes meaning.
+ */
+#ifndef __RM0004_PLUGIN_H__
+#define __RM0004_PLUGIN_H__
+
+#include <stdint.h>
+
+#define RM0004_PLUGIN_ABI_VERSION  1
+#define RM0004_PLUGIN_ENTRY        "rm0004_plugin_entry"
+/* Largest sample a collector may produce */
+#define RM0004_PLUGIN_MAX_SAMPLE   256
+
+/* Font ids accepted by write_text, same values as FontType */
+#define RM0004_FONT_7x10   0
+#define RM0004_FONT_8x16   1
+#define RM0004_FONT_11x18  2
+#define RM0004_FONT_16x26  3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rm0004_draw_api
+{
+    uint32_t abi_version;
+    uint32_t size;            /* sizeof(struct rm0004_draw_api) in the host */
+    uint16_t width;
+    uint16_t height;
+    uint16_t top;             /* first row below the header; cleared before render */
+    void *surface;            /* pass back as the first argument of every call */
+
+    void (*fill_rect)(void *surface, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
+    void (*write_text)(void *surface, uint16_t x, uint16_t y, const char *str, int font,
+                       uint16_t color, uint16_t bgcolor);
+    /* largest font that fits the box; ellipsis when nothing fits */
+    void (*fit_text)(void *surface, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const char *str,
+                     uint16_t color, uint16_t bgcolor);
+    /* the stock ten-cell bar under the value, percent 0..100 */
+    void (*draw_bar)(void *surface, uint8_t percent, uint16_t color);
+    /* w*h big-endian RGB565 pixels */
+    void (*draw_image)(void *surface, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *data);
+};
+
+struct rm0004_plugin
+{
+    uint32_t abi_version;      /* RM0004_PLUGIN_ABI_VERSION the plugin was built against */
+    const char *name;
+    uint32_t sample_size;      /* bytes, at most RM0004_PLUGIN_MAX_SAMPLE; 0 without a collector */
+    uint32_t interval_ms;      /* collector period; 0 for the daemon default */
+    uint32_t collect_budget_us;/* 0 for the daemon default */
+    uint32_t render_budget_us; /* 0 for the daemon default */
+    uint32_t dwell_ms;         /* how long the page stays up; 0 for the default */
+
+    /* optional; non-zero keeps the plugin from loading */
+    int (*init)(void);
+    /* optional; return 0 when buf holds a valid sample. Runs on a sampler thread. */
+    int (*collect)(void *buf, uint32_t len);
+    /* optional; sample is NULL until the first successful collect */
+    void (*render)(const void *sample, uint32_t len, const struct rm0004_draw_api *api);
+    /* reserved; the daemon keeps plugins loaded for its whole lifetime */
+    void (*fini)(void);
+};
+
+typedef const struct rm0004_plugin *(*rm0004_plugin_entry_fn)(uint32_t host_abi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RM0004_PLUGIN_H__
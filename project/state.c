@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * state.c — the daemon's state directory
+ *
+ * Small files that let a restarted daemon pick up where it left off,
+ * such as the last frame of every panel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "state.h"
+
+const char* state_dir(void)
+{
+    const char *dir = getenv(STATE_DIR_ENV);
+    return (dir && *dir) ? dir : STATE_DIR;
+}
+
+/*
+ * Path of name inside the state directory, which is created if missing.
+ * Returns 0, or -1 if the directory cannot be created or the path does
+ * not fit.
+ */
+int state_path(char *buf, size_t len, const char *name)
+{
+    const char *dir = state_dir();
+    int n;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "state: cannot create %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    n = snprintf(buf, len, "%s/%s", dir, name);
+    return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
@@ -0,0 +1,13 @@
+#ifndef  __STATE_H
+#define  __STATE_H
+
+#include <stddef.h>
+
+/* Where the daemon keeps what should survive a restart; the environment variable overrides it */
+#define STATE_DIR                   "/var/lib/uctronics-display"
+#define STATE_DIR_ENV               "UCTRONICS_STATE_DIR"
+
+const char* state_dir(void);
+int state_path(char *buf, size_t len, const char *name);
+
+#endif /*__STATE_H*/
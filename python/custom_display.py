@@ -1,58 +1,50 @@
 #!/usr/bin/python
 from enum import Enum
-import os
 import sys
-from ctypes import c_uint16, cdll  
 import time        
+import rm0004  #Build with: python3 setup.py build_ext --inplace
 class FontType(Enum):
-    Font_7x10 = 0
-    Font_8x16 = 1
-    Font_11x18 = 2
-    Font_16x26  = 3         
-
-UCTRONICS = cdll.LoadLibrary('./librm0004_display.so')  #The directory where the dynamic link library is located
+    Font_7x10 = rm0004.FONT_7x10
+    Font_8x16 = rm0004.FONT_8x16
+    Font_11x18 = rm0004.FONT_11x18
+    Font_16x26  = rm0004.FONT_16x26
 
 def getCPUtemperature():
-    res = os.popen('vcgencmd measure_temp').readline()
-    return(res.replace("temp=","").replace("'C\n",""))
+    return("%d" % rm0004.snapshot().temperature)
 
 def getRAMinfo():
-    p = os.popen('free')
-    i = 0
-    while 1:
-        i = i + 1
-        line = p.readline()
-        if i==2:
-            return(line.split()[1:4])
+    s = rm0004.snapshot()
+    return(["%.0f" % s.ram_total_mb, "%.0f" % (s.ram_total_mb - s.ram_available_mb), "%.0f" % s.ram_available_mb])
 
 
 def getDiskSpace():
-    p = os.popen("df -h /")
-    i = 0
-    while 1:
-        i = i +1
-        line = p.readline()
-        if i==2:
-            return(line.split()[1:5])
+    s = rm0004.snapshot()
+    used = s.disk_used_gb * 100 / s.disk_total_gb if s.disk_total_gb else 0
+    return(["%.0fG" % s.disk_total_gb, "%.0fG" % s.disk_used_gb, "%.0fG" % (s.disk_total_gb - s.disk_used_gb), "%.0f%%" % used])
 
 def getCPUuse():
-    return(str(os.popen("top -n1 | awk '/Cpu\(s\):/ {print $2}'").readline().strip()))
+    return("%.1f" % rm0004.snapshot().cpu_percent)
  
 if __name__ == '__main__':
-    if UCTRONICS.lcd_begin() > 0:
+    try:
+        lcd = rm0004.Device(deferred=True)  #draw into the framebuffer, send on flush()
+    except OSError:
         sys.exit(0)
-    UCTRONICS.lcd_fill_screen(0x0000)
+    lcd.fill(0,0,lcd.width,lcd.height,0x0000)
+    lcd.flush()
 
 
     while True:
+        s = rm0004.snapshot()  #one in-process read, no subprocesses
         
-        UCTRONICS.lcd_fill_rectangle(0,10,160,20,80)
-        UCTRONICS.lcd_write_str(5,10,bytes("TEMP:","utf8"),FontType.Font_11x18.value,0xFFFF,80)
-        UCTRONICS.lcd_write_str(65,10,bytes(getCPUtemperature()+"C","utf8"),FontType.Font_11x18.value,0xFFFF,80)
-
-        UCTRONICS.lcd_fill_rectangle(0,45,160,20,80)
-        UCTRONICS.lcd_write_str(5,45,bytes("USE:","utf8"),FontType.Font_11x18.value,0xFFFF,80)
-        UCTRONICS.lcd_write_str(65,45,bytes(getCPUuse()+"%","utf8"),FontType.Font_11x18.value,0xFFFF,80)
+        lcd.fill(0,10,160,20,80)
+        lcd.text(5,10,"TEMP:",FontType.Font_11x18.value,0xFFFF,80)
+        lcd.text(65,10,"%dC" % s.temperature,FontType.Font_11x18.value,0xFFFF,80)
+
+        lcd.fill(0,45,160,20,80)
+        lcd.text(5,45,"USE:",FontType.Font_11x18.value,0xFFFF,80)
+        lcd.text(65,45,"%.1f%%" % s.cpu_percent,FontType.Font_11x18.value,0xFFFF,80)
+        lcd.flush()
         time.sleep(1)
 
             
@@ -0,0 +1,54 @@
+#!/usr/bin/python
+# Pack a frame of drawing into one command buffer (layout in hardware/st7735/drawcmd.h).
+#
+#   cmds = CommandBuffer()
+#   cmds.fill(0, 10, 160, 20, 80)
+#   cmds.text(5, 10, "TEMP: 48C", color=0xFFFF, bgcolor=80)
+#   lcd.submit(cmds.data)                                # rm0004.Device
+#   UCTRONICS.lcd_submit(bytes(cmds.data), len(cmds))   # ctypes, librm0004_display.so
+import struct
+
+CMD_FILL = 1
+CMD_TEXT = 2
+CMD_IMAGE = 3
+CMD_BAR = 4
+
+FONT_7x10 = 0
+FONT_8x16 = 1
+FONT_11x18 = 2
+FONT_16x26 = 3
+
+_HEADER = struct.Struct('<BBH')
+
+
+class CommandBuffer(object):
+    def __init__(self):
+        self.data = bytearray()
+
+    def __len__(self):
+        return len(self.data)
+
+    def clear(self):
+        del self.data[:]
+
+    def _record(self, op, body):
+        self.data += _HEADER.pack(op, 0, _HEADER.size + len(body))
+        self.data += body
+
+    def fill(self, x, y, w, h, color):
+        self._record(CMD_FILL, struct.pack('<5H', x, y, w, h, color))
+
+    def text(self, x, y, s, font=FONT_11x18, color=0xFFFF, bgcolor=0, w=0, h=0):
+        # With w and h set the library picks the largest font that fits the box
+        raw = s.encode('ascii', 'replace')[:64]
+        self._record(CMD_TEXT, struct.pack('<6HBB', x, y, w, h, color, bgcolor, font, len(raw)) + raw)
+
+    def image(self, x, y, w, h, pixels):
+        # pixels: w*h big-endian RGB565 as bytes-like
+        raw = bytes(pixels)
+        if len(raw) != w * h * 2:
+            raise ValueError('need %d bytes of pixels' % (w * h * 2))
+        self._record(CMD_IMAGE, struct.pack('<4H', x, y, w, h) + raw)
+
+    def bar(self, x, y, w, h, percent, color, bgcolor=0):
+        self._record(CMD_BAR, struct.pack('<6HBB', x, y, w, h, color, bgcolor, max(0, min(100, int(percent))), 0))
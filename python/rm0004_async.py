@@ -0,0 +1,52 @@
+#!/usr/bin/python
+# asyncio front end for rm0004.Device: frames go out on the library's flush
+# thread while the event loop keeps running.
+#
+#   display = AsyncDisplay('/dev/i2c-1', 0x18)
+#   display.dev.fill(0, 0, 160, 80, 0x0000)
+#   await display.flush()
+import asyncio
+
+import rm0004
+
+
+class AsyncDisplay(object):
+    def __init__(self, bus='/dev/i2c-1', address=0x18, loop=None):
+        self.dev = rm0004.Device(bus, address, deferred=True)
+        self._loop = loop or asyncio.get_event_loop()
+        self._waiters = []
+        self._fd = self.dev.fileno()
+        self._loop.add_reader(self._fd, self._on_sent)
+
+    def _on_sent(self):
+        self.dev.ack()
+        waiters, self._waiters = self._waiters, []
+        for fut in waiters:
+            if not fut.done():
+                fut.set_result(None)
+
+    async def _idle(self):
+        # The eventfd stays readable until acked, so a frame that finishes
+        # between the busy check and the await still wakes us.
+        while self.dev.busy:
+            fut = self._loop.create_future()
+            self._waiters.append(fut)
+            await fut
+
+    async def flush(self):
+        """Send everything drawn since the last flush; returns once it is on the panel."""
+        while True:
+            try:
+                queued = self.dev.flush_nowait()
+                break
+            except BlockingIOError:
+                if self.dev.busy:
+                    await self._idle()
+                else:
+                    await asyncio.sleep(0)
+        if queued:
+            await self._idle()
+
+    def close(self):
+        self._loop.remove_reader(self._fd)
+        self.dev.close()
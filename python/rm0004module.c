@@ -0,0 +1,602 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * rm0004module.c — native Python binding for the SKU_RM0004 panel
+ *
+ * rm0004.Device wraps one lcd_ctx. Pixel data is read straight out of any
+ * object that supports the buffer protocol (bytes, bytearray, memoryview,
+ * array, numpy), and the GIL is released for as long as a call may touch
+ * the bus, so other Python threads keep running during a flush.
+ *
+ * Panels are driven through the library's per-bus flush worker. An event
+ * loop can start a flush with flush_nowait() and learn that it finished
+ * from the eventfd returned by fileno(); rm0004_async.py wraps this as
+ * "await display.flush()".
+ *
+ * rm0004.snapshot() reads every system figure the stock pages show in one
+ * call, so custom displays need no subprocesses.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lcd_ctx.h"
+#include "lcd_bus.h"
+#include "drawcmd.h"
+#include "snapshot.h"
+
+typedef struct
+{
+    PyObject_HEAD
+    lcd_ctx *ctx;
+    PyThread_type_lock lock;    /* one call on the panel at a time */
+} Device;
+
+/*
+ * Run stmt on the panel with the GIL released and the device lock held.
+ * If the device was closed while the call waited for the lock, stmt is
+ * not run; ValueError is set and closed, e.g. "return NULL", runs instead.
+ */
+#define DEVICE_CALL_OR(self, stmt, closed)              \
+    do                                                  \
+    {                                                   \
+        int closed_;                                    \
+        Py_BEGIN_ALLOW_THREADS                          \
+        PyThread_acquire_lock((self)->lock, WAIT_LOCK); \
+        closed_ = !(self)->ctx;                         \
+        if (!closed_)                                   \
+        {                                               \
+            stmt;                                       \
+        }                                               \
+        PyThread_release_lock((self)->lock);            \
+        Py_END_ALLOW_THREADS                            \
+        if (closed_)                                    \
+        {                                               \
+            PyErr_SetString(PyExc_ValueError, "device is closed"); \
+            closed;                                     \
+        }                                               \
+    } while (0)
+
+#define DEVICE_CALL(self, stmt) DEVICE_CALL_OR(self, stmt, return NULL)
+
+static int device_check(Device *self)
+{
+    if (!self->ctx)
+    {
+        PyErr_SetString(PyExc_ValueError, "device is closed");
+        return -1;
+    }
+    return 0;
+}
+
+static int device_init(Device *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"bus", "address", "deferred", NULL};
+    const char *bus = "/dev/i2c-1";
+    int address = I2C_ADDRESS;
+    int deferred = 0;
+    lcd_ctx *ctx;
+    lcd_bus *link;
+    uint8_t rc;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sip", kwlist, &bus, &address, &deferred))
+        return -1;
+    if (address < 0x03 || address > 0x77)
+    {
+        PyErr_Format(PyExc_ValueError, "address 0x%x out of range", address);
+        return -1;
+    }
+    if (self->ctx)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "device already open");
+        return -1;
+    }
+    if (!self->lock && !(self->lock = PyThread_allocate_lock()))
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    ctx = lcd_ctx_create();
+    if (!ctx)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    link = lcd_bus_get(bus);
+    rc = link ? lcd_bus_attach(ctx, link, (uint8_t)address) : 1;
+    Py_END_ALLOW_THREADS
+    if (rc)
+    {
+        lcd_ctx_destroy(ctx);
+        PyErr_Format(PyExc_OSError, "cannot open panel 0x%02x on %s", address, bus);
+        return -1;
+    }
+    ctx->deferred = deferred ? 1 : 0;
+    self->ctx = ctx;
+    return 0;
+}
+
+/*
+ * Take the context away from the device and destroy it. The pointer is
+ * swapped out holding both the GIL and the device lock, so neither a call
+ * in flight nor a getter can still be using it when it is destroyed.
+ */
+static void device_close_ctx(Device *self)
+{
+    lcd_ctx *ctx;
+
+    if (!self->ctx || !self->lock)
+        return;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+    ctx = self->ctx;
+    self->ctx = NULL;
+    Py_BEGIN_ALLOW_THREADS
+    if (ctx)
+        lcd_ctx_destroy(ctx);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+}
+
+static void device_dealloc(Device *self)
+{
+    device_close_ctx(self);
+    if (self->lock)
+        PyThread_free_lock(self->lock);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+PyDoc_STRVAR(device_blit_doc,
+"blit(buffer, x, y, w, h)\n\n"
+"Copy a w x h RGB565 image to (x, y). A buffer of 16-bit items (array('H'),\n"
+"numpy.uint16) holds pixels in host byte order and may be a 2-D view with a\n"
+"row stride; any other buffer holds big-endian pixel bytes, row after row.\n"
+"Views that are reversed or strided are copied first.");
+
+static PyObject *device_blit(Device *self, PyObject *args)
+{
+    PyObject *obj;
+    PyObject *result = NULL;
+    Py_buffer view;
+    void *copy = NULL;
+    const void *pixels;
+    int x, y, w, h;
+    Py_ssize_t need;
+    Py_ssize_t stride;
+    uint8_t in_place = 0;
+
+    if (device_check(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTuple(args, "Oiiii", &obj, &x, &y, &w, &h))
+        return NULL;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_STRIDES | PyBUF_FORMAT) < 0)
+        return NULL;
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x > 0xFFFF || y > 0xFFFF || w > 0xFFFF || h > 0xFFFF)
+    {
+        PyErr_SetString(PyExc_ValueError, "bad rectangle");
+        goto done;
+    }
+
+    need = (Py_ssize_t)w * h;
+    pixels = view.buf;
+    stride = w;
+    if (view.itemsize == 2 && view.ndim == 2 && view.strides)
+    {
+        /* host-order pixels in rows of at least w, read in place if the rows are forward and unbroken */
+        if (view.shape[0] < h || view.shape[1] < w)
+        {
+            PyErr_SetString(PyExc_ValueError, "need h x w or larger rows of pixels");
+            goto done;
+        }
+        if (view.strides[1] == 2 && view.strides[0] >= (Py_ssize_t)w * 2 && view.strides[0] % 2 == 0)
+        {
+            stride = view.strides[0] / 2;
+            in_place = 1;
+        }
+        else
+        {
+            stride = view.shape[1];
+        }
+    }
+    else if (view.len < need * 2)
+    {
+        if (view.itemsize == 2)
+            PyErr_Format(PyExc_ValueError, "need %zd pixels", need);
+        else
+            PyErr_Format(PyExc_ValueError, "need %zd bytes", need * 2);
+        goto done;
+    }
+    if (!in_place && !PyBuffer_IsContiguous(&view, 'C'))
+    {
+        /* reversed, strided or broken rows: read them in order from a copy */
+        if (!(copy = PyMem_Malloc(view.len)))
+        {
+            PyErr_NoMemory();
+            goto done;
+        }
+        if (PyBuffer_ToContiguous(copy, &view, view.len, 'C') < 0)
+            goto done;
+        pixels = copy;
+    }
+
+    if (view.itemsize == 2)
+        DEVICE_CALL_OR(self, lcd_ctx_draw_pixels(self->ctx, (uint16_t)x, (uint16_t)y, (uint16_t)w, (uint16_t)h,
+                                                 (const uint16_t *)pixels, (uint32_t)stride), goto done);
+    else
+        DEVICE_CALL_OR(self, lcd_ctx_draw_image(self->ctx, (uint16_t)x, (uint16_t)y, (uint16_t)w, (uint16_t)h,
+                                                (const uint8_t *)pixels), goto done);
+    Py_INCREF(Py_None);
+    result = Py_None;
+done:
+    PyMem_Free(copy);
+    PyBuffer_Release(&view);
+    return result;
+}
+
+PyDoc_STRVAR(device_fill_doc,
+"fill(x, y, w, h, color)\n\nFill a rectangle with an RGB565 color.");
+
+static PyObject *device_fill(Device *self, PyObject *args)
+{
+    unsigned short x, y, w, h, color;
+
+    if (device_check(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTuple(args, "HHHHH", &x, &y, &w, &h, &color))
+        return NULL;
+    DEVICE_CALL(self, lcd_ctx_fill_rectangle(self->ctx, x, y, w, h, color));
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(device_text_doc,
+"text(x, y, s, font=FONT_11x18, color=0xFFFF, background=0)\n\n"
+"Draw a string; characters past the right edge are dropped.");
+
+static PyObject *device_text(Device *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"x", "y", "s", "font", "color", "background", NULL};
+    unsigned short x, y;
+    unsigned short color = ST7735_WHITE;
+    unsigned short background = ST7735_BLACK;
+    int font = FontType_11x18;
+    const char *s;
+
+    if (device_check(self) < 0)
+        return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "HHs|iHH", kwlist, &x, &y, &s, &font, &color, &background))
+        return NULL;
+    if (font < FontType_7x10 || font > FontType_16x26)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown font %d", font);
+        return NULL;
+    }
+    DEVICE_CALL(self, lcd_ctx_write_str(self->ctx, x, y, s, (FontType)font, color, background));
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(device_submit_doc,
+"submit(buffer) -> int\n\n"
+"Run a packed command buffer (see drawcmd.py) as one frame and return the\n"
+"number of commands. A malformed buffer draws nothing and raises ValueError.");
+
+static PyObject *device_submit(Device *self, PyObject *arg)
+{
+    Py_buffer view;
+    int count;
+
+    if (device_check(self) < 0)
+        return NULL;
+    if (PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) < 0)
+        return NULL;
+    if (view.len > UINT32_MAX)
+    {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "command buffer too large");
+        return NULL;
+    }
+    DEVICE_CALL_OR(self, count = lcd_ctx_submit(self->ctx, (const uint8_t *)view.buf, (uint32_t)view.len),
+                   PyBuffer_Release(&view); return NULL);
+    PyBuffer_Release(&view);
+    if (count < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "malformed command buffer");
+        return NULL;
+    }
+    return PyLong_FromLong(count);
+}
+
+PyDoc_STRVAR(device_flush_doc,
+"flush()\n\nSend everything drawn since the last flush as one burst.");
+
+static PyObject *device_flush(Device *self, PyObject *Py_UNUSED(ignored))
+{
+    if (device_check(self) < 0)
+        return NULL;
+    DEVICE_CALL(self, lcd_ctx_flush(self->ctx));
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(device_flush_nowait_doc,
+"flush_nowait() -> bool\n\n"
+"Queue everything drawn since the last flush and return at once: True if\n"
+"a frame was queued, False if nothing changed. Raises BlockingIOError if\n"
+"the previous frame is still going out; wait for fileno() to be readable.");
+
+static PyObject *device_flush_nowait(Device *self, PyObject *Py_UNUSED(ignored))
+{
+    int rc;
+
+    if (device_check(self) < 0)
+        return NULL;
+    DEVICE_CALL(self, rc = lcd_ctx_try_flush(self->ctx));
+    if (rc < 0)
+    {
+        PyErr_SetString(PyExc_BlockingIOError, "previous frame still being sent");
+        return NULL;
+    }
+    return PyBool_FromLong(rc);
+}
+
+PyDoc_STRVAR(device_fileno_doc,
+"fileno() -> int\n\n"
+"eventfd that becomes readable whenever a frame has reached the panel;\n"
+"clear it with ack(). Closed with the device.");
+
+static PyObject *device_fileno(Device *self, PyObject *Py_UNUSED(ignored))
+{
+    int fd;
+
+    if (device_check(self) < 0)
+        return NULL;
+    DEVICE_CALL(self, fd = lcd_ctx_event_fd(self->ctx));
+    if (fd < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    return PyLong_FromLong(fd);
+}
+
+PyDoc_STRVAR(device_ack_doc,
+"ack() -> int\n\nClear the eventfd; returns the frames finished since the last ack().");
+
+static PyObject *device_ack(Device *self, PyObject *Py_UNUSED(ignored))
+{
+    uint64_t count = 0;
+
+    if (device_check(self) < 0)
+        return NULL;
+    /* under the lock: close() may be destroying the context and its eventfd */
+    DEVICE_CALL(self, if (self->ctx->event_fd >= 0 &&
+                          read(self->ctx->event_fd, &count, sizeof(count)) != sizeof(count))
+                          count = 0);   /* EAGAIN: nothing finished */
+    return PyLong_FromUnsignedLongLong(count);
+}
+
+PyDoc_STRVAR(device_close_doc, "close()\n\nRelease the bus. Further calls raise ValueError.");
+
+static PyObject *device_close(Device *self, PyObject *Py_UNUSED(ignored))
+{
+    device_close_ctx(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *device_enter(Device *self, PyObject *Py_UNUSED(ignored))
+{
+    if (device_check(self) < 0)
+        return NULL;
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *device_exit(Device *self, PyObject *Py_UNUSED(args))
+{
+    device_close_ctx(self);
+    Py_RETURN_FALSE;
+}
+
+static PyObject *device_get_deferred(Device *self, void *closure)
+{
+    (void)closure;
+    if (device_check(self) < 0)
+        return NULL;
+    return PyBool_FromLong(self->ctx->deferred);
+}
+
+static int device_set_deferred(Device *self, PyObject *value, void *closure)
+{
+    int deferred;
+
+    (void)closure;
+    if (device_check(self) < 0)
+        return -1;
+    if (!value || (deferred = PyObject_IsTrue(value)) < 0)
+    {
+        if (!value)
+            PyErr_SetString(PyExc_TypeError, "cannot delete deferred");
+        return -1;
+    }
+    /* turning deferral off flushes, so this may touch the bus */
+    DEVICE_CALL_OR(self, lcd_ctx_set_deferred(self->ctx, (uint8_t)deferred), return -1);
+    return 0;
+}
+
+static PyObject *device_get_busy(Device *self, void *closure)
+{
+    uint8_t busy;
+
+    (void)closure;
+    if (device_check(self) < 0)
+        return NULL;
+    DEVICE_CALL(self, busy = lcd_ctx_busy(self->ctx));
+    return PyBool_FromLong(busy);
+}
+
+static PyObject *device_get_width(Device *self, void *closure)
+{
+    (void)closure;
+    if (device_check(self) < 0)
+        return NULL;
+    return PyLong_FromLong(self->ctx->width);
+}
+
+static PyObject *device_get_height(Device *self, void *closure)
+{
+    (void)closure;
+    if (device_check(self) < 0)
+        return NULL;
+    return PyLong_FromLong(self->ctx->height);
+}
+
+static PyMethodDef device_methods[] = {
+    {"blit", (PyCFunction)device_blit, METH_VARARGS, device_blit_doc},
+    {"fill", (PyCFunction)device_fill, METH_VARARGS, device_fill_doc},
+    {"text", (PyCFunction)(void (*)(void))device_text, METH_VARARGS | METH_KEYWORDS, device_text_doc},
+    {"submit", (PyCFunction)device_submit, METH_O, device_submit_doc},
+    {"flush", (PyCFunction)device_flush, METH_NOARGS, device_flush_doc},
+    {"flush_nowait", (PyCFunction)device_flush_nowait, METH_NOARGS, device_flush_nowait_doc},
+    {"fileno", (PyCFunction)device_fileno, METH_NOARGS, device_fileno_doc},
+    {"ack", (PyCFunction)device_ack, METH_NOARGS, device_ack_doc},
+    {"close", (PyCFunction)device_close, METH_NOARGS, device_close_doc},
+    {"__enter__", (PyCFunction)device_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)device_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef device_getset[] = {
+    {"deferred", (getter)device_get_deferred, (setter)device_set_deferred,
+     "Only send on flush(); when False every call is sent before it returns.", NULL},
+    {"busy", (getter)device_get_busy, NULL, "A flushed frame has not reached the panel yet.", NULL},
+    {"width", (getter)device_get_width, NULL, "Panel width in pixels.", NULL},
+    {"height", (getter)device_get_height, NULL, "Panel height in pixels.", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+PyDoc_STRVAR(device_doc,
+"Device(bus='/dev/i2c-1', address=0x18, deferred=False)\n\n"
+"One SKU_RM0004 panel. Drawing goes to a shadow framebuffer; in deferred\n"
+"mode nothing is sent until flush().");
+
+static PyTypeObject DeviceType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "rm0004.Device",
+    .tp_basicsize = sizeof(Device),
+    .tp_dealloc = (destructor)device_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = device_doc,
+    .tp_methods = device_methods,
+    .tp_getset = device_getset,
+    .tp_init = (initproc)device_init,
+    .tp_new = PyType_GenericNew,
+};
+
+static PyStructSequence_Field snapshot_fields[] = {
+    {"cpu_percent", "busy share of all CPUs since the previous snapshot"},
+    {"load1", "1-minute load average"},
+    {"temperature", "SoC temperature, degrees"},
+    {"ram_total_mb", NULL},
+    {"ram_available_mb", NULL},
+    {"disk_total_gb", "root filesystem size"},
+    {"disk_used_gb", NULL},
+    {"hostname", NULL},
+    {"address", "\"hostname ip\" as the CPU page shows it"},
+    {NULL, NULL}
+};
+
+static PyStructSequence_Desc snapshot_desc = {
+    "rm0004.Snapshot",
+    "System readings taken together by rm0004.snapshot().",
+    snapshot_fields,
+    9
+};
+
+static PyTypeObject SnapshotType;
+
+PyDoc_STRVAR(snapshot_doc,
+"snapshot() -> Snapshot\n\n"
+"Read CPU, memory, temperature, disk and address in-process, in one call.");
+
+static PyObject *rm0004_snapshot(PyObject *module, PyObject *Py_UNUSED(ignored))
+{
+    rpi_snapshot s;
+    PyObject *t;
+    int rc;
+
+    (void)module;
+    Py_BEGIN_ALLOW_THREADS
+    rc = rpi_snapshot_take(&s, sizeof(s));
+    Py_END_ALLOW_THREADS
+    if (rc != 0)
+    {
+        PyErr_SetString(PyExc_OSError, "snapshot failed");
+        return NULL;
+    }
+    t = PyStructSequence_New(&SnapshotType);
+    if (!t)
+        return NULL;
+    PyStructSequence_SET_ITEM(t, 0, PyFloat_FromDouble(s.cpu_percent));
+    PyStructSequence_SET_ITEM(t, 1, PyFloat_FromDouble(s.load1));
+    PyStructSequence_SET_ITEM(t, 2, PyFloat_FromDouble(s.temperature));
+    PyStructSequence_SET_ITEM(t, 3, PyFloat_FromDouble(s.ram_total_mb));
+    PyStructSequence_SET_ITEM(t, 4, PyFloat_FromDouble(s.ram_available_mb));
+    PyStructSequence_SET_ITEM(t, 5, PyFloat_FromDouble(s.disk_total_gb));
+    PyStructSequence_SET_ITEM(t, 6, PyFloat_FromDouble(s.disk_used_gb));
+    PyStructSequence_SET_ITEM(t, 7, PyUnicode_DecodeUTF8(s.hostname, strlen(s.hostname), "replace"));
+    PyStructSequence_SET_ITEM(t, 8, PyUnicode_DecodeUTF8(s.address, strlen(s.address), "replace"));
+    if (PyErr_Occurred())
+    {
+        Py_DECREF(t);
+        return NULL;
+    }
+    return t;
+}
+
+static PyMethodDef rm0004_methods[] = {
+    {"snapshot", (PyCFunction)rm0004_snapshot, METH_NOARGS, snapshot_doc},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef rm0004_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "rm0004",
+    .m_doc = "Native driver for the UCTRONICS SKU_RM0004 I2C panel.",
+    .m_size = -1,
+    .m_methods = rm0004_methods,
+};
+
+PyMODINIT_FUNC PyInit_rm0004(void)
+{
+    PyObject *m;
+
+    if (PyType_Ready(&DeviceType) < 0)
+        return NULL;
+    if (!SnapshotType.tp_name && PyStructSequence_InitType2(&SnapshotType, &snapshot_desc) < 0)
+        return NULL;
+    m = PyModule_Create(&rm0004_module);
+    if (!m)
+        return NULL;
+    Py_INCREF(&DeviceType);
+    if (PyModule_AddObject(m, "Device", (PyObject *)&DeviceType) < 0)
+    {
+        Py_DECREF(&DeviceType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(&SnapshotType);
+    if (PyModule_AddObject(m, "Snapshot", (PyObject *)&SnapshotType) < 0)
+    {
+        Py_DECREF(&SnapshotType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    PyModule_AddIntConstant(m, "FONT_7x10", FontType_7x10);
+    PyModule_AddIntConstant(m, "FONT_8x16", FontType_8x16);
+    PyModule_AddIntConstant(m, "FONT_11x18", FontType_11x18);
+    PyModule_AddIntConstant(m, "FONT_16x26", FontType_16x26);
+    PyModule_AddIntConstant(m, "WIDTH", ST7735_WIDTH);
+    PyModule_AddIntConstant(m, "HEIGHT", ST7735_HEIGHT);
+    return m;
+}
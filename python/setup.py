@@ -0,0 +1,41 @@
+#!/usr/bin/python
+# Build the native module in place:  python3 setup.py build_ext --inplace
+import os
+from setuptools import setup, Extension
+
+ROOT = os.path.relpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+SOURCES = [
+    'hardware/rpiInfo/rpiInfo.c',
+    'hardware/rpiInfo/sampler.c',
+    'hardware/rpiInfo/snapshot.c',
+    'hardware/rpiInfo/history.c',
+    'hardware/rpiInfo/histfile.c',
+    'hardware/rpiInfo/quantile.c',
+    'hardware/rpiInfo/rules.c',
+    'hardware/st7735/st7735.c',
+    'hardware/st7735/fonts.c',
+    'hardware/st7735/textlayout.c',
+    'hardware/st7735/raster.c',
+    'hardware/st7735/anim.c',
+    'hardware/st7735/drawcmd.c',
+    'hardware/st7735/fbstore.c',
+    'hardware/st7735/splash.c',
+    'hardware/st7735/lcd_bus.c',
+    'hardware/st7735/lcd_probe.c',
+]
+
+rm0004 = Extension(
+    'rm0004',
+    sources=[os.path.join(os.path.dirname(__file__) or '.', 'rm0004module.c')] +
+            [os.path.join(ROOT, s) for s in SOURCES],
+    include_dirs=[os.path.join(ROOT, 'hardware/rpiInfo'), os.path.join(ROOT, 'hardware/st7735')],
+    libraries=['pthread'],
+)
+
+setup(
+    name='rm0004',
+    version='1.0',
+    description='Native driver for the UCTRONICS SKU_RM0004 I2C panel',
+    ext_modules=[rm0004],
+)
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * alertbench.c — time an alert posted while a full-screen page is on the bus
+ *
+ *   LD_PRELOAD=$PWD/tools/stubbus.so ./tools/alertbench [BUS] [ROUNDS]
+ *
+ * Attaches two panels, 0x18 and 0x19, to BUS (default /tmp/stubbus; use
+ * tools/stubbus.so to run it on a plain file). Each round starts a
+ * full-screen flush on 0x18 and, 30 ms later, posts a 40x16 alert on
+ * either panel through the normal or the urgent lane. For each case it
+ * prints the least, average and most time from posting the alert until
+ * it was on the panel: for the urgent lane as the bus stats count it,
+ * for the normal lane until the alert's panel had nothing left to send.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lcd_bus.h"
+#include "sampler.h"
+
+#define BENCH_LEAD_MS  30
+#define BENCH_ALERT_W  40
+#define BENCH_ALERT_H  16
+
+typedef struct Result
+{
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    int rounds;
+} Result;
+
+static void idle_wait(lcd_ctx *a, lcd_ctx *b)
+{
+    while (lcd_bus_busy(a) || lcd_bus_busy(b))
+        usleep(1000);
+}
+
+static void note(Result *r, uint32_t us)
+{
+    if (r->rounds == 0 || us < r->min_us)
+        r->min_us = us;
+    if (us > r->max_us)
+        r->max_us = us;
+    r->sum_us += us;
+    r->rounds++;
+}
+
+/* One round: a page on a, then an alert on target; returns the alert's latency in us */
+static uint32_t round_once(lcd_bus *bus, lcd_ctx *a, lcd_ctx *b, lcd_ctx *target, int urgent, int n)
+{
+    lcd_bus_stats before;
+    lcd_bus_stats after;
+    uint64_t t0;
+
+    /* a different colour every round, so the whole screen has changed */
+    lcd_ctx_fill_screen(a, (uint16_t)(0x1082 * (n % 15 + 1)));
+    lcd_ctx_flush_async(a);
+    usleep(BENCH_LEAD_MS * 1000);
+
+    lcd_ctx_fill_rectangle(target, 60, 32, BENCH_ALERT_W, BENCH_ALERT_H, (uint16_t)((n >> 1) & 1 ? 0xf800 : 0xffe0));
+    lcd_bus_get_stats(bus, &before);
+    t0 = sampler_now_us();
+    if (urgent)
+    {
+        lcd_ctx_flush_urgent(target);
+        idle_wait(a, b);
+        lcd_bus_get_stats(bus, &after);
+        return (uint32_t)(after.urgent_us - before.urgent_us);
+    }
+    lcd_ctx_flush_async(target);
+    while (lcd_bus_busy(target))
+        usleep(100);
+    t0 = sampler_now_us() - t0;
+    idle_wait(a, b);
+    return (uint32_t)t0;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const names[2][2] = {{"normal lane, same panel ", "normal lane, other panel"},
+                                            {"urgent lane, same panel ", "urgent lane, other panel"}};
+    const char *path = argc > 1 ? argv[1] : "/tmp/stubbus";
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    Result results[2][2];
+    lcd_bus_stats stats;
+    lcd_bus *bus;
+    lcd_ctx *a;
+    lcd_ctx *b;
+    int urgent;
+    int other;
+    int i;
+    int n = 0;
+
+    if (rounds < 1)
+        rounds = 1;
+    bus = lcd_bus_get(path);
+    a = lcd_ctx_create();
+    b = lcd_ctx_create();
+    if (!bus || !a || !b || lcd_bus_attach(a, bus, 0x18) != 0 || lcd_bus_attach(b, bus, 0x19) != 0)
+        return 1;
+    lcd_ctx_set_deferred(a, 1);
+    lcd_ctx_set_deferred(b, 1);
+
+    /* put a first frame on both, so later rounds only send what changed */
+    lcd_ctx_fill_screen(a, 0x0000);
+    lcd_ctx_fill_screen(b, 0x0000);
+    lcd_ctx_flush(a);
+    lcd_ctx_flush(b);
+
+    memset(results, 0, sizeof(results));
+    for (i = 0; i < rounds; i++)
+    {
+        for (urgent = 0; urgent < 2; urgent++)
+        {
+            for (other = 0; other < 2; other++)
+                note(&results[urgent][other], round_once(bus, a, b, other ? b : a, urgent, n++));
+        }
+    }
+
+    lcd_bus_get_stats(bus, &stats);
+    printf("%s: %d rounds, alert %dx%d posted %d ms into a full-screen flush, %u-byte messages\n",
+           path, rounds, BENCH_ALERT_W, BENCH_ALERT_H, BENCH_LEAD_MS, stats.chunk_bytes);
+    for (urgent = 0; urgent < 2; urgent++)
+    {
+        for (other = 0; other < 2; other++)
+        {
+            Result *r = &results[urgent][other];
+
+            printf("  %s  min %6.1f ms  avg %6.1f ms  max %6.1f ms\n", names[urgent][other],
+                   r->min_us / 1000.0, r->sum_us / 1000.0 / r->rounds, r->max_us / 1000.0);
+        }
+    }
+    printf("  preemptions %u, longest urgent wait for the wire %.1f ms\n",
+           stats.preemptions, stats.max_urgent_wait_us / 1000.0);
+    return 0;
+}
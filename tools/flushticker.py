@@ -0,0 +1,46 @@
+#!/usr/bin/python
+# Check that an asyncio loop keeps running while AsyncDisplay flushes.
+#
+#   LD_PRELOAD=$PWD/tools/stubbus.so PYTHONPATH=python:<build dir> \
+#       python3 tools/flushticker.py [BUS] [FLUSHES]
+#
+# A ticker task wakes every 5 ms while full-screen frames go out on BUS
+# (default /tmp/stubbus, a plain file under tools/stubbus.so). Prints how
+# long each flush took and how many ticks ran during it; a loop blocked
+# by the flush would show none.
+import asyncio
+import sys
+import time
+
+from rm0004_async import AsyncDisplay
+
+TICK_S = 0.005
+
+
+async def ticker(counter):
+    while True:
+        await asyncio.sleep(TICK_S)
+        counter[0] += 1
+
+
+async def main(bus, flushes):
+    display = AsyncDisplay(bus, 0x18)
+    counter = [0]
+    task = asyncio.ensure_future(ticker(counter))
+    try:
+        for i in range(flushes):
+            display.dev.fill(0, 0, 160, 80, 0x1082 * (i % 15 + 1))
+            ticks = counter[0]
+            start = time.monotonic()
+            await display.flush()
+            print('flush %d: %.1f ms, %d ticks' %
+                  (i, (time.monotonic() - start) * 1000, counter[0] - ticks))
+    finally:
+        task.cancel()
+        display.close()
+
+
+if __name__ == '__main__':
+    asyncio.get_event_loop().run_until_complete(
+        main(sys.argv[1] if len(sys.argv) > 1 else '/tmp/stubbus',
+             int(sys.argv[2]) if len(sys.argv) > 2 else 5))
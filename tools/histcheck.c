@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * histcheck.c — check that the history ring file survives what power loss does to it
+ *
+ *   histcheck [SCRATCH_FILE]
+ *
+ * Writes a history file from scratch (default /tmp/histcheck.bin, which is
+ * overwritten) and checks that:
+ *   - all 210 samples written, one a step too big for a record, decode
+ *     to the values written, in order;
+ *   - a record whose sequence number never got written, as when power
+ *     fails mid-append, loses only the rest of its block;
+ *   - a reopened file appends after the newest block, and the samples
+ *     from before the reopen are still there.
+ * Prints one line per check and exits 1 if any fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "histfile.h"
+
+#define CHECK_SAMPLES   210
+#define CHECK_REOPENED  10
+#define CHECK_MAX       (CHECK_SAMPLES + CHECK_REOPENED)
+
+typedef struct Decoded
+{
+    int count;
+    char series[CHECK_MAX][HISTFILE_NAME_LEN];
+    float value[CHECK_MAX];
+} Decoded;
+
+static const char *const names[] = {"cpu", "temp", "fan"};
+
+static char expect_series[CHECK_MAX][HISTFILE_NAME_LEN];
+static float expect_value[CHECK_MAX];
+static int failures;
+
+static void collect(void *arg, int64_t time_s, const char *series, float value)
+{
+    Decoded *d = (Decoded *)arg;
+
+    (void)time_s;
+    if (d->count < CHECK_MAX)
+    {
+        snprintf(d->series[d->count], HISTFILE_NAME_LEN, "%s", series);
+        d->value[d->count] = value;
+    }
+    d->count++;
+}
+
+static void report(int ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/* Sample i of the run: three series, and one step no record can carry */
+static void append_sample(histfile *hf, int i)
+{
+    int s = i % 3;
+    float v;
+
+    if (s == 0)
+        v = (float)(i % 200) * 0.5f;
+    else if (s == 1)
+        v = 40.f + (float)(i % 7) / 10.f;
+    else
+        v = i == 101 ? 100000.f : 1200.f + (float)i;
+    histfile_append(hf, s, v);
+    snprintf(expect_series[i], HISTFILE_NAME_LEN, "%s", names[s]);
+    expect_value[i] = v;
+}
+
+static histfile *open_named(const char *path)
+{
+    histfile *hf = histfile_open(path);
+    int s;
+
+    for (s = 0; hf && s < 3; s++)
+        histfile_name(hf, s, names[s]);
+    return hf;
+}
+
+/* Whether the first n decoded samples are the first n written, skipping [gap, gap + gap_len) */
+static int matches(const Decoded *d, int n, int gap, int gap_len)
+{
+    float diff;
+    int i;
+    int j = 0;
+
+    for (i = 0; i < n; i++, j++)
+    {
+        if (j == gap)
+            j += gap_len;
+        diff = d->value[i] - expect_value[j];
+        if (strcmp(d->series[i], expect_series[j]) != 0 || diff > 0.051f || diff < -0.051f)
+        {
+            fprintf(stderr, "sample %d: %s %.1f, wrote %s %.1f\n",
+                    i, d->series[i], d->value[i], expect_series[j], expect_value[j]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Zero the sequence number of record k of the oldest block holding more
+ * than k records, as if power failed before it was written. Returns how
+ * many samples that block held from k on, and where they start among all
+ * samples, or -1 if no block is long enough.
+ */
+static int tear_record(const char *path, uint32_t k, int *first_lost)
+{
+    HistBlockHeader b;
+    HistRecord r;
+    uint16_t zero = 0;
+    uint32_t oldest = 0;
+    off_t oldest_at = -1;
+    off_t at;
+    uint32_t used;
+    uint32_t i;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if (fd < 0)
+        return -1;
+    for (i = 0; i < HISTFILE_BLOCKS; i++)
+    {
+        at = (off_t)HISTFILE_BLOCK_BYTES * (i + 1);
+        if (pread(fd, &b, sizeof(b), at) != (ssize_t)sizeof(b) || b.seq == 0)
+            continue;
+        if (pread(fd, &r, sizeof(r), at + sizeof(b) + k * sizeof(r)) != (ssize_t)sizeof(r) || r.seq == 0)
+            continue;
+        if (oldest_at < 0 || b.seq < oldest)
+        {
+            oldest = b.seq;
+            oldest_at = at;
+        }
+    }
+    if (oldest_at < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    pread(fd, &b, sizeof(b), oldest_at);
+    for (used = k; used < HISTFILE_RECORDS; used++)
+    {
+        if (pread(fd, &r, sizeof(r), oldest_at + sizeof(b) + used * sizeof(r)) != (ssize_t)sizeof(r) || r.seq == 0)
+            break;
+    }
+    /* before any reopen, records are numbered from 0, one per sample */
+    *first_lost = (int)(b.first_record + k);
+    pwrite(fd, &zero, sizeof(zero), oldest_at + sizeof(b) + k * sizeof(r));
+    close(fd);
+    return (int)(used - k);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/histcheck.bin";
+    static Decoded d;
+    histfile *hf;
+    int first_lost;
+    int lost;
+    int i;
+
+    unlink(path);
+    hf = open_named(path);
+    if (!hf)
+        return 1;
+    for (i = 0; i < CHECK_SAMPLES; i++)
+        append_sample(hf, i);
+    histfile_close(hf);
+
+    d.count = 0;
+    histfile_read(path, collect, &d);
+    report(d.count == CHECK_SAMPLES && matches(&d, CHECK_SAMPLES, -1, 0),
+           "all 210 samples decode, the oversized step included");
+
+    hf = open_named(path);
+    if (!hf)
+        return 1;
+    for (i = CHECK_SAMPLES; i < CHECK_MAX; i++)
+        append_sample(hf, i);
+    histfile_close(hf);
+
+    d.count = 0;
+    histfile_read(path, collect, &d);
+    report(d.count == CHECK_MAX && matches(&d, CHECK_MAX, -1, 0),
+           "a reopened file appends after the newest block and keeps the old samples");
+
+    lost = tear_record(path, 5, &first_lost);
+    d.count = 0;
+    histfile_read(path, collect, &d);
+    report(lost > 0 && d.count == CHECK_MAX - lost && matches(&d, d.count, first_lost, lost),
+           "a record never stamped loses only the rest of its block");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * histdump.c — print the history ring file the daemon keeps
+ *
+ *   histdump [FILE] [SERIES]
+ *
+ * FILE defaults to the daemon's state directory; one line per sample,
+ * oldest first: local time, series name, value.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "histfile.h"
+#include "state.h"
+
+static void print_sample(void *arg, int64_t time_s, const char *series, float value)
+{
+    const char *only = (const char *)arg;
+    char stamp[32];
+    time_t t = (time_t)time_s;
+    struct tm tm;
+
+    if (only && strcmp(only, series) != 0)
+        return;
+    localtime_r(&t, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s %-8s %.1f\n", stamp, series, value);
+}
+
+int main(int argc, char **argv)
+{
+    char path[256];
+
+    if (argc > 1)
+        snprintf(path, sizeof(path), "%s", argv[1]);
+    else
+        snprintf(path, sizeof(path), "%s/history.bin", state_dir());
+
+    if (histfile_read(path, print_sample, argc > 2 ? argv[2] : NULL) < 0)
+    {
+        fprintf(stderr, "%s: not a history file\n", path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT
+ *
+ * stubbus.c — stand in a plain file for an i2c-dev node, to time the bus code without a panel
+ *
+ *   make tools
+ *   LD_PRELOAD=$PWD/tools/stubbus.so ./display -p /tmp/stubbus:0x18
+ *
+ * Preloaded into the daemon, a tool or Python, it makes I2C_SLAVE and
+ * I2C_SLAVE_FORCE succeed on regular files, so any file can be given as
+ * a bus path; what is written to the "bus" ends up in the file. Writes
+ * to such a file take no wire time unless STUBBUS_HZ is set, in which
+ * case each one sleeps for 9 clocks per byte at that SCL rate, as a real
+ * bus would. The per-message delays of the driver itself are kept
+ * either way.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <linux/i2c-dev.h>
+
+#define STUB_FDS 1024
+
+static uint8_t stub_fd[STUB_FDS];
+
+static int is_file(int fd)
+{
+    struct stat st;
+
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    static int (*real_ioctl)(int, unsigned long, ...);
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if ((request == I2C_SLAVE || request == I2C_SLAVE_FORCE) && is_file(fd))
+    {
+        if (fd >= 0 && fd < STUB_FDS)
+            stub_fd[fd] = 1;
+        return 0;
+    }
+    if (!real_ioctl)
+        real_ioctl = (int (*)(int, unsigned long, ...))dlsym(RTLD_NEXT, "ioctl");
+    return real_ioctl(fd, request, arg);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+    static ssize_t (*real_write)(int, const void *, size_t);
+    static long hz = -1;
+    const char *env;
+
+    if (!real_write)
+        real_write = (ssize_t (*)(int, const void *, size_t))dlsym(RTLD_NEXT, "write");
+    if (hz < 0)
+    {
+        env = getenv("STUBBUS_HZ");
+        hz = env ? atol(env) : 0;
+    }
+    /* a descriptor that was closed and reused may still be marked; check it is a file */
+    if (hz > 0 && fd >= 0 && fd < STUB_FDS && stub_fd[fd] && is_file(fd))
+        usleep((useconds_t)((uint64_t)count * 9 * 1000000 / (uint64_t)hz));
+    return real_write(fd, buf, count);
+}